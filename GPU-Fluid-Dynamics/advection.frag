@@ -3,17 +3,47 @@ uniform sampler2D colour_sampler;
 
 uniform vec2 grid_size;
 
+// The velocity field may be coarser than the grid being advected, velocities
+// are in its texels.
+uniform vec2 velocity_grid_size;
+uniform bool bicubic_velocity;
+
 uniform vec2 mouse_position;
 uniform vec2 mouse_impulse;
 uniform float impulse_radius;
 
 uniform float timestep;
 
+// Cubic B-spline filtered velocity built from four bilinear fetches.
+vec2 bicubicVelocity(vec2 uv)
+{
+	vec2 coord = uv * velocity_grid_size - 0.5;
+	vec2 f = fract(coord);
+	coord -= f;
+
+	vec2 w0 = (1.0 - f) * (1.0 - f) * (1.0 - f) / 6.0;
+	vec2 w1 = (4.0 - 6.0 * f * f + 3.0 * f * f * f) / 6.0;
+	vec2 w3 = f * f * f / 6.0;
+	vec2 w2 = 1.0 - w0 - w1 - w3;
+
+	vec2 g0 = w0 + w1;
+	vec2 g1 = w2 + w3;
+	vec2 h0 = (coord - 0.5 + w1 / g0) / velocity_grid_size;
+	vec2 h1 = (coord + 1.5 + w3 / g1) / velocity_grid_size;
+
+	return g0.y * (g0.x * texture2D(velocity_sampler, h0).xy
+			+ g1.x * texture2D(velocity_sampler, vec2(h1.x, h0.y)).xy)
+		+ g1.y * (g0.x * texture2D(velocity_sampler, vec2(h0.x, h1.y)).xy
+			+ g1.x * texture2D(velocity_sampler, h1).xy);
+}
+
 void main()
 {
 	vec2 uv = gl_FragCoord.xy / grid_size;
 
-	vec2 velocity = texture2D(velocity_sampler, uv).xy;
+	vec2 velocity = bicubic_velocity
+		? bicubicVelocity(uv) : texture2D(velocity_sampler, uv).xy;
+	velocity *= grid_size / velocity_grid_size;
 	vec2 prev_pos = (gl_FragCoord.xy - velocity * timestep) / grid_size;
 
 	vec4 prev_colour = texture2D(colour_sampler, prev_pos);
@@ -27,9 +57,9 @@ void main()
 	
 	// Add some additional ink within the mouse radius.
 	if (r < 1.0) {
-		prev_colour.x = mod(gl_FragCoord.x + gl_FragCoord.y, 100) < 50;
-		prev_colour.y = mod(gl_FragCoord.x, 100) < 50;
-		prev_colour.z = mod(gl_FragCoord.y, 100) < 50;
+		prev_colour.x = float(mod(gl_FragCoord.x + gl_FragCoord.y, 100.0) < 50.0);
+		prev_colour.y = float(mod(gl_FragCoord.x, 100.0) < 50.0);
+		prev_colour.z = float(mod(gl_FragCoord.y, 100.0) < 50.0);
 	}
 
 	gl_FragData[0] = prev_colour;
@@ -0,0 +1,119 @@
+/*
+* Copyright (c) 2017 Owen Glofcheski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#include "async_readback.hpp"
+
+#include <algorithm>
+
+void AsyncReadback::init(int slots) {
+	destroy();
+	ring.resize(std::max(slots, 1));
+	for (Slot &slot : ring) {
+		glGenBuffers(1, &slot.buffer);
+	}
+}
+
+void AsyncReadback::destroy() {
+	for (Slot &slot : ring) {
+		if (slot.fence) {
+			glDeleteSync(slot.fence);
+		}
+		glDeleteBuffers(1, &slot.buffer);
+	}
+	ring.clear();
+	oldest = 0;
+	pending_count = 0;
+}
+
+bool AsyncReadback::readTexture(GLuint texture, GLenum format, GLenum type, size_t bytes, int tag) {
+	Slot *slot = beginRead(bytes, tag);
+	if (!slot) {
+		return false;
+	}
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glGetTexImage(GL_TEXTURE_2D, 0, format, type, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	endRead(slot);
+	return true;
+}
+
+bool AsyncReadback::readFramebuffer(int width, int height, GLenum format, GLenum type, size_t bytes, int tag) {
+	Slot *slot = beginRead(bytes, tag);
+	if (!slot) {
+		return false;
+	}
+	glReadPixels(0, 0, width, height, format, type, 0);
+	endRead(slot);
+	return true;
+}
+
+int AsyncReadback::poll(bool wait, const Callback &callback) {
+	int completed = 0;
+	while (pending_count > 0) {
+		Slot &slot = ring[oldest];
+		GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+			wait ? GL_TIMEOUT_IGNORED : 0);
+		if (status == GL_TIMEOUT_EXPIRED) {
+			break;
+		}
+		glDeleteSync(slot.fence);
+		slot.fence = nullptr;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		const void *data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.bytes, GL_MAP_READ_BIT);
+		if (data) {
+			callback(slot.tag, data, slot.bytes);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		oldest = (oldest + 1) % (int)ring.size();
+		--pending_count;
+		++completed;
+	}
+	return completed;
+}
+
+AsyncReadback::Slot *AsyncReadback::beginRead(size_t bytes, int tag) {
+	if (pending_count == (int)ring.size()) {
+		return nullptr;
+	}
+
+	Slot &slot = ring[(oldest + pending_count) % ring.size()];
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+	if (slot.capacity < bytes) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+		slot.capacity = bytes;
+	}
+	slot.bytes = bytes;
+	slot.tag = tag;
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	return &slot;
+}
+
+void AsyncReadback::endRead(Slot *slot) {
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	++pending_count;
+}
@@ -0,0 +1,57 @@
+#ifndef _ASYNC_READBACK_HPP_
+#define _ASYNC_READBACK_HPP_
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "Utility\gl.hpp"
+
+// Reads textures back through a ring of pixel pack buffers. A read into a
+// bound GL_PIXEL_PACK_BUFFER returns without waiting for the GPU and a fence
+// after it marks when the buffer can be mapped, so results are picked up by
+// poll() a frame or more later rather than stalling the render loop. Reads
+// complete in the order they were queued.
+class AsyncReadback
+{
+public:
+	typedef std::function<void(int tag, const void *data, size_t bytes)> Callback;
+
+	void init(int slots);
+	void destroy();
+
+	// Queues a read of level 0 of |texture|, |bytes| must match |format| and
+	// |type|. Returns false when every slot is still pending.
+	bool readTexture(GLuint texture, GLenum format, GLenum type, size_t bytes, int tag);
+
+	// Queues a read of the bound read framebuffer.
+	bool readFramebuffer(int width, int height, GLenum format, GLenum type, size_t bytes, int tag);
+
+	// Passes each completed read to |callback|, whose data is only valid
+	// during the call. Waits for every pending read when |wait| is set.
+	// Returns the number of reads completed.
+	int poll(bool wait, const Callback &callback);
+
+	int pending() const { return pending_count; }
+	int slots() const { return (int)ring.size(); }
+
+private:
+	struct Slot
+	{
+		GLuint buffer = 0;
+		size_t capacity = 0;
+		size_t bytes = 0;
+		GLsync fence = nullptr;
+		int tag = 0;
+	};
+
+	// Binds the next free slot's buffer with room for |bytes|, or null.
+	Slot *beginRead(size_t bytes, int tag);
+	void endRead(Slot *slot);
+
+	std::vector<Slot> ring;
+	int oldest = 0;
+	int pending_count = 0;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,239 @@
+/*
+* Copyright (c) 2017 Owen Glofcheski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#include "benchmark.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+#include "cpu_solver.hpp"
+#include "domain_solver.hpp"
+
+namespace {
+
+const float kTimestep = 1 / 60.0f;
+
+void stepCpuSolver(const RunConfig &config, CpuSolver &solver) {
+	// The impulse is configured for the config's canvas.
+	solver.setImpulse(config.impulse_x * solver.width() / config.width,
+		config.impulse_y * solver.height() / config.height, config.impulse_dx, config.impulse_dy);
+	solver.step(kTimestep);
+}
+
+const BenchmarkResult *findResult(const std::vector<BenchmarkResult> &results,
+	const BenchmarkResult &match) {
+	for (const BenchmarkResult &result : results) {
+		if (result.backend == match.backend && result.size == match.size && result.stage == match.stage) {
+			return &result;
+		}
+	}
+	return nullptr;
+}
+
+} // namespace
+
+void benchmarkCpuSolver(const RunConfig &config, std::vector<BenchmarkResult> *results) {
+	const BenchmarkSettings &settings = config.benchmark;
+	auto finish = [] {};
+
+	for (int size : settings.sizes) {
+		CpuSolver solver(size, size);
+		solver.settings.pressure = config.pressure;
+		solver.settings.impulse_radius = config.impulse_radius * size / config.width;
+		for (int step = 0; step < settings.warmup_steps; ++step) {
+			stepCpuSolver(config, solver);
+		}
+
+		auto measure = [&](const char *stage, const std::function<void()> &run) {
+			results->push_back(measureStage(settings, "cpu", size, stage, run, finish));
+			const BenchmarkResult &result = results->back();
+			printf("cpu %dx%d %s: %.3f ms\n", size, size, stage, result.ms_per_frame);
+		};
+
+		measure("advect", [&] { solver.advect(kTimestep * solver.settings.advection_scale); });
+		measure("divergence", [&] { solver.calculateDivergence(kTimestep); });
+
+		// Each pressure variant from the same divergence, cold started so
+		// they all do the same work every frame.
+		PressureSettings &pressure = solver.settings.pressure;
+		pressure.warm_start = false;
+		pressure.residual_tolerance = 0;
+		pressure.solver = PressureSolver::Jacobi;
+		solver.settings.pressure_kernel = PressureKernel::Jacobi;
+		measure("pressure_jacobi", [&] { solver.calculatePressure(); });
+		solver.settings.pressure_kernel = PressureKernel::RedBlackGaussSeidel;
+		measure("pressure_red_black", [&] { solver.calculatePressure(); });
+		solver.settings.pressure_kernel = PressureKernel::Jacobi;
+		pressure.solver = PressureSolver::Multigrid;
+		measure("pressure_multigrid", [&] { solver.calculatePressure(); });
+		pressure = config.pressure;
+
+		measure("normalize", [&] { solver.normalizeVelocity(kTimestep); });
+		measure("step", [&] { stepCpuSolver(config, solver); });
+	}
+}
+
+void benchmarkDomainScaling(const RunConfig &config, std::vector<BenchmarkResult> *results) {
+	const BenchmarkSettings &settings = config.benchmark;
+	if (settings.domain_workers.empty()) {
+		return;
+	}
+	auto finish = [] {};
+
+	printf("%d Jacobi iterations, overlap %s\n", settings.domain_iterations,
+		settings.domain_overlap ? "on" : "off");
+	printf("%-7s %8s %7s %11s %10s %9s %11s %10s\n",
+		"scaling", "workers", "layout", "grid", "ms/solve", "gain", "efficiency", "halo wait");
+	for (int weak = 0; weak < 2; ++weak) {
+		int first_workers = settings.domain_workers[0];
+		double first_rate = 0;
+		for (int workers : settings.domain_workers) {
+			// Weak scaling keeps the area per worker, rounded to a multiple
+			// of four for multigrid.
+			int size = settings.domain_size;
+			if (weak) {
+				size = (int)std::lround(size * std::sqrt((double)workers / first_workers) / 4) * 4;
+			}
+
+			CpuSolver solver(size, size);
+			solver.settings.threads = workers;
+			solver.settings.pressure = config.pressure;
+			solver.settings.impulse_radius = config.impulse_radius * size / config.width;
+			for (int step = 0; step < settings.warmup_steps; ++step) {
+				stepCpuSolver(config, solver);
+			}
+
+			PressureSettings &pressure = solver.settings.pressure;
+			pressure.solver = PressureSolver::Jacobi;
+			pressure.jacobi_iterations = settings.domain_iterations;
+			pressure.warm_start = false;
+			pressure.residual_tolerance = 0;
+			DomainSettings &domains = solver.settings.domains;
+			domains = domainLayout(workers, size, size);
+			domains.overlap = settings.domain_overlap;
+			domains.pin_threads = settings.domain_pin_threads;
+
+			char stage[64];
+			snprintf(stage, sizeof(stage), "pressure_%s_%d", weak ? "weak" : "strong", workers);
+			results->push_back(measureStage(settings, "cpu", size, stage,
+				[&] { solver.calculatePressure(); }, finish));
+			const BenchmarkResult &result = results->back();
+
+			// A single worker sweeps without halos.
+			double wait = 0;
+			if (domains.rankCount() > 1) {
+				const DomainSolveStats &stats = solver.domainStats();
+				wait = stats.wait_seconds / std::max(1e-9, stats.wait_seconds + stats.compute_seconds);
+			}
+
+			double rate = result.cellsPerSecond();
+			if (first_rate == 0) {
+				first_rate = rate;
+			}
+			double gain = first_rate > 0 ? rate / first_rate : 0.0;
+			char layout[32];
+			char grid[32];
+			snprintf(layout, sizeof(layout), "%dx%d", domains.columns, domains.rows);
+			snprintf(grid, sizeof(grid), "%dx%d", size, size);
+			printf("%-7s %8d %7s %11s %10.3f %8.2fx %10.1f%% %9.1f%%\n", weak ? "weak" : "strong",
+				workers, layout, grid, result.ms_per_frame, gain,
+				gain * first_workers / workers * 100, wait * 100);
+		}
+	}
+}
+
+bool writeBenchmarkResults(const char *path, const std::vector<BenchmarkResult> &results) {
+	FILE *file = fopen(path, "w");
+	if (!file) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		return false;
+	}
+	fprintf(file, "backend,size,stage,frames,ms_per_frame,cells_per_second\n");
+	for (const BenchmarkResult &result : results) {
+		fprintf(file, "%s,%d,%s,%d,%.4f,%.0f\n", result.backend.c_str(), result.size,
+			result.stage.c_str(), result.frames, result.ms_per_frame, result.cellsPerSecond());
+	}
+	fclose(file);
+	return true;
+}
+
+bool readBenchmarkResults(const char *path, std::vector<BenchmarkResult> *results) {
+	std::ifstream file(path);
+	if (!file) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		return false;
+	}
+
+	results->clear();
+	std::string line;
+	int line_number = 0;
+	while (std::getline(file, line)) {
+		// Skip the header.
+		if (++line_number == 1 || line.empty()) {
+			continue;
+		}
+
+		std::istringstream stream(line);
+		std::string size, frames, ms;
+		BenchmarkResult result;
+		if (!std::getline(stream, result.backend, ',') || !std::getline(stream, size, ',')
+			|| !std::getline(stream, result.stage, ',') || !std::getline(stream, frames, ',')
+			|| !std::getline(stream, ms, ',')) {
+			fprintf(stderr, "%s:%d: expected %s\n", path, line_number,
+				"backend,size,stage,frames,ms_per_frame");
+			return false;
+		}
+		result.size = atoi(size.c_str());
+		result.frames = atoi(frames.c_str());
+		result.ms_per_frame = atof(ms.c_str());
+		results->push_back(result);
+	}
+	return true;
+}
+
+int compareBenchmarkResults(const std::vector<BenchmarkResult> &results,
+	const std::vector<BenchmarkResult> &baseline, float threshold) {
+	int regressions = 0;
+	printf("%-9s %10s %-20s %11s %12s %11s %8s\n",
+		"backend", "grid", "stage", "ms/frame", "Mcells/s", "baseline", "change");
+	for (const BenchmarkResult &result : results) {
+		char grid[32];
+		snprintf(grid, sizeof(grid), "%dx%d", result.size, result.size);
+		printf("%-9s %10s %-20s %11.3f %12.2f", result.backend.c_str(), grid, result.stage.c_str(),
+			result.ms_per_frame, result.cellsPerSecond() / 1e6);
+
+		const BenchmarkResult *reference = findResult(baseline, result);
+		if (!reference || reference->ms_per_frame <= 0) {
+			printf("\n");
+			continue;
+		}
+		double change = (result.ms_per_frame / reference->ms_per_frame - 1) * 100;
+		bool regressed = change > threshold;
+		regressions += regressed;
+		printf(" %11.3f %+7.1f%%%s\n", reference->ms_per_frame, change, regressed ? " REGRESSION" : "");
+	}
+	return regressions;
+}
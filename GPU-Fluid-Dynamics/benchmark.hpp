@@ -0,0 +1,72 @@
+#ifndef _BENCHMARK_HPP_
+#define _BENCHMARK_HPP_
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "run_config.hpp"
+
+// The time of one stage on one backend at one grid size.
+struct BenchmarkResult
+{
+	std::string backend; // cpu, fragment or compute.
+	int size = 0; // grid edge.
+	std::string stage;
+	int frames = 0;
+	double ms_per_frame = 0;
+
+	double cellsPerSecond() const {
+		return ms_per_frame > 0 ? (double)size * size / ms_per_frame * 1000 : 0.0;
+	}
+};
+
+// Runs |run| until |settings.frames| runs or |settings.max_seconds| have
+// passed, calling |finish| before reading the clock, and returns the median
+// frame, which shrugs off the odd descheduled frame that skews a mean.
+template <typename Run, typename Finish>
+BenchmarkResult measureStage(const BenchmarkSettings &settings, const std::string &backend,
+	int size, const std::string &stage, Run run, Finish finish) {
+	BenchmarkResult result;
+	result.backend = backend;
+	result.size = size;
+	result.stage = stage;
+
+	std::vector<double> frame_ms;
+	double seconds = 0;
+	finish();
+	do {
+		auto start = std::chrono::steady_clock::now();
+		run();
+		finish();
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		frame_ms.push_back(ms);
+		seconds += ms / 1000;
+	} while ((int)frame_ms.size() < settings.frames && seconds < settings.max_seconds);
+
+	std::nth_element(frame_ms.begin(), frame_ms.begin() + frame_ms.size() / 2, frame_ms.end());
+	result.frames = (int)frame_ms.size();
+	result.ms_per_frame = frame_ms[frame_ms.size() / 2];
+	return result;
+}
+
+// Measures each CpuSolver stage and pressure kernel in isolation and a full
+// step at every size, using the config's pressure settings and impulse.
+void benchmarkCpuSolver(const RunConfig &config, std::vector<BenchmarkResult> *results);
+
+// The domain decomposed Jacobi solve with every benchmark.domain_workers
+// count, on a fixed grid and on one growing with the workers, printed as the
+// throughput gain and efficiency against the first count.
+void benchmarkDomainScaling(const RunConfig &config, std::vector<BenchmarkResult> *results);
+
+// One line per result, "backend,size,stage,frames,ms_per_frame,cells_per_second".
+bool writeBenchmarkResults(const char *path, const std::vector<BenchmarkResult> &results);
+bool readBenchmarkResults(const char *path, std::vector<BenchmarkResult> *results);
+
+// Prints every result next to its baseline, if any, and returns the number
+// more than |threshold| percent slower.
+int compareBenchmarkResults(const std::vector<BenchmarkResult> &results,
+	const std::vector<BenchmarkResult> &baseline, float threshold);
+
+#endif
\ No newline at end of file
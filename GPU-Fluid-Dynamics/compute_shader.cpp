@@ -0,0 +1,129 @@
+/*
+* Copyright (c) 2017 Owen Glofcheski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#include "compute_shader.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+bool readShaderSource(const char *path, const std::string &defines, std::string *source) {
+	std::ifstream file(path);
+	if (!file) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		return false;
+	}
+	std::stringstream stream;
+	stream << file.rdbuf();
+	*source = stream.str();
+
+	// Defines have to follow the #version line.
+	size_t insert_at = 0;
+	if (source->compare(0, 8, "#version") == 0) {
+		insert_at = source->find('\n') + 1;
+	}
+	source->insert(insert_at, defines);
+	return true;
+}
+
+GLuint loadComputeShader(const char *path, const std::string &defines) {
+	std::string source;
+	if (!readShaderSource(path, defines, &source)) {
+		return 0;
+	}
+
+	GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+	const char *source_ptr = source.c_str();
+	glShaderSource(shader, 1, &source_ptr, NULL);
+	glCompileShader(shader);
+
+	GLint status = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (status != GL_TRUE) {
+		GLint length = 0;
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+		std::vector<char> log(length + 1);
+		glGetShaderInfoLog(shader, length, NULL, &log[0]);
+		fprintf(stderr, "Failed to compile %s:\n%s\n", path, &log[0]);
+		glDeleteShader(shader);
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, shader);
+	glLinkProgram(program);
+	glDeleteShader(shader);
+
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (status != GL_TRUE) {
+		GLint length = 0;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+		std::vector<char> log(length + 1);
+		glGetProgramInfoLog(program, length, NULL, &log[0]);
+		fprintf(stderr, "Failed to link %s:\n%s\n", path, &log[0]);
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	return program;
+}
+
+const char *imageFormatQualifier(GLenum internal_format) {
+	switch (internal_format) {
+		case GL_RGBA32F: return "rgba32f";
+		case GL_RGBA16F: return "rgba16f";
+		case GL_RG32F: return "rg32f";
+		case GL_RG16F: return "rg16f";
+		case GL_R32F: return "r32f";
+		case GL_R16F: return "r16f";
+		case GL_RGBA8: return "rgba8";
+		case GL_RGB10_A2: return "rgb10_a2";
+	}
+	return "rgba32f";
+}
+
+GLenum internalFormatFromQualifier(const std::string &qualifier) {
+	const GLenum formats[] = {
+		GL_RGBA32F, GL_RGBA16F, GL_RG32F, GL_RG16F, GL_R32F, GL_R16F, GL_RGBA8, GL_RGB10_A2 };
+	for (GLenum format : formats) {
+		if (qualifier == imageFormatQualifier(format)) {
+			return format;
+		}
+	}
+	return GL_NONE;
+}
+
+int bytesPerTexel(GLenum internal_format) {
+	switch (internal_format) {
+		case GL_RGBA32F: return 16;
+		case GL_RGBA16F: return 8;
+		case GL_RG32F: return 8;
+		case GL_RG16F: return 4;
+		case GL_R32F: return 4;
+		case GL_R16F: return 2;
+		case GL_RGBA8: return 4;
+		case GL_RGB10_A2: return 4;
+	}
+	return 16;
+}
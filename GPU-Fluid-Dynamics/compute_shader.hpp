@@ -0,0 +1,25 @@
+#ifndef _COMPUTE_SHADER_HPP_
+#define _COMPUTE_SHADER_HPP_
+
+#include <string>
+
+#include "Utility\gl.hpp"
+
+// Reads the shader at |path| with |defines| inserted after its #version
+// line, if any. Prints an error and returns false if it can't be opened.
+bool readShaderSource(const char *path, const std::string &defines, std::string *source);
+
+// Compiles and links the compute shader at |path|, with |defines| inserted
+// after its #version line. Returns 0 and prints the log on failure.
+GLuint loadComputeShader(const char *path, const std::string &defines);
+
+// The GLSL image format qualifier for a sized internal format.
+const char *imageFormatQualifier(GLenum internal_format);
+
+// The sized internal format named by a qualifier such as "rg16f", GL_NONE if
+// it isn't one of the formats the simulation textures support.
+GLenum internalFormatFromQualifier(const std::string &qualifier);
+
+int bytesPerTexel(GLenum internal_format);
+
+#endif
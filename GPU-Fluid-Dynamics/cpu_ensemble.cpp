@@ -0,0 +1,229 @@
+/*
+* Copyright (c) 2017 Owen Glofcheski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#include "cpu_ensemble.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#include "pressure_kernels.hpp"
+
+namespace {
+
+const float kTimestep = 1 / 60.0f;
+
+int wrap(int i, int n) {
+	i %= n;
+	return i < 0 ? i + n : i;
+}
+
+int threadCount(int threads) {
+	return threads > 0 ? threads : std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+// The ink pattern used by init() and advection.frag.
+float inkPattern(float value) {
+	return std::fmod(value, 100.0f) < 50 ? 1.0f : 0.0f;
+}
+
+} // namespace
+
+CpuEnsemble::CpuEnsemble(int size, const std::vector<EnsembleMember> &members, int threads)
+	: grid_size(size), members(members), thread_pool(threadCount(threads)) {
+	int height = size * (int)members.size();
+	velocity_x.resize(size, height);
+	velocity_y.resize(size, height);
+	for (int c = 0; c < 3; ++c) {
+		colours[c].resize(size, height);
+	}
+	divergence_plane.resize(size, height);
+	pressure_plane.resize(size, height);
+
+	// Same initial colour as init() in every member.
+	for (int y = 0; y < height; ++y) {
+		int member_y = y % size;
+		for (int x = 0; x < size; ++x) {
+			colours[0].front().at(x, y) = ((x + member_y) % 100) < 50;
+			colours[1].front().at(x, y) = (x % 100) < 50;
+			colours[2].front().at(x, y) = (member_y % 100) < 50;
+		}
+	}
+}
+
+int CpuEnsemble::atlasRow(int member, int y) const {
+	return member * grid_size + wrap(y, grid_size);
+}
+
+void CpuEnsemble::step() {
+	advect();
+	calculateDivergence();
+	calculatePressure();
+	normalizeVelocity();
+}
+
+// CpuSolver::advectRegion() with each member's impulse and timestep and the
+// bilinear lookups wrapped within the member.
+void CpuEnsemble::advect() {
+	const Plane &vx = velocity_x.front();
+	const Plane &vy = velocity_y.front();
+	int stride = vx.stride;
+
+	thread_pool.parallelFor(vx.height, [&](int begin, int end) {
+		for (int row = begin; row < end; ++row) {
+			int m = row / grid_size;
+			const EnsembleMember &member = members[m];
+			float frag_y = row % grid_size + 0.5f;
+
+			for (int x = 0; x < grid_size; ++x) {
+				float frag_x = x + 0.5f;
+				int i = x + row * stride;
+
+				// Texel centres sit on half pixels.
+				float prev_x = frag_x - vx.data[i] * member.advection_timestep - 0.5f;
+				float prev_y = frag_y - vy.data[i] * member.advection_timestep - 0.5f;
+				float floor_x = std::floor(prev_x);
+				float floor_y = std::floor(prev_y);
+				float tx = prev_x - floor_x;
+				float ty = prev_y - floor_y;
+				int x0 = wrap((int)floor_x, grid_size);
+				int x1 = x0 + 1 == grid_size ? 0 : x0 + 1;
+				int row0 = atlasRow(m, (int)floor_y) * stride;
+				int row1 = atlasRow(m, (int)floor_y + 1) * stride;
+				auto bilinear = [&](const Plane &plane) {
+					const float *d = &plane.data[0];
+					float bottom = d[row0 + x0] + (d[row0 + x1] - d[row0 + x0]) * tx;
+					float top = d[row1 + x0] + (d[row1 + x1] - d[row1 + x0]) * tx;
+					return bottom + (top - bottom) * ty;
+				};
+
+				// Apply the impulse.
+				float dx = frag_x - member.impulse_x;
+				float dy = frag_y - member.impulse_y;
+				float r = member.impulse_radius > 0
+					? std::min(std::sqrt(dx * dx + dy * dy) / member.impulse_radius, 1.0f) : 1.0f;
+				float mag = 1.0f - r;
+				velocity_x.back().data[i] = bilinear(vx) + member.impulse_dx * mag * mag;
+				velocity_y.back().data[i] = bilinear(vy) + member.impulse_dy * mag * mag;
+
+				// Add some additional ink within the impulse radius.
+				if (r < 1.0f) {
+					colours[0].back().data[i] = inkPattern(frag_x + frag_y);
+					colours[1].back().data[i] = inkPattern(frag_x);
+					colours[2].back().data[i] = inkPattern(frag_y);
+				} else {
+					for (int c = 0; c < 3; ++c) {
+						colours[c].back().data[i] = bilinear(colours[c].front());
+					}
+				}
+			}
+		}
+	});
+
+	velocity_x.flip();
+	velocity_y.flip();
+	for (int c = 0; c < 3; ++c) {
+		colours[c].flip();
+	}
+}
+
+void CpuEnsemble::calculateDivergence() {
+	const Plane &vx = velocity_x.front();
+	const Plane &vy = velocity_y.front();
+	float e = 1.0f / grid_size;
+
+	thread_pool.parallelFor(vx.height, [&](int begin, int end) {
+		for (int row = begin; row < end; ++row) {
+			int m = row / grid_size;
+			int y = row % grid_size;
+			const float *vx_row = vx.row(row);
+			const float *vy_bottom = vy.row(atlasRow(m, y - 1));
+			const float *vy_top = vy.row(atlasRow(m, y + 1));
+			float *out = divergence_plane.row(row);
+
+			for (int x = 0; x < grid_size; ++x) {
+				float uL = vx_row[x == 0 ? grid_size - 1 : x - 1];
+				float uR = vx_row[x + 1 == grid_size ? 0 : x + 1];
+				out[x] = -2 * (e * (uR - uL) + e * (vy_top[x] - vy_bottom[x])) / kTimestep;
+			}
+		}
+	});
+}
+
+// Each member runs all of its sweeps while its rows are in cache, members in
+// parallel. A member's result is in the front plane after an even number of
+// sweeps and in the back plane after an odd one, see normalizeVelocity().
+void CpuEnsemble::calculatePressure() {
+	thread_pool.parallelFor(memberCount(), [&](int begin, int end) {
+		for (int m = begin; m < end; ++m) {
+			Plane *planes[] = { &pressure_plane.front(), &pressure_plane.back() };
+			for (int y = 0; y < grid_size; ++y) {
+				float *row = planes[0]->row(m * grid_size + y);
+				std::fill(row, row + grid_size, 0.0f);
+			}
+
+			for (int i = 0; i < members[m].jacobi_iterations; ++i) {
+				const Plane &in = *planes[i & 1];
+				Plane &out = *planes[!(i & 1)];
+				for (int y = 0; y < grid_size; ++y) {
+					int row = m * grid_size + y;
+					jacobiRow(divergence_plane.row(row), in.row(atlasRow(m, y - 2)), in.row(row),
+						in.row(atlasRow(m, y + 2)), out.row(row), grid_size, 1);
+				}
+			}
+		}
+	});
+}
+
+void CpuEnsemble::normalizeVelocity() {
+	const Plane &vx = velocity_x.front();
+	const Plane &vy = velocity_y.front();
+	float scale = kTimestep * grid_size / 2;
+
+	thread_pool.parallelFor(vx.height, [&](int begin, int end) {
+		for (int row = begin; row < end; ++row) {
+			int m = row / grid_size;
+			int y = row % grid_size;
+
+			const Plane &pressure = members[m].jacobi_iterations % 2 == 0
+				? pressure_plane.front() : pressure_plane.back();
+			const float *p_row = pressure.row(row);
+			const float *p_bottom = pressure.row(atlasRow(m, y - 1));
+			const float *p_top = pressure.row(atlasRow(m, y + 1));
+			float *out_vx = velocity_x.back().row(row);
+			float *out_vy = velocity_y.back().row(row);
+
+			for (int x = 0; x < grid_size; ++x) {
+				float pL = p_row[x == 0 ? grid_size - 1 : x - 1];
+				float pR = p_row[x + 1 == grid_size ? 0 : x + 1];
+
+				// Subtract the gradient of the pressure.
+				out_vx[x] = vx.row(row)[x] - scale * (pR - pL);
+				out_vy[x] = vy.row(row)[x] - scale * (p_top[x] - p_bottom[x]);
+			}
+		}
+	});
+
+	velocity_x.flip();
+	velocity_y.flip();
+}
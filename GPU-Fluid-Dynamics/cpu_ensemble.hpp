@@ -0,0 +1,54 @@
+#ifndef _CPU_ENSEMBLE_HPP_
+#define _CPU_ENSEMBLE_HPP_
+
+#include <vector>
+
+#include "cpu_solver.hpp"
+#include "solver_settings.hpp"
+#include "thread_pool.hpp"
+
+// Independent simulations of the same size stepped together on the CPU, the
+// counterpart of GpuEnsemble. Each field is one atlas plane with the members
+// stacked as bands of rows, and every stage is a single parallel loop over
+// the atlas, so each thread keeps busy with small members rather than waiting
+// on per-member stages of a few rows. Pressure is Jacobi only and runs each
+// member's sweeps back to back while it is in cache. Rows wrap within their
+// member like GL_REPEAT.
+class CpuEnsemble
+{
+public:
+	// |threads| 0 uses every hardware thread.
+	CpuEnsemble(int size, const std::vector<EnsembleMember> &members, int threads = 0);
+
+	int size() const { return grid_size; }
+	int memberCount() const { return (int)members.size(); }
+
+	// Advances every member by one step, equivalent to CpuSolver::step().
+	void step();
+
+	// The atlas, member m's row y is row m * size() + y.
+	FlipPlane &velocityX() { return velocity_x; }
+	FlipPlane &velocityY() { return velocity_y; }
+	FlipPlane &colour(int channel) { return colours[channel]; }
+
+private:
+	// Row |y| of |member|, wrapped within the member.
+	int atlasRow(int member, int y) const;
+
+	void advect();
+	void calculateDivergence();
+	void calculatePressure();
+	void normalizeVelocity();
+
+	int grid_size;
+	std::vector<EnsembleMember> members;
+	ThreadPool thread_pool;
+
+	FlipPlane velocity_x;
+	FlipPlane velocity_y;
+	FlipPlane colours[3];
+	Plane divergence_plane;
+	FlipPlane pressure_plane;
+};
+
+#endif
\ No newline at end of file
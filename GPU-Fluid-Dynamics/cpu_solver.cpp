@@ -0,0 +1,884 @@
+/*
+* Copyright (c) 2017 Owen Glofcheski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#include "cpu_solver.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "domain_solver.hpp"
+#include "pressure_kernels.hpp"
+
+namespace {
+
+int wrap(int i, int n) {
+	i %= n;
+	return i < 0 ? i + n : i;
+}
+
+// Bilinear lookup matching GL_LINEAR with GL_REPEAT, where |x|, |y| are in
+// the same pixel units as gl_FragCoord.
+struct Bilinear
+{
+	Bilinear(const Plane &plane, float x, float y) {
+		// Texel centres sit on half pixels.
+		x -= 0.5f;
+		y -= 0.5f;
+
+		float floor_x = std::floor(x);
+		float floor_y = std::floor(y);
+		tx = x - floor_x;
+		ty = y - floor_y;
+
+		int x0 = wrap((int)floor_x, plane.width);
+		int y0 = wrap((int)floor_y, plane.height);
+		int x1 = x0 + 1 == plane.width ? 0 : x0 + 1;
+		int y1 = y0 + 1 == plane.height ? 0 : y0 + 1;
+
+		i00 = x0 + y0 * plane.stride;
+		i10 = x1 + y0 * plane.stride;
+		i01 = x0 + y1 * plane.stride;
+		i11 = x1 + y1 * plane.stride;
+	}
+
+	float operator()(const Plane &plane) const {
+		const float *d = &plane.data[0];
+		float bottom = d[i00] + (d[i10] - d[i00]) * tx;
+		float top = d[i01] + (d[i11] - d[i01]) * tx;
+		return bottom + (top - bottom) * ty;
+	}
+
+	int i00, i10, i01, i11;
+	float tx, ty;
+};
+
+// The ink pattern used by init() and advection.frag.
+float inkPattern(float value) {
+	return std::fmod(value, 100.0f) < 50 ? 1.0f : 0.0f;
+}
+
+} // namespace
+
+void Plane::resize(int width, int height) {
+	const int line_floats = kCacheLineSize / sizeof(float);
+
+	this->width = width;
+	this->height = height;
+	this->stride = (width + line_floats - 1) / line_floats * line_floats;
+	data.assign(stride * height, 0.0f);
+}
+
+void Plane::fill(float value) {
+	std::fill(data.begin(), data.end(), value);
+}
+
+CpuSolver::CpuSolver(int width, int height)
+	: grid_width(width), grid_height(height) {
+	velocity_x.resize(width, height);
+	velocity_y.resize(width, height);
+	for (int c = 0; c < 3; ++c) {
+		colours[c].resize(width, height);
+	}
+	divergence_plane.resize(width, height);
+	pressure_plane.resize(width, height);
+
+	tile_columns = (width + kSparseTileSize - 1) / kSparseTileSize;
+	tile_rows = (height + kSparseTileSize - 1) / kSparseTileSize;
+	tile_moving.assign(tile_columns * tile_rows, 0);
+	tile_active.assign(tile_columns * tile_rows, 0);
+
+	// Coarsen while the grid splits into interleaved lattices, a lattice of odd
+	// size folds its last texel into the last coarse one.
+	int level_width = width;
+	int level_height = height;
+	while (level_width % 2 == 0 && level_height % 2 == 0
+		&& level_width >= 16 && level_height >= 16) {
+		level_width = level_width / 4 * 2;
+		level_height = level_height / 4 * 2;
+
+		multigrid_levels.emplace_back();
+		multigrid_levels.back().rhs.resize(level_width, level_height);
+		multigrid_levels.back().pressure.resize(level_width, level_height);
+	}
+
+	// In Stage order.
+	stage_profiler.addStage("advect");
+	stage_profiler.addStage("divergence");
+	stage_profiler.addStage("pressure");
+	stage_profiler.addStage("normalize");
+
+	// Same initial colour as init().
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			colours[0].front().at(x, y) = ((x + y) % 100) < 50;
+			colours[1].front().at(x, y) = (x % 100) < 50;
+			colours[2].front().at(x, y) = (y % 100) < 50;
+		}
+	}
+}
+
+// Out of line for the DomainSolver forward declaration.
+CpuSolver::~CpuSolver() {
+}
+
+void CpuSolver::setImpulse(float x, float y, float impulse_x, float impulse_y) {
+	impulse_position_x = x;
+	impulse_position_y = y;
+	frame_impulse_x = impulse_x;
+	frame_impulse_y = impulse_y;
+}
+
+void CpuSolver::step(float timestep) {
+	if (settings.sparse.enabled) {
+		updateActiveTiles();
+	}
+	sparse_last_step = settings.sparse.enabled;
+
+	{
+		StageProfiler::Scope scope(stage_profiler, kAdvectStage);
+		splatEmitters();
+		advect(timestep * settings.advection_scale);
+	}
+	{
+		StageProfiler::Scope scope(stage_profiler, kDivergenceStage);
+		calculateDivergence(timestep);
+	}
+	{
+		StageProfiler::Scope scope(stage_profiler, kPressureStage);
+		calculatePressure();
+	}
+	{
+		StageProfiler::Scope scope(stage_profiler, kNormalizeStage);
+		normalizeVelocity(timestep);
+	}
+
+	// Reset the frame impulse and emitters.
+	frame_impulse_x = 0;
+	frame_impulse_y = 0;
+	frame_emitters.clear();
+}
+
+// Matches splat.vert and splat.frag, each emitter's force is added to the
+// velocity and the colour is mixed towards its dye.
+void CpuSolver::splatEmitters() {
+	for (const Emitter &emitter : frame_emitters) {
+		float radius = std::max(emitter.radius, 0.5f);
+		int x0 = (int)std::floor(emitter.x - radius);
+		int y0 = (int)std::floor(emitter.y - radius);
+		int x1 = (int)std::ceil(emitter.x + radius);
+		int y1 = (int)std::ceil(emitter.y + radius);
+
+		for (int y = y0; y <= y1; ++y) {
+			float dy = y + 0.5f - emitter.y;
+			for (int x = x0; x <= x1; ++x) {
+				float dx = x + 0.5f - emitter.x;
+				float r = std::sqrt(dx * dx + dy * dy) / radius;
+				if (r >= 1.0f) {
+					continue;
+				}
+				float mag = 1.0f - r;
+				int i = wrap(x, grid_width) + wrap(y, grid_height) * velocity_x.front().stride;
+
+				velocity_x.front().data[i] += emitter.force_x * mag * mag;
+				velocity_y.front().data[i] += emitter.force_y * mag * mag;
+
+				float dye = emitter.dye * mag;
+				float colour[] = { emitter.red, emitter.green, emitter.blue };
+				for (int c = 0; c < 3; ++c) {
+					float &value = colours[c].front().data[i];
+					value += (colour[c] - value) * dye;
+				}
+			}
+		}
+	}
+}
+
+void CpuSolver::advect(float timestep) {
+	forEachRegion([&](const Region &region, int) {
+		advectRegion(region, timestep);
+	});
+
+	if (settings.advection == AdvectionScheme::MacCormack) {
+		if (corrected_velocity_x.width != grid_width || corrected_velocity_x.height != grid_height) {
+			corrected_velocity_x.resize(grid_width, grid_height);
+			corrected_velocity_y.resize(grid_width, grid_height);
+			for (int c = 0; c < 3; ++c) {
+				corrected_colours[c].resize(grid_width, grid_height);
+			}
+		}
+
+		forEachRegion([&](const Region &region, int) {
+			correctRegion(region, timestep);
+		});
+
+		// Inactive tiles hold the unadvected fields in the back planes,
+		// which is also their advected value, so only active rows are copied.
+		Plane *corrected[] = {
+			&corrected_velocity_x, &corrected_velocity_y,
+			&corrected_colours[0], &corrected_colours[1], &corrected_colours[2] };
+		Plane *targets[] = {
+			&velocity_x.back(), &velocity_y.back(),
+			&colours[0].back(), &colours[1].back(), &colours[2].back() };
+		forEachRegion([&](const Region &region, int) {
+			for (int f = 0; f < 5; ++f) {
+				for (int y = region.y0; y < region.y1; ++y) {
+					std::copy(corrected[f]->row(y) + region.x0, corrected[f]->row(y) + region.x1,
+						targets[f]->row(y) + region.x0);
+				}
+			}
+		});
+	}
+
+	velocity_x.flip();
+	velocity_y.flip();
+	for (int c = 0; c < 3; ++c) {
+		colours[c].flip();
+	}
+}
+
+void CpuSolver::advectRegion(const Region &region, float timestep) {
+	const Plane &vx = velocity_x.front();
+	const Plane &vy = velocity_y.front();
+	Plane &out_vx = velocity_x.back();
+	Plane &out_vy = velocity_y.back();
+
+	float radius = settings.impulse_radius;
+
+	for (int y = region.y0; y < region.y1; ++y) {
+		float frag_y = y + 0.5f;
+		for (int x = region.x0; x < region.x1; ++x) {
+			float frag_x = x + 0.5f;
+			int i = x + y * vx.stride;
+
+			Bilinear prev(vx,
+				frag_x - vx.data[i] * timestep,
+				frag_y - vy.data[i] * timestep);
+
+			float prev_vx = prev(vx);
+			float prev_vy = prev(vy);
+
+			// Apply mouse force.
+			float dx = frag_x - impulse_position_x;
+			float dy = frag_y - impulse_position_y;
+			float r = radius > 0 ? std::min(std::sqrt(dx * dx + dy * dy) / radius, 1.0f) : 1.0f;
+			float mag = 1.0f - r;
+			out_vx.data[i] = prev_vx + frame_impulse_x * mag * mag;
+			out_vy.data[i] = prev_vy + frame_impulse_y * mag * mag;
+
+			// Add some additional ink within the mouse radius.
+			if (r < 1.0f) {
+				colours[0].back().data[i] = inkPattern(frag_x + frag_y);
+				colours[1].back().data[i] = inkPattern(frag_x);
+				colours[2].back().data[i] = inkPattern(frag_y);
+			} else {
+				for (int c = 0; c < 3; ++c) {
+					colours[c].back().data[i] = prev(colours[c].front());
+				}
+			}
+		}
+	}
+}
+
+// Matches maccormack.frag, corrects the result of advectRegion() in the back
+// planes by half the error of advecting it back again, clamped to the texels
+// the backward lookup interpolated.
+void CpuSolver::correctRegion(const Region &region, float timestep) {
+	const Plane &vx = velocity_x.front();
+	const Plane &vy = velocity_y.front();
+
+	const FlipPlane *fields[] = { &velocity_x, &velocity_y, &colours[0], &colours[1], &colours[2] };
+	Plane *corrected[] = {
+		&corrected_velocity_x, &corrected_velocity_y,
+		&corrected_colours[0], &corrected_colours[1], &corrected_colours[2] };
+
+	float radius = settings.impulse_radius;
+
+	for (int y = region.y0; y < region.y1; ++y) {
+		float frag_y = y + 0.5f;
+		for (int x = region.x0; x < region.x1; ++x) {
+			float frag_x = x + 0.5f;
+			int i = x + y * vx.stride;
+
+			// The forward pass added the mouse force and ink here.
+			float dx = frag_x - impulse_position_x;
+			float dy = frag_y - impulse_position_y;
+			if (radius > 0 && std::sqrt(dx * dx + dy * dy) < radius) {
+				for (int f = 0; f < 5; ++f) {
+					corrected[f]->data[i] = fields[f]->back().data[i];
+				}
+				continue;
+			}
+
+			float offset_x = vx.data[i] * timestep;
+			float offset_y = vy.data[i] * timestep;
+			Bilinear prev(vx, frag_x - offset_x, frag_y - offset_y);
+			Bilinear next(vx, frag_x + offset_x, frag_y + offset_y);
+
+			for (int f = 0; f < 5; ++f) {
+				const float *source = &fields[f]->front().data[0];
+				const Plane &advected = fields[f]->back();
+
+				float value = advected.data[i] + 0.5f * (source[i] - next(advected));
+				float low = std::min(std::min(source[prev.i00], source[prev.i10]),
+					std::min(source[prev.i01], source[prev.i11]));
+				float high = std::max(std::max(source[prev.i00], source[prev.i10]),
+					std::max(source[prev.i01], source[prev.i11]));
+				corrected[f]->data[i] = std::min(std::max(value, low), high);
+			}
+		}
+	}
+}
+
+void CpuSolver::calculateDivergence(float timestep) {
+	forEachRegion([&](const Region &region, int tile) {
+		markMoving(tile, divergenceRegion(region, timestep), settings.sparse.divergence_threshold);
+	});
+}
+
+// Returns the largest divergence magnitude in |region|.
+float CpuSolver::divergenceRegion(const Region &region, float timestep) {
+	const Plane &vx = velocity_x.front();
+	const Plane &vy = velocity_y.front();
+
+	float e_x = 1.0f / grid_width;
+	float e_y = 1.0f / grid_height;
+
+	float largest = 0;
+	for (int y = region.y0; y < region.y1; ++y) {
+		const float *vx_row = vx.row(y);
+		const float *vy_bottom = vy.row(y == 0 ? grid_height - 1 : y - 1);
+		const float *vy_top = vy.row(y + 1 == grid_height ? 0 : y + 1);
+		float *out = divergence_plane.row(y);
+
+		for (int x = region.x0; x < region.x1; ++x) {
+			float uL = vx_row[x == 0 ? grid_width - 1 : x - 1];
+			float uR = vx_row[x + 1 == grid_width ? 0 : x + 1];
+			float uB = vy_bottom[x];
+			float uT = vy_top[x];
+
+			out[x] = -2 * (e_x * (uR - uL) + e_y * (uT - uB)) / timestep;
+			largest = std::max(largest, std::abs(out[x]));
+		}
+	}
+	return largest;
+}
+
+void CpuSolver::calculatePressure() {
+	const PressureSettings &pressure = settings.pressure;
+
+	// Inactive tiles already have zero pressure.
+	bool sparse = settings.sparse.enabled && pressure.solver == PressureSolver::Jacobi;
+
+	if (!pressure.warm_start) {
+		// Re-zero the pressure.
+		if (sparse) {
+			forEachRegion([&](const Region &region, int) {
+				for (int y = region.y0; y < region.y1; ++y) {
+					std::fill(pressure_plane.front().row(y) + region.x0,
+						pressure_plane.front().row(y) + region.x1, 0.0f);
+				}
+			});
+		} else {
+			pressure_plane.front().fill(0);
+		}
+	} else if (pressure.warm_start_scale != 1) {
+		if (sparse) {
+			forEachRegion([&](const Region &region, int) {
+				for (int y = region.y0; y < region.y1; ++y) {
+					float *row = pressure_plane.front().row(y);
+					for (int x = region.x0; x < region.x1; ++x) {
+						row[x] *= pressure.warm_start_scale;
+					}
+				}
+			});
+		} else {
+			for (float &p : pressure_plane.front().data) {
+				p *= pressure.warm_start_scale;
+			}
+		}
+	}
+
+	pressure_stats = PressureSolveStats();
+	auto start_time = std::chrono::steady_clock::now();
+
+	bool converged = false;
+	if (pressure.solver == PressureSolver::Multigrid) {
+		while (!converged && pressure_stats.iterations < pressure.multigrid_cycles) {
+			vCycle(0);
+			++pressure_stats.iterations;
+
+			if (pressure.residual_tolerance > 0) {
+				pressure_stats.residual = residual(divergence_plane, pressure_plane.front());
+				converged = pressure_stats.residual <= pressure.residual_tolerance;
+			}
+		}
+	} else {
+		int interval = pressure.residual_tolerance > 0
+			? std::max(1, pressure.residual_check_interval) : pressure.jacobi_iterations;
+		while (!converged && pressure_stats.iterations < pressure.jacobi_iterations) {
+			int iterations = std::min(interval, pressure.jacobi_iterations - pressure_stats.iterations);
+			if (sparse) {
+				relaxTiles(iterations);
+			} else {
+				relax(divergence_plane, pressure_plane, iterations, 1);
+			}
+			pressure_stats.iterations += iterations;
+
+			if (pressure.residual_tolerance > 0) {
+				pressure_stats.residual = sparse
+					? residualTiles() : residual(divergence_plane, pressure_plane.front());
+				converged = pressure_stats.residual <= pressure.residual_tolerance;
+			}
+		}
+	}
+
+	pressure_stats.seconds = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start_time).count();
+
+	if (pressure.residual_tolerance <= 0 && settings.report_residual) {
+		pressure_stats.residual = sparse
+			? residualTiles() : residual(divergence_plane, pressure_plane.front());
+	}
+}
+
+float CpuSolver::residual(const Plane &rhs, const Plane &pressure) {
+	int width = rhs.width;
+	int height = rhs.height;
+
+	// Per row sums keep the total independent of the thread count.
+	std::vector<double> row_sums(height);
+	threadPool().parallelFor(height, [&](int begin, int end) {
+		for (int y = begin; y < end; ++y) {
+			row_sums[y] = residualRow(rhs.row(y), pressure.row(wrap(y - 2, height)), pressure.row(y),
+				pressure.row(wrap(y + 2, height)), width);
+		}
+	});
+
+	double sum = 0;
+	for (double row_sum : row_sums) {
+		sum += row_sum;
+	}
+
+	return (float)std::sqrt(sum / (width * height));
+}
+
+// residual() of the level 0 pressure summed over the active tiles only, the
+// inactive ones have zero pressure and divergence.
+float CpuSolver::residualTiles() {
+	const Plane &pressure = pressure_plane.front();
+	int count = (int)active_tiles.size();
+
+	std::vector<double> tile_sums(count);
+	threadPool().parallelFor(count, [&](int begin, int end) {
+		for (int t = begin; t < end; ++t) {
+			Region region = tileRegion(active_tiles[t]);
+			double sum = 0;
+			for (int y = region.y0; y < region.y1; ++y) {
+				sum += residualSpan(divergence_plane.row(y), pressure.row(wrap(y - 2, grid_height)),
+					pressure.row(y), pressure.row(wrap(y + 2, grid_height)), grid_width, region.x0, region.x1);
+			}
+			tile_sums[t] = sum;
+		}
+	});
+
+	double sum = 0;
+	for (double tile_sum : tile_sums) {
+		sum += tile_sum;
+	}
+
+	return (float)std::sqrt(sum / (grid_width * grid_height));
+}
+
+ThreadPool &CpuSolver::threadPool() {
+	int threads = settings.threads > 0
+		? settings.threads : std::max(1, (int)std::thread::hardware_concurrency());
+	if (!thread_pool || thread_pool->threadCount() != threads) {
+		thread_pool.reset(new ThreadPool(threads));
+	}
+	return *thread_pool;
+}
+
+const DomainSolveStats &CpuSolver::domainStats() const {
+	static const DomainSolveStats kNoStats;
+	return domain_solver ? domain_solver->stats() : kNoStats;
+}
+
+DomainSolver &CpuSolver::domainSolver() {
+	const DomainSettings &domains = settings.domains;
+	const DomainSettings *current = domain_solver ? &domain_solver->settings() : nullptr;
+	if (!current || current->columns != domains.columns || current->rows != domains.rows
+		|| current->overlap != domains.overlap || current->pin_threads != domains.pin_threads) {
+		domain_solver.reset(new DomainSolver(grid_width, grid_height, domains));
+	}
+	return *domain_solver;
+}
+
+void CpuSolver::relax(const Plane &rhs, FlipPlane &pressure, int iterations, float relaxation) {
+	int width = rhs.width;
+	int height = rhs.height;
+
+	ThreadPool &pool = threadPool();
+
+	if (settings.pressure_kernel == PressureKernel::RedBlackGaussSeidel
+		&& width % 4 == 0 && height % 4 == 0) {
+		Plane &p = pressure.front();
+		for (int i = 0; i < iterations; ++i) {
+			for (int colour = 0; colour < 2; ++colour) {
+				pool.parallelFor(height, [&](int begin, int end) {
+					for (int y = begin; y < end; ++y) {
+						redBlackRow(rhs.row(y), p.row(wrap(y - 2, height)), p.row(y),
+							p.row(wrap(y + 2, height)), width, y, colour, relaxation);
+					}
+				});
+			}
+		}
+	} else if (settings.domains.rankCount() > 1 && width == grid_width && height == grid_height) {
+		domainSolver().relax(rhs, pressure, iterations, relaxation);
+	} else {
+		int sweeps = std::max(1, settings.temporal_block_sweeps);
+		int i = 0;
+		for (; sweeps > 1 && i + sweeps <= iterations; i += sweeps) {
+			relaxBlocked(rhs, pressure, sweeps, relaxation);
+		}
+
+		for (; i < iterations; ++i) {
+			const Plane &in = pressure.front();
+			Plane &out = pressure.back();
+
+			pool.parallelFor(height, [&](int begin, int end) {
+				for (int y = begin; y < end; ++y) {
+					jacobiRow(rhs.row(y), in.row(wrap(y - 2, height)), in.row(y),
+						in.row(wrap(y + 2, height)), out.row(y), width, relaxation);
+				}
+			});
+
+			// Flip the input and output planes.
+			pressure.flip();
+		}
+	}
+
+	pressure_stats.cell_updates += (double)iterations * width * height;
+}
+
+// Jacobi iterations of the level 0 pressure over the active tiles. Inactive
+// tiles hold zero in both planes, which acts as the boundary condition.
+void CpuSolver::relaxTiles(int iterations) {
+	ThreadPool &pool = threadPool();
+	int count = (int)active_tiles.size();
+
+	for (int i = 0; i < iterations; ++i) {
+		const Plane &in = pressure_plane.front();
+		Plane &out = pressure_plane.back();
+
+		pool.parallelFor(count, [&](int begin, int end) {
+			for (int t = begin; t < end; ++t) {
+				Region region = tileRegion(active_tiles[t]);
+				for (int y = region.y0; y < region.y1; ++y) {
+					jacobiSpan(divergence_plane.row(y), in.row(wrap(y - 2, grid_height)), in.row(y),
+						in.row(wrap(y + 2, grid_height)), out.row(y), grid_width, region.x0, region.x1, 1);
+				}
+			}
+		});
+
+		// Flip the input and output planes.
+		pressure_plane.flip();
+	}
+
+	double cells = 0;
+	for (int tile : active_tiles) {
+		Region region = tileRegion(tile);
+		cells += (double)(region.x1 - region.x0) * (region.y1 - region.y0);
+	}
+	pressure_stats.cell_updates += iterations * cells;
+}
+
+void CpuSolver::relaxBlocked(const Plane &rhs, FlipPlane &pressure, int sweeps, float relaxation) {
+	int width = rhs.width;
+	int height = rhs.height;
+	int stride = rhs.stride;
+
+	int band_rows = std::max(1, settings.temporal_block_rows);
+	int bands = (height + band_rows - 1) / band_rows;
+	int halo = 2 * sweeps;
+
+	const Plane &in = pressure.front();
+	Plane &out = pressure.back();
+
+	threadPool().parallelFor(bands, [&](int begin, int end) {
+		// Two buffers holding a band and its halo, alternating between sweeps.
+		thread_local std::vector<float, CacheAlignedAllocator<float>> scratch;
+		int max_rows = band_rows + 2 * halo;
+		if ((int)scratch.size() < 2 * max_rows * stride) {
+			scratch.resize(2 * max_rows * stride);
+		}
+		float *buffers[] = { &scratch[0], &scratch[max_rows * stride] };
+
+		for (int band = begin; band < end; ++band) {
+			int band_begin = band * band_rows;
+			int band_end = std::min(band_begin + band_rows, height);
+			int rows = band_end - band_begin + 2 * halo;
+
+			// Local row r is the global row band_begin - halo + r.
+			for (int r = 0; r < rows; ++r) {
+				const float *source = in.row(wrap(band_begin - halo + r, height));
+				std::copy(source, source + width, buffers[0] + r * stride);
+			}
+
+			// Each sweep is valid on two fewer rows at either end than the
+			// last, the final sweep covers just the band and goes straight
+			// to the output.
+			for (int s = 1; s <= sweeps; ++s) {
+				const float *src = buffers[(s - 1) & 1];
+				float *dst = buffers[s & 1];
+
+				for (int r = 2 * s; r < rows - 2 * s; ++r) {
+					int y = wrap(band_begin - halo + r, height);
+					float *target = s == sweeps ? out.row(y) : dst + r * stride;
+					jacobiRow(rhs.row(y), src + (r - 2) * stride, src + r * stride,
+						src + (r + 2) * stride, target, width, relaxation);
+				}
+			}
+		}
+	});
+
+	pressure.flip();
+}
+
+// The pressure stencil samples neighbours two texels away, which splits the
+// grid into four interleaved lattices that never interact. Coarse levels keep
+// that interleaving so every level can be relaxed with the same stencil: the
+// coarse texel |c| with parity |p| covers the fine texels 2c - p and 2c - p + 2
+// along each axis, and also 2c - p + 4 for the last texel of an odd lattice.
+void CpuSolver::restrictResidual(const Plane &rhs, const Plane &pressure, Plane &coarse_rhs) {
+	int width = rhs.width;
+	int height = rhs.height;
+
+	for (int cy = 0; cy < coarse_rhs.height; ++cy) {
+		int fine_y = 2 * cy - (cy & 1);
+		int extent_y = cy >= coarse_rhs.height - 2 && height % 4 != 0 ? 4 : 2;
+
+		for (int cx = 0; cx < coarse_rhs.width; ++cx) {
+			int fine_x = 2 * cx - (cx & 1);
+			int extent_x = cx >= coarse_rhs.width - 2 && width % 4 != 0 ? 4 : 2;
+
+			float sum = 0;
+			for (int j = 0; j <= extent_y; j += 2) {
+				int y = fine_y + j;
+				const float *row = pressure.row(y);
+				const float *bottom = pressure.row(wrap(y - 2, height));
+				const float *top = pressure.row(wrap(y + 2, height));
+
+				for (int i = 0; i <= extent_x; i += 2) {
+					int x = fine_x + i;
+					float pL = row[wrap(x - 2, width)];
+					float pR = row[wrap(x + 2, width)];
+
+					sum += rhs.at(x, y) - (4 * row[x] - pL - pR - bottom[x] - top[x]);
+				}
+			}
+
+			// Averaging the residuals and scaling by the squared ratio of grid
+			// spacings leaves just the sum, the transpose of the prolongation.
+			coarse_rhs.at(cx, cy) = sum;
+		}
+	}
+}
+
+void CpuSolver::prolongCorrection(const Plane &coarse_pressure, FlipPlane &pressure) {
+	Plane &fine = pressure.front();
+	int last_x = coarse_pressure.width - 2;
+	int last_y = coarse_pressure.height - 2;
+
+	for (int y = 0; y < fine.height; ++y) {
+		int cy = std::min((y >> 2) << 1, last_y) + (y & 1);
+		const float *coarse_row = coarse_pressure.row(cy);
+		float *row = fine.row(y);
+
+		for (int x = 0; x < fine.width; ++x) {
+			int cx = std::min((x >> 2) << 1, last_x) + (x & 1);
+			row[x] += coarse_row[cx];
+		}
+	}
+}
+
+void CpuSolver::vCycle(int level) {
+	const Plane &rhs = level == 0 ? divergence_plane : multigrid_levels[level - 1].rhs;
+	FlipPlane &pressure = level == 0 ? pressure_plane : multigrid_levels[level - 1].pressure;
+
+	float relaxation = settings.pressure.multigrid_relaxation;
+
+	if (level == (int)multigrid_levels.size()) {
+		relax(rhs, pressure, settings.pressure.multigrid_coarse_iterations, relaxation);
+		return;
+	}
+
+	MultigridLevel &coarse = multigrid_levels[level];
+
+	relax(rhs, pressure, settings.pressure.multigrid_smoothing_iterations, relaxation);
+
+	restrictResidual(rhs, pressure.front(), coarse.rhs);
+	coarse.pressure.front().fill(0);
+	vCycle(level + 1);
+	prolongCorrection(coarse.pressure.front(), pressure);
+
+	relax(rhs, pressure, settings.pressure.multigrid_smoothing_iterations, relaxation);
+}
+
+void CpuSolver::normalizeVelocity(float timestep) {
+	forEachRegion([&](const Region &region, int tile) {
+		markMoving(tile, normalizeRegion(region, timestep), settings.sparse.velocity_threshold);
+	});
+
+	velocity_x.flip();
+	velocity_y.flip();
+}
+
+// Returns the largest velocity component in |region| after the projection.
+float CpuSolver::normalizeRegion(const Region &region, float timestep) {
+	const Plane &vx = velocity_x.front();
+	const Plane &vy = velocity_y.front();
+	const Plane &pressure = pressure_plane.front();
+	Plane &out_vx = velocity_x.back();
+	Plane &out_vy = velocity_y.back();
+
+	float scale_x = timestep * grid_width / 2;
+	float scale_y = timestep * grid_height / 2;
+
+	float largest = 0;
+	for (int y = region.y0; y < region.y1; ++y) {
+		const float *p_row = pressure.row(y);
+		const float *p_bottom = pressure.row(y == 0 ? grid_height - 1 : y - 1);
+		const float *p_top = pressure.row(y + 1 == grid_height ? 0 : y + 1);
+
+		for (int x = region.x0; x < region.x1; ++x) {
+			int i = x + y * vx.stride;
+
+			float pL = p_row[x == 0 ? grid_width - 1 : x - 1];
+			float pR = p_row[x + 1 == grid_width ? 0 : x + 1];
+			float pB = p_bottom[x];
+			float pT = p_top[x];
+
+			// Subtract the gradient of the pressure.
+			out_vx.data[i] = vx.data[i] - scale_x * (pR - pL);
+			out_vy.data[i] = vy.data[i] - scale_y * (pT - pB);
+			largest = std::max(largest, std::max(std::abs(out_vx.data[i]), std::abs(out_vy.data[i])));
+		}
+	}
+	return largest;
+}
+
+void CpuSolver::forEachRegion(const std::function<void(const Region &region, int tile)> &task) {
+	if (!settings.sparse.enabled) {
+		task(Region{ 0, 0, grid_width, grid_height }, -1);
+		return;
+	}
+	for (int tile : active_tiles) {
+		task(tileRegion(tile), tile);
+	}
+}
+
+CpuSolver::Region CpuSolver::tileRegion(int tile) const {
+	int x0 = tile % tile_columns * kSparseTileSize;
+	int y0 = tile / tile_columns * kSparseTileSize;
+	return Region{ x0, y0,
+		std::min(x0 + kSparseTileSize, grid_width), std::min(y0 + kSparseTileSize, grid_height) };
+}
+
+void CpuSolver::markMoving(int tile, float value, float threshold) {
+	if (tile >= 0 && value > threshold) {
+		tile_moving[tile] = 1;
+	}
+}
+
+bool CpuSolver::underEmitter(int tile_x, int tile_y) const {
+	for (const Emitter &emitter : frame_emitters) {
+		int x0 = (int)std::floor((emitter.x - emitter.radius) / kSparseTileSize);
+		int y0 = (int)std::floor((emitter.y - emitter.radius) / kSparseTileSize);
+		int columns = (int)std::floor((emitter.x + emitter.radius) / kSparseTileSize) - x0;
+		int rows = (int)std::floor((emitter.y + emitter.radius) / kSparseTileSize) - y0;
+		if (wrap(tile_x - x0, tile_columns) <= columns && wrap(tile_y - y0, tile_rows) <= rows) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Rebuilds the active tile list from the tiles that moved during the last
+// step, dilated by the margin, and the tiles under the impulse or an
+// emitter.
+void CpuSolver::updateActiveTiles() {
+	// After dense steps any tile may be moving.
+	if (!sparse_last_step) {
+		std::fill(tile_moving.begin(), tile_moving.end(), 1);
+		std::fill(tile_active.begin(), tile_active.end(), 1);
+	}
+
+	int margin = std::max(0, settings.sparse.margin);
+
+	float radius = settings.impulse_radius;
+	int impulse_x0 = (int)std::floor((impulse_position_x - radius) / kSparseTileSize);
+	int impulse_y0 = (int)std::floor((impulse_position_y - radius) / kSparseTileSize);
+	int impulse_columns = (int)std::floor((impulse_position_x + radius) / kSparseTileSize) - impulse_x0;
+	int impulse_rows = (int)std::floor((impulse_position_y + radius) / kSparseTileSize) - impulse_y0;
+
+	active_tiles.clear();
+	for (int ty = 0; ty < tile_rows; ++ty) {
+		for (int tx = 0; tx < tile_columns; ++tx) {
+			bool active = (wrap(tx - impulse_x0, tile_columns) <= impulse_columns
+				&& wrap(ty - impulse_y0, tile_rows) <= impulse_rows) || underEmitter(tx, ty);
+			for (int dy = -margin; dy <= margin && !active; ++dy) {
+				for (int dx = -margin; dx <= margin && !active; ++dx) {
+					active = tile_moving[wrap(tx + dx, tile_columns) + wrap(ty + dy, tile_rows) * tile_columns] != 0;
+				}
+			}
+
+			int tile = tx + ty * tile_columns;
+			if (active) {
+				active_tiles.push_back(tile);
+			} else if (tile_active[tile]) {
+				settleTile(tile);
+			}
+			tile_active[tile] = active;
+		}
+	}
+
+	std::fill(tile_moving.begin(), tile_moving.end(), 0);
+}
+
+// Makes both planes of every field agree on a tile leaving the active set, so
+// later flips leave it unchanged, and zeroes its pressure and divergence.
+void CpuSolver::settleTile(int tile) {
+	Region region = tileRegion(tile);
+
+	FlipPlane *fields[] = { &velocity_x, &velocity_y, &colours[0], &colours[1], &colours[2] };
+	for (int y = region.y0; y < region.y1; ++y) {
+		for (FlipPlane *field : fields) {
+			const float *row = field->front().row(y);
+			std::copy(row + region.x0, row + region.x1, field->back().row(y) + region.x0);
+		}
+		std::fill(pressure_plane.front().row(y) + region.x0, pressure_plane.front().row(y) + region.x1, 0.0f);
+		std::fill(pressure_plane.back().row(y) + region.x0, pressure_plane.back().row(y) + region.x1, 0.0f);
+		std::fill(divergence_plane.row(y) + region.x0, divergence_plane.row(y) + region.x1, 0.0f);
+	}
+}
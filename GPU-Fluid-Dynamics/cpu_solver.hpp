@@ -0,0 +1,298 @@
+#ifndef _CPU_SOLVER_HPP_
+#define _CPU_SOLVER_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "emitters.hpp"
+#include "solver_settings.hpp"
+#include "stage_profiler.hpp"
+#include "thread_pool.hpp"
+
+class DomainSolver;
+struct DomainSolveStats;
+
+const int kCacheLineSize = 64; // bytes.
+
+// Allocates on cache line boundaries.
+template <typename T>
+struct CacheAlignedAllocator
+{
+	typedef T value_type;
+
+	CacheAlignedAllocator() {}
+	template <typename U>
+	CacheAlignedAllocator(const CacheAlignedAllocator<U> &) {}
+
+	T *allocate(std::size_t n) {
+		char *raw = (char*)::operator new(n * sizeof(T) + kCacheLineSize + sizeof(void*));
+		std::uintptr_t aligned = ((std::uintptr_t)(raw + sizeof(void*)) + kCacheLineSize - 1)
+			& ~(std::uintptr_t)(kCacheLineSize - 1);
+		((void**)aligned)[-1] = raw;
+		return (T*)aligned;
+	}
+
+	void deallocate(T *p, std::size_t) {
+		::operator delete(((void**)p)[-1]);
+	}
+};
+
+template <typename T, typename U>
+bool operator==(const CacheAlignedAllocator<T> &, const CacheAlignedAllocator<U> &) { return true; }
+template <typename T, typename U>
+bool operator!=(const CacheAlignedAllocator<T> &, const CacheAlignedAllocator<U> &) { return false; }
+
+// A single channel of a simulation field. Every channel is stored in its own
+// contiguous row-major plane so each stage only streams the channels it uses.
+// Rows are padded to whole cache lines so threads working on neighbouring
+// rows never write to the same line.
+struct Plane
+{
+	int width = 0;
+	int height = 0;
+	int stride = 0; // floats between rows.
+	std::vector<float, CacheAlignedAllocator<float>> data;
+
+	void resize(int width, int height);
+	void fill(float value);
+
+	float *row(int y) { return &data[y * stride]; }
+	const float *row(int y) const { return &data[y * stride]; }
+
+	float &at(int x, int y) { return data[x + y * stride]; }
+	float at(int x, int y) const { return data[x + y * stride]; }
+};
+
+// Mirrors the FlipBuffer used for the GPU textures.
+class FlipPlane
+{
+public:
+	void resize(int width, int height) {
+		planes[0].resize(width, height);
+		planes[1].resize(width, height);
+	}
+
+	void flip() {
+		active_plane = !active_plane;
+	}
+
+	Plane &front() { return planes[active_plane]; }
+	Plane &back() { return planes[!active_plane]; }
+	const Plane &front() const { return planes[active_plane]; }
+	const Plane &back() const { return planes[!active_plane]; }
+
+private:
+	int active_plane = 0;
+	Plane planes[2];
+};
+
+enum class PressureKernel
+{
+	Jacobi,
+	RedBlackGaussSeidel,
+};
+
+// Splits the finest level's Jacobi sweeps into |columns| x |rows|
+// subdomains, each swept by its own thread and exchanging halos with its
+// neighbours, see DomainSolver. With more than one it replaces temporal
+// blocking and the solver's threads for those sweeps.
+struct DomainSettings
+{
+	int columns = 1;
+	int rows = 1;
+
+	// Sweeps and sends a subdomain's edges before its interior, so halos
+	// travel while the interior is computed.
+	bool overlap = true;
+
+	// Pins rank r to hardware thread r. Rank 0 runs on the calling thread,
+	// which gets its own affinity back when the solve returns.
+	bool pin_threads = false;
+
+	int rankCount() const { return columns * rows; }
+};
+
+struct CpuSolverSettings
+{
+	PressureSettings pressure;
+
+	// Fills pressureStats().residual after every solve without a tolerance
+	// too, like the GPU's convergence report, at the cost of another pass
+	// over the grid.
+	bool report_residual = false;
+
+	// Red-black Gauss-Seidel updates in place and converges roughly twice as
+	// fast per iteration, it needs both dimensions of a level to be a
+	// multiple of four and falls back to Jacobi otherwise.
+	PressureKernel pressure_kernel = PressureKernel::Jacobi;
+
+	int threads = 0; // 0 uses every hardware thread.
+
+	// Jacobi sweeps performed on a band of rows while it's resident in cache
+	// rather than streaming the whole grid once per sweep. Every sweep grows
+	// the band's dependencies by two rows above and below, so each band
+	// redundantly recomputes 2 * (sweeps - 1) rows on average. Results are
+	// bit identical to plain sweeps.
+	int temporal_block_sweeps = 1;
+	int temporal_block_rows = 32;
+
+	// Advection runs at the projection timestep times this scale, the GPU
+	// path advects with a timestep of 4 while projecting with 1/60.
+	float advection_scale = 240;
+
+	// MacCormack costs a second pass and a copy over the advected texels.
+	AdvectionScheme advection = AdvectionScheme::SemiLagrangian;
+
+	float impulse_radius = 40; // pixels.
+
+	DomainSettings domains;
+
+	// Only the Jacobi kernel is sparse, red-black Gauss-Seidel and temporal
+	// blocking fall back to plain sweeps over the active tiles.
+	SparseTileSettings sparse;
+};
+
+// Headless reference implementation of the GPU pipeline. Each stage matches
+// the fragment shader of the same name, including GL_REPEAT wrapping and
+// bilinear filtering of the velocity and colour fields.
+class CpuSolver
+{
+public:
+	CpuSolver(int width, int height);
+	~CpuSolver();
+
+	int width() const { return grid_width; }
+	int height() const { return grid_height; }
+
+	// Advances the simulation by |timestep| seconds, equivalent to update().
+	void step(float timestep);
+
+	void advect(float timestep);
+	void calculateDivergence(float timestep);
+	void calculatePressure();
+	void normalizeVelocity(float timestep);
+
+	// Applies an impulse at |x|, |y| (pixels) during the next advection and
+	// moves the ink source there, see handleMouseMove().
+	void setImpulse(float x, float y, float impulse_x, float impulse_y);
+
+	// Adds emitters applied before the next advection, see splatEmitters().
+	void addEmitters(const std::vector<Emitter> &emitters) {
+		frame_emitters.insert(frame_emitters.end(), emitters.begin(), emitters.end());
+	}
+
+	FlipPlane &velocityX() { return velocity_x; }
+	FlipPlane &velocityY() { return velocity_y; }
+	FlipPlane &colour(int channel) { return colours[channel]; }
+	Plane &divergence() { return divergence_plane; }
+	FlipPlane &pressure() { return pressure_plane; }
+
+	const PressureSolveStats &pressureStats() const { return pressure_stats; }
+
+	// Halo exchange timings of the last decomposed sweeps, see DomainSettings.
+	const DomainSolveStats &domainStats() const;
+
+	// Tiles simulated by the last step, see SparseTileSettings.
+	int tileCount() const { return tile_columns * tile_rows; }
+	int activeTileCount() const {
+		return settings.sparse.enabled ? (int)active_tiles.size() : tileCount();
+	}
+
+	// Wall time of each stage run by step(), named as on the GPU.
+	StageProfiler &profiler() { return stage_profiler; }
+
+	CpuSolverSettings settings;
+
+private:
+	// A coarse level of the pressure hierarchy, see calculatePressure().
+	struct MultigridLevel
+	{
+		Plane rhs;
+		FlipPlane pressure;
+	};
+
+	// A rectangle of texels, either a tile or the whole grid.
+	struct Region
+	{
+		int x0, y0, x1, y1;
+	};
+
+	// Runs |task| over the active tiles when sparse, otherwise over the whole
+	// grid, passing the tile index or -1.
+	void forEachRegion(const std::function<void(const Region &region, int tile)> &task);
+	Region tileRegion(int tile) const;
+	void updateActiveTiles();
+	void settleTile(int tile);
+	void markMoving(int tile, float value, float threshold);
+	bool underEmitter(int tile_x, int tile_y) const;
+
+	void splatEmitters();
+
+	void advectRegion(const Region &region, float timestep);
+	void correctRegion(const Region &region, float timestep);
+	float divergenceRegion(const Region &region, float timestep);
+	float normalizeRegion(const Region &region, float timestep);
+
+	void relax(const Plane &rhs, FlipPlane &pressure, int iterations, float relaxation);
+	void relaxTiles(int iterations);
+	float residualTiles();
+	void relaxBlocked(const Plane &rhs, FlipPlane &pressure, int sweeps, float relaxation);
+	float residual(const Plane &rhs, const Plane &pressure);
+	ThreadPool &threadPool();
+	DomainSolver &domainSolver();
+	void restrictResidual(const Plane &rhs, const Plane &pressure, Plane &coarse_rhs);
+	void prolongCorrection(const Plane &coarse_pressure, FlipPlane &pressure);
+	void vCycle(int level);
+
+	int grid_width;
+	int grid_height;
+
+	FlipPlane velocity_x;
+	FlipPlane velocity_y;
+	FlipPlane colours[3];
+	Plane divergence_plane;
+	FlipPlane pressure_plane;
+
+	// MacCormack corrections before they're copied over the back planes,
+	// allocated on first use.
+	Plane corrected_velocity_x;
+	Plane corrected_velocity_y;
+	Plane corrected_colours[3];
+
+	std::vector<MultigridLevel> multigrid_levels;
+
+	PressureSolveStats pressure_stats;
+
+	// Sparse simulation state, per tile in row-major order. A tile is moving
+	// when its velocity or divergence exceeded the threshold this step.
+	int tile_columns;
+	int tile_rows;
+	std::vector<char> tile_moving;
+	std::vector<char> tile_active;
+	std::vector<int> active_tiles;
+	bool sparse_last_step = false;
+
+	enum Stage
+	{
+		kAdvectStage,
+		kDivergenceStage,
+		kPressureStage,
+		kNormalizeStage,
+	};
+	StageProfiler stage_profiler;
+
+	std::unique_ptr<ThreadPool> thread_pool;
+	std::unique_ptr<DomainSolver> domain_solver;
+
+	float impulse_position_x = 0;
+	float impulse_position_y = 0;
+	float frame_impulse_x = 0;
+	float frame_impulse_y = 0;
+	std::vector<Emitter> frame_emitters;
+};
+
+#endif
@@ -0,0 +1,320 @@
+/*
+* Copyright (c) 2017 Owen Glofcheski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#include "domain_solver.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "pressure_kernels.hpp"
+
+namespace {
+
+const int kHalo = 2; // texels, the pressure stencil reaches two away.
+
+// The direction a halo travels, the receiver stores it on its opposite side.
+enum HaloTag
+{
+	kToLeft,
+	kToRight,
+	kToBottom,
+	kToTop,
+	kHaloTagCount,
+};
+
+int wrap(int i, int n) {
+	i %= n;
+	return i < 0 ? i + n : i;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// A thread's affinity from before pinThread(), for restoreThread().
+struct ThreadAffinity
+{
+#ifdef _WIN32
+	DWORD_PTR mask = 0;
+#elif defined(__linux__)
+	cpu_set_t set;
+	bool saved = false;
+#endif
+};
+
+// Pins the calling thread to hardware thread |index|, modulo their number,
+// and returns its previous affinity.
+ThreadAffinity pinThread(int index) {
+	int threads = std::max(1, (int)std::thread::hardware_concurrency());
+	index %= threads;
+	ThreadAffinity previous;
+#ifdef _WIN32
+	previous.mask = SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << (index % 64));
+#elif defined(__linux__)
+	previous.saved = pthread_getaffinity_np(pthread_self(), sizeof(previous.set), &previous.set) == 0;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(index, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+	return previous;
+}
+
+void restoreThread(const ThreadAffinity &affinity) {
+#ifdef _WIN32
+	if (affinity.mask) {
+		SetThreadAffinityMask(GetCurrentThread(), affinity.mask);
+	}
+#elif defined(__linux__)
+	if (affinity.saved) {
+		pthread_setaffinity_np(pthread_self(), sizeof(affinity.set), &affinity.set);
+	}
+#endif
+}
+
+void packBlock(const Plane &plane, int x, int y, int width, int height, float *out) {
+	for (int row = 0; row < height; ++row) {
+		std::copy(plane.row(y + row) + x, plane.row(y + row) + x + width, out + row * width);
+	}
+}
+
+void unpackBlock(const float *in, int x, int y, int width, int height, Plane &plane) {
+	for (int row = 0; row < height; ++row) {
+		std::copy(in + row * width, in + (row + 1) * width, plane.row(y + row) + x);
+	}
+}
+
+DomainSettings clampLayout(DomainSettings settings, int width, int height) {
+	settings.columns = std::max(1, std::min(settings.columns, width / (2 * kHalo)));
+	settings.rows = std::max(1, std::min(settings.rows, height / (2 * kHalo)));
+	return settings;
+}
+
+} // namespace
+
+DomainSettings domainLayout(int workers, int width, int height) {
+	DomainSettings layout;
+	long long best_cut = -1;
+	for (int columns = 1; columns <= workers; ++columns) {
+		int rows = workers / columns;
+		if (columns * rows != workers || columns > width / (2 * kHalo) || rows > height / (2 * kHalo)) {
+			continue;
+		}
+
+		long long cut = (long long)columns * height + (long long)rows * width;
+		if (best_cut < 0 || cut < best_cut) {
+			best_cut = cut;
+			layout.columns = columns;
+			layout.rows = rows;
+		}
+	}
+	return layout;
+}
+
+DomainSolver::DomainSolver(int width, int height, const DomainSettings &settings)
+	: grid_width(width), grid_height(height), domain_settings(settings),
+	domain_layout(clampLayout(settings, width, height)), subdomains(domain_layout.rankCount()),
+	hub(domain_layout.rankCount(), kHaloTagCount), thread_pool(domain_layout.rankCount()) {
+	int columns = domain_layout.columns;
+	int rows = domain_layout.rows;
+	for (int row = 0; row < rows; ++row) {
+		for (int column = 0; column < columns; ++column) {
+			Subdomain &subdomain = subdomains[column + row * columns];
+			subdomain.x0 = width * column / columns;
+			subdomain.x1 = width * (column + 1) / columns;
+			subdomain.y0 = height * row / rows;
+			subdomain.y1 = height * (row + 1) / rows;
+			subdomain.left = wrap(column - 1, columns) + row * columns;
+			subdomain.right = wrap(column + 1, columns) + row * columns;
+			subdomain.bottom = column + wrap(row - 1, rows) * columns;
+			subdomain.top = column + wrap(row + 1, rows) * columns;
+			subdomain.compute_seconds = 0;
+			subdomain.wait_seconds = 0;
+		}
+	}
+}
+
+void DomainSolver::relax(const Plane &rhs, FlipPlane &pressure, int iterations, float relaxation) {
+	const Plane &initial = pressure.front();
+	Plane &result = pressure.back();
+
+	// The pool's own threads stay pinned, but rank 0 runs on the caller, which
+	// is only pinned until the solve returns so threads it creates later
+	// don't inherit the mask.
+	std::thread::id caller = std::this_thread::get_id();
+	ThreadAffinity caller_affinity;
+	bool caller_pinned = false;
+
+	// The pool has a thread per rank, so every rank runs concurrently.
+	thread_pool.parallelFor(rankCount(), [&](int begin, int end) {
+		for (int rank = begin; rank < end; ++rank) {
+			Subdomain &subdomain = subdomains[rank];
+			int width = subdomain.x1 - subdomain.x0;
+			int height = subdomain.y1 - subdomain.y0;
+			bool on_caller = std::this_thread::get_id() == caller;
+			if (domain_settings.pin_threads && (subdomain.rhs.width == 0 || on_caller)) {
+				ThreadAffinity previous = pinThread(rank);
+				if (on_caller && !caller_pinned) {
+					caller_affinity = previous;
+					caller_pinned = true;
+				}
+			}
+			if (subdomain.rhs.width == 0) {
+				subdomain.rhs.resize(width + 2 * kHalo, height + 2 * kHalo);
+				subdomain.pressure.resize(width + 2 * kHalo, height + 2 * kHalo);
+				subdomain.halo.resize(2 * kHalo * std::max(width, height));
+			}
+
+			// Copy in the rectangle and its halo, wrapping around the grid.
+			for (int y = 0; y < height + 2 * kHalo; ++y) {
+				int global_y = wrap(subdomain.y0 + y - kHalo, grid_height);
+				const float *rhs_row = rhs.row(global_y);
+				const float *pressure_row = initial.row(global_y);
+				float *local_rhs = subdomain.rhs.row(y);
+				float *local_pressure = subdomain.pressure.front().row(y);
+				for (int x = 0; x < width + 2 * kHalo; ++x) {
+					int global_x = wrap(subdomain.x0 + x - kHalo, grid_width);
+					local_rhs[x] = rhs_row[global_x];
+					local_pressure[x] = pressure_row[global_x];
+				}
+			}
+
+			SharedMemoryTransport transport(hub, rank);
+			relaxSubdomain(subdomain, transport, iterations, relaxation);
+
+			for (int y = 0; y < height; ++y) {
+				const float *local = subdomain.pressure.front().row(y + kHalo) + kHalo;
+				std::copy(local, local + width, result.row(subdomain.y0 + y) + subdomain.x0);
+			}
+		}
+	});
+	if (caller_pinned) {
+		restoreThread(caller_affinity);
+	}
+
+	// Flip the input and output planes.
+	pressure.flip();
+
+	solve_stats = DomainSolveStats();
+	for (const Subdomain &subdomain : subdomains) {
+		solve_stats.compute_seconds += subdomain.compute_seconds / rankCount();
+		solve_stats.wait_seconds += subdomain.wait_seconds / rankCount();
+		solve_stats.halo_bytes += (double)iterations * kHalo * 2
+			* (subdomain.x1 - subdomain.x0 + subdomain.y1 - subdomain.y0) * sizeof(float);
+	}
+}
+
+void DomainSolver::relaxSubdomain(Subdomain &subdomain, HaloTransport &transport, int iterations,
+	float relaxation) {
+	int plane_width = subdomain.rhs.width;
+	int x0 = kHalo;
+	int y0 = kHalo;
+	int x1 = kHalo + subdomain.x1 - subdomain.x0;
+	int y1 = kHalo + subdomain.y1 - subdomain.y0;
+
+	subdomain.compute_seconds = 0;
+	subdomain.wait_seconds = 0;
+
+	// The halo columns never wrap, the spans stop two short of either end.
+	auto sweep = [&](const Plane &in, Plane &out, int begin_y, int end_y, int begin_x, int end_x) {
+		for (int y = begin_y; y < end_y; ++y) {
+			jacobiSpan(subdomain.rhs.row(y), in.row(y - 2), in.row(y), in.row(y + 2), out.row(y),
+				plane_width, begin_x, end_x, relaxation);
+		}
+	};
+
+	for (int i = 0; i < iterations; ++i) {
+		const Plane &in = subdomain.pressure.front();
+		Plane &out = subdomain.pressure.back();
+
+		auto start = std::chrono::steady_clock::now();
+		if (domain_settings.overlap) {
+			// The texels the neighbours need first, then the interior while
+			// they're in flight.
+			sweep(in, out, y0, y0 + kHalo, x0, x1);
+			sweep(in, out, y1 - kHalo, y1, x0, x1);
+			sweep(in, out, y0 + kHalo, y1 - kHalo, x0, x0 + kHalo);
+			sweep(in, out, y0 + kHalo, y1 - kHalo, x1 - kHalo, x1);
+			sendHalos(subdomain, transport, out);
+			sweep(in, out, y0 + kHalo, y1 - kHalo, x0 + kHalo, x1 - kHalo);
+		} else {
+			sweep(in, out, y0, y1, x0, x1);
+			sendHalos(subdomain, transport, out);
+		}
+		subdomain.compute_seconds += secondsSince(start);
+
+		receiveHalos(subdomain, transport, out);
+
+		// Flip the input and output planes.
+		subdomain.pressure.flip();
+	}
+}
+
+void DomainSolver::sendHalos(Subdomain &subdomain, HaloTransport &transport, const Plane &plane) {
+	int width = subdomain.x1 - subdomain.x0;
+	int height = subdomain.y1 - subdomain.y0;
+	float *halo = &subdomain.halo[0];
+
+	packBlock(plane, kHalo, kHalo, width, kHalo, halo);
+	transport.send(subdomain.bottom, kToBottom, halo, width * kHalo);
+	packBlock(plane, kHalo, height, width, kHalo, halo);
+	transport.send(subdomain.top, kToTop, halo, width * kHalo);
+	packBlock(plane, kHalo, kHalo, kHalo, height, halo);
+	transport.send(subdomain.left, kToLeft, halo, height * kHalo);
+	packBlock(plane, width, kHalo, kHalo, height, halo);
+	transport.send(subdomain.right, kToRight, halo, height * kHalo);
+}
+
+void DomainSolver::receiveHalos(Subdomain &subdomain, HaloTransport &transport, Plane &plane) {
+	int width = subdomain.x1 - subdomain.x0;
+	int height = subdomain.y1 - subdomain.y0;
+	float *halo = &subdomain.halo[0];
+
+	auto start = std::chrono::steady_clock::now();
+	transport.receive(subdomain.top, kToBottom, halo, width * kHalo);
+	subdomain.wait_seconds += secondsSince(start);
+	unpackBlock(halo, kHalo, kHalo + height, width, kHalo, plane);
+
+	start = std::chrono::steady_clock::now();
+	transport.receive(subdomain.bottom, kToTop, halo, width * kHalo);
+	subdomain.wait_seconds += secondsSince(start);
+	unpackBlock(halo, kHalo, 0, width, kHalo, plane);
+
+	start = std::chrono::steady_clock::now();
+	transport.receive(subdomain.right, kToLeft, halo, height * kHalo);
+	subdomain.wait_seconds += secondsSince(start);
+	unpackBlock(halo, kHalo + width, kHalo, kHalo, height, plane);
+
+	start = std::chrono::steady_clock::now();
+	transport.receive(subdomain.left, kToRight, halo, height * kHalo);
+	subdomain.wait_seconds += secondsSince(start);
+	unpackBlock(halo, 0, kHalo, kHalo, height, plane);
+}
@@ -0,0 +1,82 @@
+#ifndef _DOMAIN_SOLVER_HPP_
+#define _DOMAIN_SOLVER_HPP_
+
+#include <memory>
+#include <vector>
+
+#include "cpu_solver.hpp"
+#include "halo_transport.hpp"
+#include "thread_pool.hpp"
+
+// Columns and rows for |workers| subdomains of a |width| by |height| grid,
+// the factorisation with the shortest total cut between them, capped so no
+// subdomain is narrower than 4 texels.
+DomainSettings domainLayout(int workers, int width, int height);
+
+// Time spent by the ranks of the last DomainSolver::relax(), averaged.
+struct DomainSolveStats
+{
+	double compute_seconds = 0; // sweeping and packing halos.
+	double wait_seconds = 0; // blocked in HaloTransport::receive().
+	double halo_bytes = 0; // sent by every rank over every iteration.
+};
+
+// The Jacobi pressure sweep split into a grid of rectangular subdomains, each
+// owned by one rank with a two texel halo for the stride two stencil. Ranks
+// are threads of a pool with one thread each and only exchange halos through
+// a HaloTransport, relaxSubdomain() touches nothing else, so moving ranks to
+// processes or nodes is a matter of another transport. Neighbours wrap like
+// GL_REPEAT and the stencil has no diagonals, so corners are never sent.
+// Results are bit identical to CpuSolver::relax().
+class DomainSolver
+{
+public:
+	DomainSolver(int width, int height, const DomainSettings &settings);
+
+	int rankCount() const { return (int)subdomains.size(); }
+
+	// As constructed, the layout may have fewer columns or rows.
+	const DomainSettings &settings() const { return domain_settings; }
+	const DomainSettings &layout() const { return domain_layout; }
+
+	// Runs |iterations| Jacobi sweeps from |pressure|'s front plane, which
+	// holds the result afterwards. Every rank copies its rectangle in and out
+	// itself, so its planes are first touched by its own thread.
+	void relax(const Plane &rhs, FlipPlane &pressure, int iterations, float relaxation);
+
+	const DomainSolveStats &stats() const { return solve_stats; }
+
+private:
+	// One rank's rectangle [x0, x1) x [y0, y1) of the global grid. The planes
+	// cover it plus the halo, global texel (x0, y0) is local (2, 2).
+	struct Subdomain
+	{
+		int x0, y0, x1, y1;
+		int left, right, bottom, top; // neighbouring ranks.
+
+		Plane rhs;
+		FlipPlane pressure;
+		std::vector<float> halo; // packing buffer.
+
+		double compute_seconds;
+		double wait_seconds;
+	};
+
+	void relaxSubdomain(Subdomain &subdomain, HaloTransport &transport, int iterations,
+		float relaxation);
+	void sendHalos(Subdomain &subdomain, HaloTransport &transport, const Plane &plane);
+	void receiveHalos(Subdomain &subdomain, HaloTransport &transport, Plane &plane);
+
+	int grid_width;
+	int grid_height;
+	DomainSettings domain_settings;
+	DomainSettings domain_layout;
+
+	std::vector<Subdomain> subdomains;
+	SharedMemoryHub hub;
+	ThreadPool thread_pool;
+
+	DomainSolveStats solve_stats;
+};
+
+#endif
\ No newline at end of file
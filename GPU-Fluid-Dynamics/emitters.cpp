@@ -0,0 +1,175 @@
+/*
+* Copyright (c) 2017 Owen Glofcheski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#include "emitters.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+
+namespace {
+
+const float kPi = 3.14159265f;
+
+// Parses "first-last", "first-" or "*".
+bool parseSteps(const std::string &text, uint64_t *first, uint64_t *last) {
+	if (text == "*") {
+		*first = 0;
+		*last = std::numeric_limits<uint64_t>::max();
+		return true;
+	}
+	size_t dash = text.find('-');
+	if (dash == std::string::npos || dash == 0) {
+		return false;
+	}
+	char *end = nullptr;
+	*first = strtoull(text.c_str(), &end, 10);
+	if (end != text.c_str() + dash) {
+		return false;
+	}
+	if (dash + 1 == text.size()) {
+		*last = std::numeric_limits<uint64_t>::max();
+		return true;
+	}
+	*last = strtoull(text.c_str() + dash + 1, &end, 10);
+	return *end == '\0' && *last >= *first;
+}
+
+// A small xorshift generator, std::uniform_real_distribution differs
+// between standard libraries.
+struct Random
+{
+	uint32_t state;
+
+	explicit Random(uint32_t seed) : state(seed ? seed : 1) {}
+
+	float next() {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return (state >> 8) / 16777216.0f;
+	}
+};
+
+// Fully saturated colour of |hue| in [0, 1).
+void hueColour(float hue, Emitter *emitter) {
+	float h = hue * 6;
+	emitter->red = std::min(std::max(std::abs(h - 3) - 1, 0.0f), 1.0f);
+	emitter->green = std::min(std::max(2 - std::abs(h - 2), 0.0f), 1.0f);
+	emitter->blue = std::min(std::max(2 - std::abs(h - 4), 0.0f), 1.0f);
+}
+
+} // namespace
+
+bool EmitterScript::load(const char *path, int width, int height) {
+	entries.clear();
+
+	std::ifstream file(path);
+	if (!file) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		return false;
+	}
+
+	std::string line;
+	int line_number = 0;
+	while (std::getline(file, line)) {
+		++line_number;
+
+		std::istringstream stream(line.substr(0, line.find('#')));
+		std::string kind;
+		if (!(stream >> kind)) {
+			continue;
+		}
+
+		std::string steps;
+		Entry entry;
+		Emitter &emitter = entry.emitter;
+		bool valid = (stream >> steps) && parseSteps(steps, &entry.first_step, &entry.last_step);
+		if (valid && kind == "emitter") {
+			valid = (bool)(stream >> emitter.x >> emitter.y >> emitter.radius >> emitter.force_x >> emitter.force_y
+				>> emitter.red >> emitter.green >> emitter.blue);
+			if (valid && !(stream >> emitter.dye)) {
+				emitter.dye = 1;
+			}
+			if (valid) {
+				entries.push_back(entry);
+			}
+		} else if (valid && kind == "ring") {
+			int count = 0;
+			float x, y, ring_radius, force;
+			valid = (bool)(stream >> count >> x >> y >> ring_radius >> emitter.radius >> force
+				>> emitter.red >> emitter.green >> emitter.blue) && count > 0;
+			if (valid && !(stream >> emitter.dye)) {
+				emitter.dye = 1;
+			}
+			for (int i = 0; valid && i < count; ++i) {
+				float angle = 2 * kPi * i / count;
+				emitter.x = x + std::cos(angle) * ring_radius;
+				emitter.y = y + std::sin(angle) * ring_radius;
+				emitter.force_x = -std::sin(angle) * force;
+				emitter.force_y = std::cos(angle) * force;
+				entries.push_back(entry);
+			}
+		} else if (valid && kind == "random") {
+			int count = 0;
+			unsigned int seed = 0;
+			float force;
+			valid = (bool)(stream >> count >> seed >> emitter.radius >> force) && count > 0;
+			if (valid && !(stream >> emitter.dye)) {
+				emitter.dye = 1;
+			}
+			Random random(seed);
+			for (int i = 0; valid && i < count; ++i) {
+				emitter.x = random.next() * width;
+				emitter.y = random.next() * height;
+				float angle = 2 * kPi * random.next();
+				emitter.force_x = std::cos(angle) * force;
+				emitter.force_y = std::sin(angle) * force;
+				hueColour(random.next(), &emitter);
+				entries.push_back(entry);
+			}
+		} else {
+			valid = false;
+		}
+
+		if (!valid) {
+			fprintf(stderr, "%s:%d: invalid emitter\n", path, line_number);
+			entries.clear();
+			return false;
+		}
+	}
+	return true;
+}
+
+void EmitterScript::emittersAt(uint64_t step, std::vector<Emitter> *emitters) const {
+	for (const Entry &entry : entries) {
+		if (step >= entry.first_step && step <= entry.last_step) {
+			emitters->push_back(entry.emitter);
+		}
+	}
+}
@@ -0,0 +1,58 @@
+#ifndef _EMITTERS_HPP_
+#define _EMITTERS_HPP_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A force and dye source applied before advection, in canvas pixels. The
+// force falls off with the square of the distance from the centre like the
+// mouse impulse and the dye is blended in with a linear falloff.
+struct Emitter
+{
+	float x = 0;
+	float y = 0;
+	float radius = 40;
+	float force_x = 0; // pixels per step at the centre.
+	float force_y = 0;
+	float red = 1;
+	float green = 1;
+	float blue = 1;
+	float dye = 1; // opacity of the dye at the centre, 0 adds none.
+};
+
+// Emitters read from a file, each active for a range of steps, for
+// reproducible runs with any number of sources. One emitter or group per
+// line, '#' starts a comment, <steps> is "first-last", "first-" or "*":
+//
+//   emitter <steps> x y radius force_x force_y red green blue [dye]
+//   ring <steps> count x y ring_radius radius force red green blue [dye]
+//   random <steps> count seed radius force [dye]
+//
+// A ring spaces its emitters evenly around a circle pushing along it. Random
+// emitters are placed over the whole canvas with a random direction and
+// colour from |seed|, identically on every platform.
+class EmitterScript
+{
+public:
+	// Parses |path| for a |width| x |height| canvas. Returns false and prints
+	// the error on failure.
+	bool load(const char *path, int width, int height);
+
+	// Appends the emitters active at |step| to |emitters|.
+	void emittersAt(uint64_t step, std::vector<Emitter> *emitters) const;
+
+	size_t size() const { return entries.size(); }
+
+private:
+	struct Entry
+	{
+		uint64_t first_step;
+		uint64_t last_step;
+		Emitter emitter;
+	};
+
+	std::vector<Entry> entries;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,217 @@
+/*
+* Copyright (c) 2017 Owen Glofcheski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#include "frame_capture.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "image_writer.hpp"
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+namespace {
+
+#ifdef _WIN32
+const char *kPipeMode = "wb";
+#else
+const char *kPipeMode = "w";
+#endif
+
+// Replaces every |name| in |text| with |value|.
+std::string replaceAll(std::string text, const std::string &name, const std::string &value) {
+	for (size_t at = text.find(name); at != std::string::npos; at = text.find(name, at + value.size())) {
+		text.replace(at, name.size(), value);
+	}
+	return text;
+}
+
+} // namespace
+
+FrameCapture::~FrameCapture() {
+	stopWriter();
+}
+
+bool FrameCapture::start(const CaptureSettings &settings, int width, int height) {
+	if (active) {
+		stop();
+	}
+
+	this->settings = settings;
+	this->settings.interval = std::max(1, settings.interval);
+	this->settings.queue_frames = std::max(1, settings.queue_frames);
+	this->width = width;
+	this->height = height;
+	bool floats = settings.format == CaptureFormat::Exr;
+	pixel_bytes = floats ? 3 * sizeof(GLfloat) : 3;
+
+	if (settings.format == CaptureFormat::Pipe) {
+		std::string command = replaceAll(settings.output, "{width}", std::to_string(width));
+		command = replaceAll(command, "{height}", std::to_string(height));
+		pipe = popen(command.c_str(), kPipeMode);
+		if (!pipe) {
+			fprintf(stderr, "Failed to run %s\n", command.c_str());
+			return false;
+		}
+	}
+
+	readback.init(std::max(1, settings.latency));
+	due_counter = 0;
+	frames_captured = 0;
+	frames_written = 0;
+	write_failed = false;
+	stopping = false;
+	blocked_ms = 0;
+	queue.clear();
+	start_time = std::chrono::steady_clock::now();
+	writer = std::thread(&FrameCapture::writerLoop, this);
+	active = true;
+	return true;
+}
+
+void FrameCapture::stop() {
+	if (!active) {
+		return;
+	}
+	collect(true);
+	readback.destroy();
+	stopWriter();
+	active = false;
+
+	if (pipe) {
+		pclose(pipe);
+		pipe = nullptr;
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+	printf("Captured %d frames (%d written) in %.2f s, %.1f ms waiting on the writer\n",
+		frames_captured, frames_written, seconds, blocked_ms);
+}
+
+void FrameCapture::capture(GLuint colour_texture) {
+	collect(false);
+
+	GLenum type = settings.format == CaptureFormat::Exr ? GL_FLOAT : GL_UNSIGNED_BYTE;
+	size_t bytes = (size_t)width * height * pixel_bytes;
+	for (int attempt = 0; attempt < 2; ++attempt) {
+		bool queued = settings.source == CaptureSource::Colour
+			? readback.readTexture(colour_texture, GL_RGB, type, bytes, frames_captured)
+			: readback.readFramebuffer(width, height, GL_RGB, type, bytes, frames_captured);
+		if (queued) {
+			++frames_captured;
+			return;
+		}
+
+		// The GPU is a whole ring of frames behind, wait for the oldest.
+		collect(true);
+	}
+}
+
+void FrameCapture::collect(bool wait) {
+	readback.poll(wait, [this](int index, const void *data, size_t bytes) {
+		std::unique_lock<std::mutex> lock(mutex);
+		if ((int)queue.size() >= settings.queue_frames) {
+			auto wait_start = std::chrono::steady_clock::now();
+			frame_written.wait(lock, [this] { return (int)queue.size() < settings.queue_frames; });
+			blocked_ms += std::chrono::duration<double, std::milli>(
+				std::chrono::steady_clock::now() - wait_start).count();
+		}
+
+		Frame frame;
+		frame.index = index;
+		if (!free_buffers.empty()) {
+			frame.data.swap(free_buffers.back());
+			free_buffers.pop_back();
+		}
+		frame.data.resize(bytes);
+		memcpy(&frame.data[0], data, bytes);
+		queue.push_back(std::move(frame));
+		frame_queued.notify_one();
+	});
+}
+
+void FrameCapture::writerLoop() {
+	std::vector<unsigned char> flipped;
+	for (;;) {
+		Frame frame;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			frame_queued.wait(lock, [this] { return !queue.empty() || stopping; });
+			if (queue.empty()) {
+				return;
+			}
+			frame = std::move(queue.front());
+			queue.pop_front();
+		}
+
+		bool written = !write_failed && writeFrame(frame, flipped);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		write_failed = !written;
+		frames_written += written;
+		free_buffers.push_back(std::move(frame.data));
+		frame_written.notify_one();
+	}
+}
+
+bool FrameCapture::writeFrame(const Frame &frame, std::vector<unsigned char> &flipped) {
+	// GL rows run bottom to top.
+	size_t row_bytes = (size_t)width * pixel_bytes;
+	flipped.resize(frame.data.size());
+	for (int y = 0; y < height; ++y) {
+		memcpy(&flipped[y * row_bytes], &frame.data[(height - 1 - y) * row_bytes], row_bytes);
+	}
+
+	char path[512];
+	switch (settings.format) {
+		case CaptureFormat::Png:
+			snprintf(path, sizeof(path), "%s_%06d.png", settings.output.c_str(), frame.index);
+			return writePng(path, width, height, &flipped[0]);
+		case CaptureFormat::Exr:
+			snprintf(path, sizeof(path), "%s_%06d.exr", settings.output.c_str(), frame.index);
+			return writeExr(path, width, height, (const float*)&flipped[0]);
+		case CaptureFormat::Pipe:
+			if (fwrite(&flipped[0], 1, flipped.size(), pipe) != flipped.size()) {
+				fprintf(stderr, "Failed to write to the capture pipe\n");
+				return false;
+			}
+			return true;
+	}
+	return false;
+}
+
+void FrameCapture::stopWriter() {
+	if (!writer.joinable()) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	frame_queued.notify_one();
+	writer.join();
+}
@@ -0,0 +1,82 @@
+#ifndef _FRAME_CAPTURE_HPP_
+#define _FRAME_CAPTURE_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Utility\gl.hpp"
+
+#include "async_readback.hpp"
+#include "run_config.hpp"
+
+// Records frames without stalling the render loop. Each capture is read into
+// a ring of |latency| pixel buffers and collected by poll() once its fence
+// has passed, normally a few frames later. A writer thread then flips the
+// rows top down and writes them out, so only a full writer queue ever makes
+// the render loop wait.
+class FrameCapture
+{
+public:
+	~FrameCapture();
+
+	// Returns false and prints the error on failure.
+	bool start(const CaptureSettings &settings, int width, int height);
+
+	// Writes every outstanding frame, stops the writer and prints a summary.
+	void stop();
+
+	bool isActive() const { return active; }
+
+	// Counts a frame, true for every |interval|th.
+	bool frameDue() { return due_counter++ % settings.interval == 0; }
+
+	// Queues a readback of |colour_texture| or the read framebuffer,
+	// depending on the source.
+	void capture(GLuint colour_texture);
+
+	// Hands completed readbacks to the writer, call once per frame.
+	void poll() { collect(false); }
+
+private:
+	struct Frame
+	{
+		int index;
+		std::vector<unsigned char> data;
+	};
+
+	void collect(bool wait);
+	void writerLoop();
+	bool writeFrame(const Frame &frame, std::vector<unsigned char> &flipped);
+	void stopWriter();
+
+	CaptureSettings settings;
+	int width = 0;
+	int height = 0;
+	size_t pixel_bytes = 0;
+	bool active = false;
+	int due_counter = 0;
+	int frames_captured = 0;
+	AsyncReadback readback;
+	FILE *pipe = nullptr;
+
+	// Shared with the writer thread.
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable frame_queued;
+	std::condition_variable frame_written;
+	std::deque<Frame> queue;
+	std::vector<std::vector<unsigned char>> free_buffers;
+	bool stopping = false;
+	int frames_written = 0;
+	bool write_failed = false;
+
+	double blocked_ms = 0; // render loop time spent waiting on the writer.
+	std::chrono::steady_clock::time_point start_time;
+};
+
+#endif
\ No newline at end of file
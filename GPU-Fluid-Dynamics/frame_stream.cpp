@@ -0,0 +1,233 @@
+/*
+* Copyright (c) 2017 Owen Glofcheski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#include "frame_stream.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Runs of unchanged bytes shorter than this are folded into the literals.
+const int kMinUnchangedRun = 4;
+const int kMaxRun = 0xffff;
+
+void appendRun(std::vector<unsigned char> &out, int unchanged, int literals) {
+	out.push_back((unsigned char)(unchanged & 0xff));
+	out.push_back((unsigned char)(unchanged >> 8));
+	out.push_back((unsigned char)(literals & 0xff));
+	out.push_back((unsigned char)(literals >> 8));
+}
+
+// Encodes the difference of |frame| to |previous| into |out|.
+void encodeFrame(const unsigned char *frame, const unsigned char *previous, size_t size,
+	std::vector<unsigned char> &out) {
+	out.clear();
+	size_t i = 0;
+	while (i < size) {
+		int unchanged = 0;
+		while (i < size && unchanged < kMaxRun && frame[i] == previous[i]) {
+			++unchanged;
+			++i;
+		}
+
+		// Literals run until kMinUnchangedRun bytes in a row are unchanged.
+		size_t begin = i;
+		size_t end = i;
+		while (end < size && end - begin < kMaxRun) {
+			if (frame[end] != previous[end]) {
+				++end;
+				continue;
+			}
+			size_t run_end = end;
+			while (run_end < size && run_end - end < kMinUnchangedRun && frame[run_end] == previous[run_end]) {
+				++run_end;
+			}
+			if (run_end - end >= kMinUnchangedRun || run_end == size) {
+				break;
+			}
+			end = std::min(run_end, begin + kMaxRun);
+		}
+
+		appendRun(out, unchanged, (int)(end - begin));
+		for (size_t j = begin; j < end; ++j) {
+			out.push_back((unsigned char)(frame[j] - previous[j]));
+		}
+		i = end;
+	}
+}
+
+} // namespace
+
+FrameStreamWriter::~FrameStreamWriter() {
+	close();
+}
+
+bool FrameStreamWriter::open(const char *path, int width, int height, int keyframe_interval) {
+	close();
+
+	file = fopen(path, "wb");
+	if (!file) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		return false;
+	}
+
+	memcpy(header.magic, kFrameStreamMagic, sizeof(header.magic));
+	header.version = kFrameStreamVersion;
+	header.width = width;
+	header.height = height;
+	header.keyframe_interval = (uint32_t)std::max(1, keyframe_interval);
+	header.frame_count = 0;
+	header.index_offset = 0;
+	previous.assign((size_t)width * height * 3, 0);
+	offsets.clear();
+	encoded_bytes = 0;
+
+	if (fwrite(&header, sizeof(header), 1, file) != 1) {
+		fprintf(stderr, "Failed to write %s\n", path);
+		fclose(file);
+		file = nullptr;
+		return false;
+	}
+	return true;
+}
+
+bool FrameStreamWriter::write(const unsigned char *rgb) {
+	if (!file) {
+		return false;
+	}
+
+	if (header.frame_count % header.keyframe_interval == 0) {
+		std::fill(previous.begin(), previous.end(), 0);
+	}
+	encodeFrame(rgb, &previous[0], previous.size(), encoded);
+	memcpy(&previous[0], rgb, previous.size());
+
+	offsets.push_back(sizeof(header) + encoded_bytes);
+	encoded_bytes += encoded.size();
+	++header.frame_count;
+	return fwrite(&encoded[0], 1, encoded.size(), file) == encoded.size();
+}
+
+bool FrameStreamWriter::close() {
+	if (!file) {
+		return false;
+	}
+
+	header.index_offset = sizeof(header) + encoded_bytes;
+	bool written = offsets.empty()
+		|| fwrite(&offsets[0], sizeof(uint64_t), offsets.size(), file) == offsets.size();
+	written = written && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+	written = fclose(file) == 0 && written;
+	file = nullptr;
+	if (!written) {
+		fprintf(stderr, "Failed to write the frame stream\n");
+	}
+	return written;
+}
+
+bool FrameStreamReader::open(const char *path) {
+	current_frame = -1;
+	if (!file.open(path)) {
+		return false;
+	}
+
+	if (file.size() < sizeof(header)) {
+		fprintf(stderr, "%s: not a frame stream\n", path);
+		return false;
+	}
+	memcpy(&header, file.data(), sizeof(header));
+	if (memcmp(header.magic, kFrameStreamMagic, sizeof(header.magic)) != 0) {
+		fprintf(stderr, "%s: not a frame stream\n", path);
+		return false;
+	}
+	if (header.version != kFrameStreamVersion) {
+		fprintf(stderr, "%s: unsupported frame stream version %u\n", path, header.version);
+		return false;
+	}
+	if (header.index_offset == 0 || header.width <= 0 || header.height <= 0 || header.keyframe_interval == 0
+		|| header.index_offset + (uint64_t)header.frame_count * sizeof(uint64_t) > file.size()) {
+		fprintf(stderr, "%s: incomplete frame stream\n", path);
+		return false;
+	}
+
+	current.assign((size_t)header.width * header.height * 3, 0);
+	return true;
+}
+
+bool FrameStreamReader::read(int frame, unsigned char *rgb) {
+	if (frame < 0 || frame >= frameCount()) {
+		return false;
+	}
+
+	if (frame != current_frame) {
+		int keyframe = frame / (int)header.keyframe_interval * (int)header.keyframe_interval;
+		int first = current_frame >= keyframe && current_frame < frame ? current_frame + 1 : keyframe;
+		for (int i = first; i <= frame; ++i) {
+			if (!decode(i)) {
+				current_frame = -1;
+				return false;
+			}
+		}
+	}
+
+	memcpy(rgb, &current[0], current.size());
+	return true;
+}
+
+bool FrameStreamReader::decode(int frame) {
+	uint64_t index_entry;
+	memcpy(&index_entry, file.data() + header.index_offset + frame * sizeof(uint64_t), sizeof(index_entry));
+	uint64_t end = frame + 1 < frameCount() ? 0 : header.index_offset;
+	if (end == 0) {
+		memcpy(&end, file.data() + header.index_offset + (frame + 1) * sizeof(uint64_t), sizeof(end));
+	}
+	if (index_entry > end || end > header.index_offset) {
+		fprintf(stderr, "Corrupt frame %d\n", frame);
+		return false;
+	}
+
+	if (frame % header.keyframe_interval == 0) {
+		std::fill(current.begin(), current.end(), 0);
+	}
+
+	const unsigned char *in = file.data() + index_entry;
+	const unsigned char *in_end = file.data() + end;
+	size_t i = 0;
+	while (in + 4 <= in_end) {
+		int unchanged = in[0] | (in[1] << 8);
+		int literals = in[2] | (in[3] << 8);
+		in += 4;
+		i += unchanged;
+		if (i + literals > current.size() || in + literals > in_end) {
+			fprintf(stderr, "Corrupt frame %d\n", frame);
+			return false;
+		}
+		for (int j = 0; j < literals; ++j) {
+			current[i++] += *in++;
+		}
+	}
+
+	current_frame = frame;
+	return true;
+}
@@ -0,0 +1,83 @@
+#ifndef _FRAME_STREAM_HPP_
+#define _FRAME_STREAM_HPP_
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "mapped_file.hpp"
+
+// Compressed stream of 8 bit RGB frames for replay. Each frame stores its
+// byte-wise difference to the previous frame, or to black on keyframes, as
+// alternating runs of unchanged bytes and literal differences, which is
+// cheap to produce and small wherever the canvas is still. Little endian.
+//
+//   FrameStreamHeader
+//   per frame: uint16 unchanged, uint16 literal count, literals... repeated
+//   uint64 offset of every frame, at index_offset
+const char kFrameStreamMagic[4] = { 'G', 'F', 'D', 'R' };
+const uint32_t kFrameStreamVersion = 1;
+
+struct FrameStreamHeader
+{
+	char magic[4];
+	uint32_t version;
+	int32_t width;
+	int32_t height;
+	uint32_t keyframe_interval;
+	uint32_t frame_count;
+	uint64_t index_offset; // 0 until the stream is closed.
+};
+
+class FrameStreamWriter
+{
+public:
+	~FrameStreamWriter();
+
+	// Returns false and prints the error on failure.
+	bool open(const char *path, int width, int height, int keyframe_interval);
+
+	// Appends |rgb|, width * height * 3 bytes.
+	bool write(const unsigned char *rgb);
+
+	// Writes the frame index, a stream that isn't closed can't be read.
+	bool close();
+
+	bool isOpen() const { return file != nullptr; }
+	uint64_t rawBytes() const { return (uint64_t)header.frame_count * previous.size(); }
+	uint64_t encodedBytes() const { return encoded_bytes; }
+
+private:
+	FILE *file = nullptr;
+	FrameStreamHeader header;
+	std::vector<unsigned char> previous;
+	std::vector<unsigned char> encoded;
+	std::vector<uint64_t> offsets;
+	uint64_t encoded_bytes = 0;
+};
+
+// Reads a closed stream through a memory mapping.
+class FrameStreamReader
+{
+public:
+	// Returns false and prints the error on failure.
+	bool open(const char *path);
+
+	int width() const { return header.width; }
+	int height() const { return header.height; }
+	int frameCount() const { return (int)header.frame_count; }
+
+	// Decodes |frame| into |rgb|, width * height * 3 bytes. Sequential reads
+	// only decode one frame, others decode forward from the last keyframe.
+	bool read(int frame, unsigned char *rgb);
+
+private:
+	bool decode(int frame);
+
+	MappedFile file;
+	FrameStreamHeader header;
+	std::vector<unsigned char> current;
+	int current_frame = -1;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,64 @@
+uniform sampler2D velocity_sampler;
+uniform sampler2D colour_sampler;
+
+uniform vec2 grid_size;
+
+uniform vec2 mouse_position;
+uniform vec2 mouse_impulse;
+uniform float impulse_radius;
+
+uniform float timestep;
+uniform float divergence_timestep;
+
+// The velocity advection.frag writes for the texel at |frag_coord|.
+vec2 advectedVelocity(vec2 frag_coord)
+{
+	frag_coord = mod(frag_coord, grid_size);
+
+	vec2 velocity = texture2D(velocity_sampler, frag_coord / grid_size).xy;
+	vec2 prev_pos = (frag_coord - velocity * timestep) / grid_size;
+
+	vec2 prev_velocity = texture2D(velocity_sampler, prev_pos).xy;
+
+	// Apply mouse force.
+	float dist = distance(frag_coord, mouse_position);
+	float r = min(dist / impulse_radius, 1.0);
+	float mag = 1.0 - r;
+	return prev_velocity + mouse_impulse * mag*mag;
+}
+
+// advection.frag followed by divergence.frag in a single pass. The divergence
+// is taken from the advected velocity of the neighbouring texels, which are
+// recomputed here rather than read back from the velocity output.
+void main()
+{
+	vec2 uv = gl_FragCoord.xy / grid_size;
+
+	vec2 velocity = texture2D(velocity_sampler, uv).xy;
+	vec2 prev_pos = (gl_FragCoord.xy - velocity * timestep) / grid_size;
+
+	vec4 prev_colour = texture2D(colour_sampler, prev_pos);
+	vec4 prev_velocity = texture2D(velocity_sampler, prev_pos);
+
+	// Apply mouse force.
+	float dist = distance(gl_FragCoord.xy, mouse_position);
+	float r = min(dist / impulse_radius, 1.0);
+	float mag = 1.0 - r;
+	prev_velocity.xy += mouse_impulse * mag*mag;
+
+	// Add some additional ink within the mouse radius.
+	if (r < 1.0) {
+		prev_colour.x = float(mod(gl_FragCoord.x + gl_FragCoord.y, 100.0) < 50.0);
+		prev_colour.y = float(mod(gl_FragCoord.x, 100.0) < 50.0);
+		prev_colour.z = float(mod(gl_FragCoord.y, 100.0) < 50.0);
+	}
+
+	float uL = advectedVelocity(gl_FragCoord.xy - vec2(1.0, 0.0)).x;
+	float uR = advectedVelocity(gl_FragCoord.xy + vec2(1.0, 0.0)).x;
+	float uB = advectedVelocity(gl_FragCoord.xy - vec2(0.0, 1.0)).y;
+	float uT = advectedVelocity(gl_FragCoord.xy + vec2(0.0, 1.0)).y;
+
+	gl_FragData[0] = prev_colour;
+	gl_FragData[1] = prev_velocity;
+	gl_FragData[2].x = -2.0 * ((uR - uL) / grid_size.x + (uT - uB) / grid_size.y) / divergence_timestep;
+}
\ No newline at end of file
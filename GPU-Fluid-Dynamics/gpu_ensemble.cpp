@@ -0,0 +1,255 @@
+/*
+* Copyright (c) 2017 Owen Glofcheski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#include "gpu_ensemble.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+#include "compute_shader.hpp"
+
+namespace {
+
+// Matches Member in the ensemble shaders, std430.
+struct GpuMember
+{
+	GLfloat impulse[4];
+	GLfloat impulse_radius;
+	GLfloat advection_timestep;
+	GLint jacobi_iterations;
+	GLfloat padding;
+};
+
+const float kTimestep = 1 / 60.0f;
+
+} // namespace
+
+GpuEnsemble::~GpuEnsemble() {
+	destroy();
+}
+
+bool GpuEnsemble::create(int size, const std::vector<EnsembleMember> &ensemble_members) {
+	destroy();
+	grid_size = size;
+	members = ensemble_members;
+
+	GLint max_layers = 0;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers);
+	if ((int)members.size() > max_layers) {
+		fprintf(stderr, "An ensemble can have at most %d members\n", max_layers);
+		return false;
+	}
+
+	advection_program = loadComputeShader("ensemble_advection.comp", "");
+	divergence_program = loadComputeShader("ensemble_divergence.comp", "");
+	pressure_program = loadComputeShader("ensemble_pressure.comp", "");
+	normalization_program = loadComputeShader("ensemble_normalization.comp", "");
+	if (!advection_program || !divergence_program || !pressure_program || !normalization_program) {
+		destroy();
+		return false;
+	}
+
+	std::vector<GpuMember> gpu_members(members.size());
+	for (size_t i = 0; i < members.size(); ++i) {
+		const EnsembleMember &member = members[i];
+		GpuMember &gpu_member = gpu_members[i];
+		gpu_member.impulse[0] = member.impulse_x;
+		gpu_member.impulse[1] = member.impulse_y;
+		gpu_member.impulse[2] = member.impulse_dx;
+		gpu_member.impulse[3] = member.impulse_dy;
+		gpu_member.impulse_radius = member.impulse_radius;
+		gpu_member.advection_timestep = member.advection_timestep;
+		gpu_member.jacobi_iterations = member.jacobi_iterations;
+		gpu_member.padding = 0;
+	}
+	glGenBuffers(1, &member_buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, member_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, gpu_members.size() * sizeof(GpuMember),
+		gpu_members.empty() ? nullptr : &gpu_members[0], GL_STATIC_DRAW);
+
+	// The layers by descending iteration count, see ensemble_pressure.comp.
+	std::vector<GLint> layers(members.size());
+	for (size_t i = 0; i < layers.size(); ++i) {
+		layers[i] = (GLint)i;
+	}
+	std::stable_sort(layers.begin(), layers.end(), [&](GLint a, GLint b) {
+		return members[a].jacobi_iterations > members[b].jacobi_iterations;
+	});
+	layer_iterations.resize(layers.size());
+	for (size_t i = 0; i < layers.size(); ++i) {
+		layer_iterations[i] = members[layers[i]].jacobi_iterations;
+	}
+	glGenBuffers(1, &active_layer_buffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, active_layer_buffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, layers.size() * sizeof(GLint),
+		layers.empty() ? nullptr : &layers[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// Same initial colour as init() in every member.
+	size_t texels = (size_t)size * size;
+	std::vector<GLfloat> colour_data(texels * members.size() * 4);
+	for (size_t layer = 0; layer < members.size(); ++layer) {
+		for (int y = 0; y < size; ++y) {
+			for (int x = 0; x < size; ++x) {
+				GLfloat *texel = &colour_data[(layer * texels + x + (size_t)y * size) * 4];
+				texel[0] = ((x + y) % 100) < 50;
+				texel[1] = (x % 100) < 50;
+				texel[2] = (y % 100) < 50;
+			}
+		}
+	}
+
+	for (int i = 0; i < 2; ++i) {
+		velocity_texture.buffers[i] = createArray(GL_RG32F, nullptr);
+		colour_texture.buffers[i] = createArray(GL_RGBA32F, &colour_data[0]);
+		pressure_texture.buffers[i] = createArray(GL_R32F, nullptr);
+	}
+	divergence_texture = createArray(GL_R32F, nullptr);
+	return true;
+}
+
+void GpuEnsemble::destroy() {
+	if (member_buffer) {
+		glDeleteTextures(2, velocity_texture.buffers);
+		glDeleteTextures(2, colour_texture.buffers);
+		glDeleteTextures(2, pressure_texture.buffers);
+		glDeleteTextures(1, &divergence_texture);
+		glDeleteBuffers(1, &member_buffer);
+		glDeleteBuffers(1, &active_layer_buffer);
+		member_buffer = 0;
+		active_layer_buffer = 0;
+	}
+	glDeleteProgram(advection_program);
+	glDeleteProgram(divergence_program);
+	glDeleteProgram(pressure_program);
+	glDeleteProgram(normalization_program);
+	advection_program = 0;
+	divergence_program = 0;
+	pressure_program = 0;
+	normalization_program = 0;
+}
+
+// A zeroed array of |format| with a layer per member, or filled from RGBA
+// floats when |data| is set.
+GLuint GpuEnsemble::createArray(GLenum format, const GLfloat *data) const {
+	std::vector<GLfloat> zeros;
+	if (!data) {
+		zeros.resize((size_t)grid_size * grid_size * members.size() * 4);
+		data = &zeros[0];
+	}
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, format, grid_size, grid_size, (GLsizei)members.size(),
+		0, GL_RGBA, GL_FLOAT, data);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	return texture;
+}
+
+// One invocation per texel of |layers| members.
+void GpuEnsemble::dispatch(int layers) const {
+	glDispatchCompute((grid_size + 15) / 16, (grid_size + 15) / 16, (GLuint)layers);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void GpuEnsemble::step() {
+	if (members.empty()) {
+		return;
+	}
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, member_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, active_layer_buffer);
+
+	// Advect.
+	glUseProgram(advection_program);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, velocity_texture.front());
+	glUniform1i(glGetUniformLocation(advection_program, "velocity_sampler"), 1);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, colour_texture.front());
+	glUniform1i(glGetUniformLocation(advection_program, "colour_sampler"), 2);
+	glBindImageTexture(0, colour_texture.back(), 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+	glBindImageTexture(1, velocity_texture.back(), 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RG32F);
+	dispatch((int)members.size());
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	velocity_texture.flip();
+	colour_texture.flip();
+
+	// Divergence.
+	glUseProgram(divergence_program);
+	glUniform1f(glGetUniformLocation(divergence_program, "timestep"), kTimestep);
+	glBindImageTexture(0, velocity_texture.front(), 0, GL_TRUE, 0, GL_READ_ONLY, GL_RG32F);
+	glBindImageTexture(1, divergence_texture, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_R32F);
+	dispatch((int)members.size());
+
+	// Each iteration covers the members with iterations left, which lead
+	// |layer_iterations|. Finished members are left in whichever buffer
+	// their last iteration wrote.
+	glUseProgram(pressure_program);
+	GLint iteration_uniform = glGetUniformLocation(pressure_program, "iteration");
+	glBindImageTexture(1, divergence_texture, 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+	int max_iterations = layer_iterations[0];
+	int active_layers = (int)members.size();
+	for (int iteration = 0; iteration < max_iterations; ++iteration) {
+		while (layer_iterations[active_layers - 1] <= iteration) {
+			--active_layers;
+		}
+		glUniform1i(iteration_uniform, iteration);
+		glBindImageTexture(0, pressure_texture.front(), 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+		glBindImageTexture(2, pressure_texture.back(), 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_R32F);
+		dispatch(active_layers);
+		pressure_texture.flip();
+	}
+
+	// Normalize.
+	glUseProgram(normalization_program);
+	glUniform1f(glGetUniformLocation(normalization_program, "timestep"), kTimestep);
+	glUniform1i(glGetUniformLocation(normalization_program, "max_iterations"), max_iterations);
+	glBindImageTexture(0, velocity_texture.front(), 0, GL_TRUE, 0, GL_READ_ONLY, GL_RG32F);
+	glBindImageTexture(1, pressure_texture.front(), 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+	glBindImageTexture(2, velocity_texture.back(), 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RG32F);
+	glBindImageTexture(3, pressure_texture.back(), 0, GL_TRUE, 0, GL_READ_ONLY, GL_R32F);
+	dispatch((int)members.size());
+	velocity_texture.flip();
+
+	glUseProgram(0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, 0);
+}
+
+std::vector<GLfloat> GpuEnsemble::readColour() {
+	std::vector<GLfloat> colour((size_t)grid_size * grid_size * members.size() * 3);
+	if (!colour.empty()) {
+		glBindTexture(GL_TEXTURE_2D_ARRAY, colour_texture.front());
+		glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RGB, GL_FLOAT, &colour[0]);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	}
+	return colour;
+}
@@ -0,0 +1,59 @@
+#ifndef _GPU_ENSEMBLE_HPP_
+#define _GPU_ENSEMBLE_HPP_
+
+#include <vector>
+
+#include "Utility\flip_buffer.hpp"
+#include "Utility\gl.hpp"
+
+#include "solver_settings.hpp"
+
+// Independent simulations of the same size stepped together on the GPU. Each
+// field is a GL_TEXTURE_2D_ARRAY with a layer per member, and every pass of
+// the fragment pipeline is a single compute dispatch over all layers with the
+// members' parameters read from a storage buffer, so small simulations fill
+// the GPU rather than each waiting on its own passes. Pressure is Jacobi only.
+// Requires OpenGL 4.3 and a current context.
+class GpuEnsemble
+{
+public:
+	~GpuEnsemble();
+
+	// Returns false and prints the error if a shader fails to build.
+	bool create(int size, const std::vector<EnsembleMember> &members);
+	void destroy();
+
+	int size() const { return grid_size; }
+	int memberCount() const { return (int)members.size(); }
+
+	// Advances every member by one step, equivalent to update().
+	void step();
+
+	// The RGB colour of every member, member by member, rows bottom up.
+	std::vector<GLfloat> readColour();
+
+private:
+	GLuint createArray(GLenum format, const GLfloat *data) const;
+	void dispatch(int layers) const;
+
+	int grid_size = 0;
+	std::vector<EnsembleMember> members;
+
+	// The members' Jacobi iterations, descending, in the order of
+	// |active_layer_buffer|.
+	std::vector<int> layer_iterations;
+
+	FlipBuffer velocity_texture;
+	FlipBuffer colour_texture;
+	FlipBuffer pressure_texture;
+	GLuint divergence_texture = 0;
+	GLuint member_buffer = 0;
+	GLuint active_layer_buffer = 0;
+
+	GLuint advection_program = 0;
+	GLuint divergence_program = 0;
+	GLuint pressure_program = 0;
+	GLuint normalization_program = 0;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,92 @@
+/*
+* Copyright (c) 2017 Owen Glofcheski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#include "gpu_stage_timer.hpp"
+
+void GpuStageTimer::init(StageProfiler *profiler) {
+	this->profiler = profiler;
+	for (int set = 0; set < 2; ++set) {
+		queries[set].resize(profiler->stageCount());
+		issued[set].assign(profiler->stageCount(), false);
+		glGenQueries((GLsizei)queries[set].size(), &queries[set][0]);
+	}
+}
+
+void GpuStageTimer::destroy() {
+	for (int set = 0; set < 2; ++set) {
+		if (!queries[set].empty()) {
+			glDeleteQueries((GLsizei)queries[set].size(), &queries[set][0]);
+		}
+		queries[set].clear();
+		issued[set].clear();
+	}
+}
+
+void GpuStageTimer::beginFrame() {
+	current_set = !current_set;
+	collect(current_set, false);
+}
+
+void GpuStageTimer::begin(int stage) {
+	if (active_stage >= 0) {
+		return;
+	}
+	glBeginQuery(GL_TIME_ELAPSED, queries[current_set][stage]);
+	active_stage = stage;
+}
+
+void GpuStageTimer::end() {
+	if (active_stage < 0) {
+		return;
+	}
+	glEndQuery(GL_TIME_ELAPSED);
+	issued[current_set][active_stage] = true;
+	active_stage = -1;
+}
+
+void GpuStageTimer::finish() {
+	// The older set first so samples stay in order.
+	collect(!current_set, true);
+	collect(current_set, true);
+}
+
+void GpuStageTimer::collect(int set, bool wait) {
+	for (size_t stage = 0; stage < queries[set].size(); ++stage) {
+		if (!issued[set][stage]) {
+			continue;
+		}
+		issued[set][stage] = false;
+
+		if (!wait) {
+			GLint available = 0;
+			glGetQueryObjectiv(queries[set][stage], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) {
+				profiler->recordDropped((int)stage);
+				continue;
+			}
+		}
+		GLuint64 elapsed_ns = 0;
+		glGetQueryObjectui64v(queries[set][stage], GL_QUERY_RESULT, &elapsed_ns);
+		profiler->record((int)stage, elapsed_ns / 1e6);
+	}
+}
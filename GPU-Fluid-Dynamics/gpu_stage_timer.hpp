@@ -0,0 +1,39 @@
+#ifndef _GPU_STAGE_TIMER_HPP_
+#define _GPU_STAGE_TIMER_HPP_
+
+#include <vector>
+
+#include "Utility\gl.hpp"
+
+#include "stage_profiler.hpp"
+
+// GL_TIME_ELAPSED queries around each stage, recorded into a StageProfiler.
+// Queries are double buffered by frame: a frame's results are collected when
+// its set is reused two frames later, by which point they're normally
+// available, and are dropped and counted by the profiler rather than waited
+// on when they aren't. Stages can't nest.
+class GpuStageTimer
+{
+public:
+	// Creates a pair of queries for every stage |profiler| has so far.
+	void init(StageProfiler *profiler);
+	void destroy();
+
+	void beginFrame();
+	void begin(int stage);
+	void end();
+
+	// Waits for and records every outstanding query.
+	void finish();
+
+private:
+	void collect(int set, bool wait);
+
+	StageProfiler *profiler = nullptr;
+	std::vector<GLuint> queries[2];
+	std::vector<bool> issued[2];
+	int current_set = 0;
+	int active_stage = -1;
+};
+
+#endif
\ No newline at end of file
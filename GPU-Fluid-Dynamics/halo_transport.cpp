@@ -0,0 +1,66 @@
+/*
+* Copyright (c) 2017 Owen Glofcheski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#include "halo_transport.hpp"
+
+#include <algorithm>
+
+SharedMemoryHub::SharedMemoryHub(int rank_count, int tag_count)
+	: rank_count(rank_count), tag_count(tag_count) {
+	mailboxes.resize((size_t)rank_count * rank_count * tag_count);
+	for (std::unique_ptr<Mailbox> &mailbox : mailboxes) {
+		mailbox.reset(new Mailbox());
+	}
+}
+
+SharedMemoryHub::Mailbox &SharedMemoryHub::mailbox(int from, int to, int tag) {
+	return *mailboxes[((size_t)to * rank_count + from) * tag_count + tag];
+}
+
+void SharedMemoryHub::send(int from, int to, int tag, const float *data, int count) {
+	Mailbox &box = mailbox(from, to, tag);
+	{
+		std::lock_guard<std::mutex> lock(box.mutex);
+		if (box.spare.empty()) {
+			box.messages.emplace_back();
+		} else {
+			box.messages.push_back(std::move(box.spare.back()));
+			box.spare.pop_back();
+		}
+
+		// Copied under the lock, the messages are a few rows at most.
+		box.messages.back().assign(data, data + count);
+	}
+	box.arrived.notify_one();
+}
+
+void SharedMemoryHub::receive(int to, int from, int tag, float *data, int count) {
+	Mailbox &box = mailbox(from, to, tag);
+	std::unique_lock<std::mutex> lock(box.mutex);
+	box.arrived.wait(lock, [&] { return !box.messages.empty(); });
+
+	std::vector<float> &message = box.messages.front();
+	std::copy(message.begin(), message.begin() + std::min(count, (int)message.size()), data);
+	box.spare.push_back(std::move(message));
+	box.messages.pop_front();
+}
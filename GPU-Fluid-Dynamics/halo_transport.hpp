@@ -0,0 +1,82 @@
+#ifndef _HALO_TRANSPORT_HPP_
+#define _HALO_TRANSPORT_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Point to point messages between the ranks of a domain decomposition, see
+// DomainSolver. Sends are buffered and return immediately so a rank can
+// compute while its halos are in flight, and messages with the same source
+// and tag arrive in order. The calls map directly onto MPI_Isend of a copy
+// and MPI_Recv, so another transport only needs these three methods.
+class HaloTransport
+{
+public:
+	virtual ~HaloTransport() {}
+
+	virtual int rank() const = 0;
+
+	// Queues |count| floats for rank |to|, |data| can be reused on return.
+	virtual void send(int to, int tag, const float *data, int count) = 0;
+
+	// Blocks until the oldest message with |tag| from rank |from| has
+	// arrived and copies its |count| floats into |data|.
+	virtual void receive(int from, int tag, float *data, int count) = 0;
+};
+
+// Mailboxes in memory shared by ranks running as threads of one process,
+// one per source, destination and tag so ranks only contend with the
+// neighbour they're exchanging with. Message buffers are recycled, so after
+// the first exchange no allocation happens.
+class SharedMemoryHub
+{
+public:
+	SharedMemoryHub(int rank_count, int tag_count);
+
+	int rankCount() const { return rank_count; }
+
+	void send(int from, int to, int tag, const float *data, int count);
+	void receive(int to, int from, int tag, float *data, int count);
+
+private:
+	struct Mailbox
+	{
+		std::mutex mutex;
+		std::condition_variable arrived;
+		std::deque<std::vector<float>> messages;
+		std::vector<std::vector<float>> spare;
+	};
+
+	Mailbox &mailbox(int from, int to, int tag);
+
+	int rank_count;
+	int tag_count;
+	std::vector<std::unique_ptr<Mailbox>> mailboxes;
+};
+
+// One rank's end of a SharedMemoryHub.
+class SharedMemoryTransport : public HaloTransport
+{
+public:
+	SharedMemoryTransport(SharedMemoryHub &hub, int rank)
+		: hub(hub), rank_index(rank) {}
+
+	int rank() const override { return rank_index; }
+
+	void send(int to, int tag, const float *data, int count) override {
+		hub.send(rank_index, to, tag, data, count);
+	}
+
+	void receive(int from, int tag, float *data, int count) override {
+		hub.receive(rank_index, from, tag, data, count);
+	}
+
+private:
+	SharedMemoryHub &hub;
+	int rank_index;
+};
+
+#endif
\ No newline at end of file
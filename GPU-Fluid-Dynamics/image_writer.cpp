@@ -0,0 +1,222 @@
+/*
+* Copyright (c) 2017 Owen Glofcheski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#include "image_writer.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+const int kMaxStoredBlock = 0xffff;
+
+uint32_t crc32(uint32_t crc, const unsigned char *data, size_t size) {
+	static uint32_t table[256];
+	static bool table_ready = false;
+	if (!table_ready) {
+		for (uint32_t i = 0; i < 256; ++i) {
+			uint32_t value = i;
+			for (int bit = 0; bit < 8; ++bit) {
+				value = value & 1 ? 0xedb88320 ^ (value >> 1) : value >> 1;
+			}
+			table[i] = value;
+		}
+		table_ready = true;
+	}
+
+	crc = ~crc;
+	for (size_t i = 0; i < size; ++i) {
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+void appendBigEndian(std::vector<unsigned char> &out, uint32_t value) {
+	out.push_back((unsigned char)(value >> 24));
+	out.push_back((unsigned char)(value >> 16));
+	out.push_back((unsigned char)(value >> 8));
+	out.push_back((unsigned char)value);
+}
+
+void appendChunk(std::vector<unsigned char> &out, const char *type, const std::vector<unsigned char> &data) {
+	appendBigEndian(out, (uint32_t)data.size());
+	size_t type_offset = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data.begin(), data.end());
+	appendBigEndian(out, crc32(0, &out[type_offset], out.size() - type_offset));
+}
+
+template <typename T>
+void appendLittleEndian(std::vector<unsigned char> &out, T value) {
+	const unsigned char *bytes = (const unsigned char*)&value;
+	out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+void appendAttribute(std::vector<unsigned char> &out, const char *name, const char *type,
+	const std::vector<unsigned char> &value) {
+	out.insert(out.end(), name, name + strlen(name) + 1);
+	out.insert(out.end(), type, type + strlen(type) + 1);
+	appendLittleEndian(out, (int32_t)value.size());
+	out.insert(out.end(), value.begin(), value.end());
+}
+
+bool writeFile(const char *path, const std::vector<unsigned char> &data) {
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		return false;
+	}
+	bool written = fwrite(&data[0], 1, data.size(), file) == data.size();
+	if (fclose(file) != 0 || !written) {
+		fprintf(stderr, "Failed to write %s\n", path);
+		return false;
+	}
+	return true;
+}
+
+} // namespace
+
+bool writePng(const char *path, int width, int height, const unsigned char *rgb) {
+	static const unsigned char kSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+
+	std::vector<unsigned char> header;
+	appendBigEndian(header, (uint32_t)width);
+	appendBigEndian(header, (uint32_t)height);
+	header.push_back(8); // bit depth.
+	header.push_back(2); // RGB.
+	header.push_back(0); // deflate.
+	header.push_back(0); // adaptive filtering.
+	header.push_back(0); // not interlaced.
+
+	// Each row is prefixed with filter type 0, none.
+	size_t row_bytes = (size_t)width * 3;
+	std::vector<unsigned char> raw((row_bytes + 1) * height);
+	for (int y = 0; y < height; ++y) {
+		raw[y * (row_bytes + 1)] = 0;
+		memcpy(&raw[y * (row_bytes + 1) + 1], rgb + y * row_bytes, row_bytes);
+	}
+
+	// A zlib stream of stored deflate blocks.
+	std::vector<unsigned char> data;
+	data.reserve(raw.size() + raw.size() / kMaxStoredBlock * 5 + 16);
+	data.push_back(0x78);
+	data.push_back(0x01);
+	uint32_t adler_a = 1;
+	uint32_t adler_b = 0;
+	for (size_t offset = 0; offset < raw.size(); offset += kMaxStoredBlock) {
+		size_t size = std::min(raw.size() - offset, (size_t)kMaxStoredBlock);
+		data.push_back(offset + size == raw.size());
+		data.push_back((unsigned char)(size & 0xff));
+		data.push_back((unsigned char)(size >> 8));
+		data.push_back((unsigned char)(~size & 0xff));
+		data.push_back((unsigned char)((~size >> 8) & 0xff));
+		data.insert(data.end(), raw.begin() + offset, raw.begin() + offset + size);
+
+		for (size_t i = offset; i < offset + size; ++i) {
+			adler_a += raw[i];
+			adler_b += adler_a;
+			// Reduce well before the sums can overflow.
+			if ((i & 0xfff) == 0xfff) {
+				adler_a %= 65521;
+				adler_b %= 65521;
+			}
+		}
+		adler_a %= 65521;
+		adler_b %= 65521;
+	}
+	appendBigEndian(data, (adler_b << 16) | adler_a);
+
+	std::vector<unsigned char> file(kSignature, kSignature + sizeof(kSignature));
+	file.reserve(data.size() + 64);
+	appendChunk(file, "IHDR", header);
+	appendChunk(file, "IDAT", data);
+	appendChunk(file, "IEND", std::vector<unsigned char>());
+	return writeFile(path, file);
+}
+
+bool writeExr(const char *path, int width, int height, const float *rgb) {
+	const int32_t kFloatPixels = 2;
+
+	std::vector<unsigned char> file;
+	appendLittleEndian(file, (int32_t)20000630); // magic.
+	appendLittleEndian(file, (int32_t)2); // version, single part scanline.
+
+	// Channels are stored in alphabetical order.
+	std::vector<unsigned char> channels;
+	for (const char *name : { "B", "G", "R" }) {
+		channels.insert(channels.end(), name, name + 2);
+		appendLittleEndian(channels, kFloatPixels);
+		appendLittleEndian(channels, (int32_t)0); // linear flag and reserved.
+		appendLittleEndian(channels, (int32_t)1); // x sampling.
+		appendLittleEndian(channels, (int32_t)1); // y sampling.
+	}
+	channels.push_back(0);
+
+	std::vector<unsigned char> window;
+	appendLittleEndian(window, (int32_t)0);
+	appendLittleEndian(window, (int32_t)0);
+	appendLittleEndian(window, (int32_t)(width - 1));
+	appendLittleEndian(window, (int32_t)(height - 1));
+
+	std::vector<unsigned char> one;
+	appendLittleEndian(one, 1.0f);
+	std::vector<unsigned char> centre;
+	appendLittleEndian(centre, 0.0f);
+	appendLittleEndian(centre, 0.0f);
+
+	appendAttribute(file, "channels", "chlist", channels);
+	appendAttribute(file, "compression", "compression", std::vector<unsigned char>(1, 0));
+	appendAttribute(file, "dataWindow", "box2i", window);
+	appendAttribute(file, "displayWindow", "box2i", window);
+	appendAttribute(file, "lineOrder", "lineOrder", std::vector<unsigned char>(1, 0));
+	appendAttribute(file, "pixelAspectRatio", "float", one);
+	appendAttribute(file, "screenWindowCenter", "v2f", centre);
+	appendAttribute(file, "screenWindowWidth", "float", one);
+	file.push_back(0);
+
+	// Uncompressed files have one scanline per chunk.
+	int32_t line_bytes = width * 3 * (int32_t)sizeof(float);
+	uint64_t offset = file.size() + (uint64_t)height * sizeof(uint64_t);
+	for (int y = 0; y < height; ++y) {
+		appendLittleEndian(file, offset + (uint64_t)y * (line_bytes + 8));
+	}
+
+	file.reserve(file.size() + (size_t)height * (line_bytes + 8));
+	std::vector<float> line(width * 3);
+	for (int y = 0; y < height; ++y) {
+		const float *src = rgb + (size_t)y * width * 3;
+		for (int x = 0; x < width; ++x) {
+			line[x] = src[x * 3 + 2];
+			line[width + x] = src[x * 3 + 1];
+			line[2 * width + x] = src[x * 3];
+		}
+		appendLittleEndian(file, (int32_t)y);
+		appendLittleEndian(file, line_bytes);
+		const unsigned char *bytes = (const unsigned char*)&line[0];
+		file.insert(file.end(), bytes, bytes + line_bytes);
+	}
+	return writeFile(path, file);
+}
@@ -0,0 +1,15 @@
+#ifndef _IMAGE_WRITER_HPP_
+#define _IMAGE_WRITER_HPP_
+
+// Image files for captured frames, without any library dependency. Pixels are
+// tightly packed RGB rows from the top row down. Both return false and print
+// the error on failure.
+
+// An 8 bit PNG. The deflate stream only uses stored blocks, so files are the
+// size of the raw pixels but take no longer to write than a copy.
+bool writePng(const char *path, int width, int height, const unsigned char *rgb);
+
+// An uncompressed scanline OpenEXR image with 32 bit float channels.
+bool writeExr(const char *path, int width, int height, const float *rgb);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,14 @@
+// The initial dye, diagonal, vertical and horizontal stripes 50 texels wide.
+void main()
+{
+	vec2 texel = floor(gl_FragCoord.xy);
+
+	vec4 colour = vec4(
+		mod(texel.x + texel.y, 100.0) < 50.0 ? 1.0 : 0.0,
+		mod(texel.x, 100.0) < 50.0 ? 1.0 : 0.0,
+		mod(texel.y, 100.0) < 50.0 ? 1.0 : 0.0,
+		1.0);
+
+	gl_FragData[0] = colour;
+	gl_FragData[1] = colour;
+}
\ No newline at end of file
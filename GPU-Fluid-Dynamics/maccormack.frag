@@ -0,0 +1,67 @@
+uniform sampler2D field_sampler;
+uniform sampler2D advected_sampler;
+uniform sampler2D velocity_sampler;
+
+uniform vec2 grid_size;
+uniform vec2 velocity_grid_size;
+uniform bool bicubic_velocity;
+
+uniform vec2 mouse_position;
+uniform float impulse_radius;
+
+uniform float timestep;
+
+// As advection.frag, so the correction follows the forward lookup.
+vec2 bicubicVelocity(vec2 uv)
+{
+	vec2 coord = uv * velocity_grid_size - 0.5;
+	vec2 f = fract(coord);
+	coord -= f;
+
+	vec2 w0 = (1.0 - f) * (1.0 - f) * (1.0 - f) / 6.0;
+	vec2 w1 = (4.0 - 6.0 * f * f + 3.0 * f * f * f) / 6.0;
+	vec2 w3 = f * f * f / 6.0;
+	vec2 w2 = 1.0 - w0 - w1 - w3;
+
+	vec2 g0 = w0 + w1;
+	vec2 g1 = w2 + w3;
+	vec2 h0 = (coord - 0.5 + w1 / g0) / velocity_grid_size;
+	vec2 h1 = (coord + 1.5 + w3 / g1) / velocity_grid_size;
+
+	return g0.y * (g0.x * texture2D(velocity_sampler, h0).xy
+			+ g1.x * texture2D(velocity_sampler, vec2(h1.x, h0.y)).xy)
+		+ g1.y * (g0.x * texture2D(velocity_sampler, vec2(h0.x, h1.y)).xy
+			+ g1.x * texture2D(velocity_sampler, h1).xy);
+}
+
+// MacCormack correction of a field advected by advection.frag. Advecting the
+// result back along the same velocity would return the original field if
+// advection were exact, so half of the round trip's error is added back. The
+// result is clamped to the texels the forward lookup interpolated, which
+// keeps the scheme from overshooting where the field isn't smooth.
+void main()
+{
+	vec2 uv = gl_FragCoord.xy / grid_size;
+	vec4 advected = texture2D(advected_sampler, uv);
+
+	// The forward pass added the mouse force and ink here.
+	if (distance(gl_FragCoord.xy, mouse_position) < impulse_radius) {
+		gl_FragColor = advected;
+		return;
+	}
+
+	vec2 velocity = bicubic_velocity
+		? bicubicVelocity(uv) : texture2D(velocity_sampler, uv).xy;
+	velocity *= grid_size / velocity_grid_size;
+	vec4 round_trip = texture2D(advected_sampler, (gl_FragCoord.xy + velocity * timestep) / grid_size);
+	vec4 corrected = advected + 0.5 * (texture2D(field_sampler, uv) - round_trip);
+
+	// The four texel centres around the forward lookup.
+	vec2 texel = floor(gl_FragCoord.xy - velocity * timestep - 0.5) + 0.5;
+	vec4 t00 = texture2D(field_sampler, texel / grid_size);
+	vec4 t10 = texture2D(field_sampler, (texel + vec2(1.0, 0.0)) / grid_size);
+	vec4 t01 = texture2D(field_sampler, (texel + vec2(0.0, 1.0)) / grid_size);
+	vec4 t11 = texture2D(field_sampler, (texel + vec2(1.0, 1.0)) / grid_size);
+
+	gl_FragColor = clamp(corrected, min(min(t00, t10), min(t01, t11)), max(max(t00, t10), max(t01, t11)));
+}
\ No newline at end of file
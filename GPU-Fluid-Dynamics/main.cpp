@@ -22,9 +22,16 @@
 */
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <ctime>
+#include <functional>
 #include <GL\glew.h>
 #include <GL\freeglut.h>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include "Utility\algebra.hpp"
@@ -33,12 +40,30 @@
 #include "Utility\gl.hpp"
 #include "Utility\quaternion.hpp"
 
+#include "async_readback.hpp"
+#include "benchmark.hpp"
+#include "compute_shader.hpp"
+#include "cpu_ensemble.hpp"
+#include "emitters.hpp"
+#include "frame_capture.hpp"
+#include "frame_stream.hpp"
+#include "gpu_ensemble.hpp"
+#include "gpu_stage_timer.hpp"
+#include "offscreen_context.hpp"
+#include "program_batch.hpp"
+#include "run_config.hpp"
+#include "snapshot.hpp"
+#include "solver_settings.hpp"
+#include "stage_profiler.hpp"
+
 struct AdvectionShader : public Shader
 {
 	Uniform velocity_uniform = -1;
 	Uniform colour_uniform = -1;
 
 	Uniform grid_size_uniform = -1;
+	Uniform velocity_grid_size_uniform = -1;
+	Uniform bicubic_velocity_uniform = -1;
 
 	Uniform mouse_position_uniform = -1;
 	Uniform mouse_impulse_uniform = -1;
@@ -47,18 +72,28 @@ struct AdvectionShader : public Shader
 	Uniform timestep_uniform = -1;
 };
 
+struct FusedAdvectionShader : public AdvectionShader
+{
+	Uniform divergence_timestep_uniform = -1;
+};
+
 struct RenderShader : public Shader
 {
 	Uniform velocity_uniform = -1;
 	Uniform colour_uniform = -1;
 
 	Uniform grid_size_uniform = -1;
+	Uniform velocity_grid_size_uniform = -1;
+	Uniform quality_uniform = -1;
 };
 
 struct VectorFieldShader : public Shader
 {
 	Uniform vector_field_uniform = -1;
 	Uniform colour_uniform = -1;
+
+	Uniform scalar_field_uniform = -1;
+	Uniform triangle_grid_uniform = -1;
 };
 
 struct DivergenceShader : public Shader
@@ -76,6 +111,105 @@ struct PressureShader : public Shader
 	Uniform divergence_uniform = -1;
 
 	Uniform grid_size_uniform = -1;
+
+	Uniform relaxation_uniform = -1;
+};
+
+struct ResidualShader : public Shader
+{
+	Uniform pressure_uniform = -1;
+	Uniform divergence_uniform = -1;
+
+	Uniform grid_size_uniform = -1;
+};
+
+struct ScaleShader : public Shader
+{
+	Uniform field_uniform = -1;
+
+	Uniform grid_size_uniform = -1;
+
+	Uniform scale_uniform = -1;
+};
+
+// The compute shaders below can also run over the sparse tile list, see
+// tiles.comp.
+struct AdvectionComputeShader : public AdvectionShader
+{
+	Uniform sparse_tiles_uniform = -1;
+	Uniform tile_columns_uniform = -1;
+	Uniform tile_colour_scale_uniform = -1;
+};
+
+struct DivergenceComputeShader : public DivergenceShader
+{
+	Uniform sparse_tiles_uniform = -1;
+	Uniform tile_columns_uniform = -1;
+	Uniform threshold_uniform = -1;
+};
+
+struct PressureComputeShader : public Shader
+{
+	Uniform iterations_uniform = -1;
+
+	Uniform sparse_tiles_uniform = -1;
+	Uniform tile_columns_uniform = -1;
+};
+
+struct TileListShader : public Shader
+{
+	Uniform tile_grid_uniform = -1;
+	Uniform margin_uniform = -1;
+	Uniform impulse_min_uniform = -1;
+	Uniform impulse_extent_uniform = -1;
+	Uniform emitter_count_uniform = -1;
+	Uniform emitter_scale_uniform = -1;
+};
+
+struct TileSettleShader : public Shader
+{
+	Uniform tile_columns_uniform = -1;
+	Uniform tile_colour_scale_uniform = -1;
+};
+
+struct RestrictionShader : public Shader
+{
+	Uniform pressure_uniform = -1;
+	Uniform divergence_uniform = -1;
+
+	Uniform grid_size_uniform = -1;
+};
+
+struct ProlongationShader : public Shader
+{
+	Uniform pressure_uniform = -1;
+	Uniform correction_uniform = -1;
+
+	Uniform grid_size_uniform = -1;
+	Uniform coarse_grid_size_uniform = -1;
+};
+
+struct MacCormackShader : public Shader
+{
+	Uniform field_uniform = -1;
+	Uniform advected_uniform = -1;
+	Uniform velocity_uniform = -1;
+
+	Uniform grid_size_uniform = -1;
+	Uniform velocity_grid_size_uniform = -1;
+	Uniform bicubic_velocity_uniform = -1;
+
+	Uniform mouse_position_uniform = -1;
+	Uniform impulse_radius_uniform = -1;
+
+	Uniform timestep_uniform = -1;
+};
+
+struct SplatShader : public Shader
+{
+	Uniform grid_size_uniform = -1;
+	Uniform grid_scale_uniform = -1;
+	Uniform dye_pass_uniform = -1;
 };
 
 struct VelocityNormalizationShader : public Shader
@@ -88,129 +222,461 @@ struct VelocityNormalizationShader : public Shader
 	Uniform timestep_uniform = -1;
 };
 
+struct VelocityNormalizationComputeShader : public VelocityNormalizationShader
+{
+	Uniform sparse_tiles_uniform = -1;
+	Uniform tile_columns_uniform = -1;
+	Uniform threshold_uniform = -1;
+};
+
+// A coarse level of the multigrid pressure hierarchy.
+struct MultigridLevel
+{
+	Size size;
+
+	GLuint rhs_texture;
+	FlipBuffer pressure_texture;
+};
+
+// Profiler indices of each stage.
+struct ProfileStages
+{
+	int splat; // emitters, see applyEmitters().
+	int tiles; // sparse tile list, see tiles.comp.
+	int advect;
+	int divergence;
+	int pressure;
+	int normalize;
+	int render;
+	int indicators;
+	int frame; // CPU time between ticks.
+};
+
+// Motion blur of the final render, matching render.frag.
+enum class RenderQuality
+{
+	Full, // 100 taps.
+	Adaptive, // taps scaled by the local blur length.
+	Mip, // up to 16 taps from a downsampled colour mip.
+};
+
+const char *renderQualityName(RenderQuality quality) {
+	switch (quality) {
+		case RenderQuality::Full: return "full";
+		case RenderQuality::Adaptive: return "adaptive";
+		case RenderQuality::Mip: return "mip";
+	}
+	return "";
+}
+
+const char *advectionSchemeName(AdvectionScheme scheme) {
+	switch (scheme) {
+		case AdvectionScheme::SemiLagrangian: return "semi-lagrangian";
+		case AdvectionScheme::MacCormack: return "maccormack";
+	}
+	return "";
+}
+
+enum class Backend
+{
+	Fragment,
+	Compute, // GL 4.3 compute shaders with image load/store.
+};
+
+// Emitters drawn per instanced draw, the size of the uniform array in
+// splat.vert.
+const int kMaxEmittersPerBatch = 256;
+
+// An Emitter as laid out in splat.vert and tiles.comp.
+struct GpuEmitter
+{
+	GLfloat position_radius[4];
+	GLfloat force_dye[4];
+	GLfloat colour[4];
+};
+
+// Where init() spent its time.
+struct StartupStats
+{
+	ProgramBatchStats programs;
+	double field_seconds = 0;
+	double seconds = 0;
+};
+
 struct State
 {
 	int window = 0;
 
+	// The window and colour field use the canvas size while velocity,
+	// divergence and pressure are simulated on a grid |simulation_divisor|
+	// times coarser, upsampled when advecting and rendering the colour.
 	Size canvas_size;
+	Size simulation_size;
+	int simulation_divisor = 1;
+	bool bicubic_velocity = false; // otherwise bilinear.
+	float advection_timestep = 4; // while pressure and divergence use 1/60.
 
 	AdvectionShader advection_shader;
+	FusedAdvectionShader fused_advection_shader;
 	RenderShader render_shader;
 	VectorFieldShader vector_field_shader;
 	DivergenceShader divergence_shader;
 	PressureShader pressure_shader;
 	VelocityNormalizationShader velocity_normalization_shader;
+	ResidualShader residual_shader;
+	ScaleShader scale_shader;
+	RestrictionShader restriction_shader;
+	ProlongationShader prolongation_shader;
+	SplatShader splat_shader;
+	MacCormackShader maccormack_shader;
+	Shader init_fields_shader;
+
+	// Program binaries are cached here between runs with --shader-cache,
+	// empty disables.
+	std::string shader_cache;
+	StartupStats startup;
+
+	// Compute backend, grid size uniforms are unused.
+	AdvectionComputeShader advection_compute_shader;
+	DivergenceComputeShader divergence_compute_shader;
+	PressureComputeShader pressure_compute_shader;
+	VelocityNormalizationComputeShader velocity_normalization_compute_shader;
+	TileListShader tile_list_shader;
+	TileSettleShader tile_settle_shader;
+
+	Backend backend = Backend::Fragment;
+	bool compute_supported = false;
+	int compute_jacobi_iterations = 4; // per dispatch.
+
+	// Sized formats which can also be bound as images by the compute backend,
+	// see applyPrecision().
+	GLenum velocity_format = GL_RG32F; // or GL_RG16F.
+	GLenum colour_format = GL_RGBA32F; // or GL_RGBA16F, GL_RGBA8, GL_RGB10_A2.
+
+	// Divergence and pressure only have an x component. The multigrid levels
+	// use the pressure format.
+	GLenum divergence_format = GL_R32F; // or GL_R16F.
+	GLenum pressure_format = GL_R32F; // or GL_R16F.
+
+	// Produce the divergence as an extra output of the advection pass.
+	bool fused_advection = false;
+
+	// MacCormack advects into the advected textures, created on first use,
+	// and corrects them into the back buffers with maccormack.frag. It can't
+	// be fused and runs the compute backend densely.
+	AdvectionScheme advection_scheme = AdvectionScheme::SemiLagrangian;
+	GLuint advected_velocity_texture = 0;
+	GLuint advected_colour_texture = 0;
+
+	// Sparse simulation over tiles of kSparseTileSize simulation texels, only
+	// used by the compute backend. The tile list and indirect dispatches are
+	// built on the GPU each step by tiles.comp.
+	SparseTileSettings sparse_tiles;
+	bool sparse_last_step = false;
+	Size tile_grid;
+	GLuint tile_command_buffer;
+	GLuint tile_moving_buffer;
+	GLuint tile_active_buffer;
+	GLuint active_tile_buffer;
+	GLuint settle_tile_buffer;
 
 	FlipBuffer velocity_texture;
 	FlipBuffer colour_texture;
 	GLuint divergence_texture;
 	FlipBuffer pressure_texture;
 
+	std::vector<MultigridLevel> multigrid_levels;
+
+	GLuint residual_texture;
+	int residual_levels;
+
 	GLuint advection_buffer;
 	GLuint divergence_buffer;
 	GLuint pressure_buffer;
+	GLuint residual_buffer;
 	GLuint velocity_normalization_buffer;
 
+	RenderQuality render_quality = RenderQuality::Full;
+	GLuint colour_mip_sampler;
+	int colour_mip_levels = 3; // including the base level.
+
 	bool render_velocity_indicators = false;
 	bool render_pressure_indicators = false;
 	int indicator_render_inverval = 10; // pixels.
+	GLuint indicator_vertex_array; // has no attributes.
 
 	float mouse_impulse_radius = 40; // pixels.
 
+	PressureSettings pressure_settings;
+	PressureSolveStats pressure_stats;
+
+	// The residual requires a readback so it's only measured when there's a
+	// tolerance or it's being reported.
+	bool report_pressure_convergence = false;
+
+	StageProfiler profiler;
+	ProfileStages stages;
+	GpuStageTimer gpu_timer;
+	bool render_profiler_overlay = false;
+
+	// Averaged frame interval and GPU time of the pressure solve, printed
+	// every |frame_time_report_interval| frames.
+	bool report_frame_time = false;
+	int frame_time_report_interval = 60;
+	double frame_time_ms = 0;
+	int frame_time_samples = 0;
+	std::chrono::steady_clock::time_point last_frame_time;
+
 	Point2 last_mouse_pos;
 	Vector2 mouse_frame_impulse;
+
+	// Force and dye sources applied by the next step, on top of the mouse.
+	// The script adds its emitters for each step, anything else driving the
+	// simulation can add more.
+	std::vector<Emitter> emitters;
+	EmitterScript emitter_script;
+	GLuint emitter_buffer; // GpuEmitter, in batches of kMaxEmittersPerBatch.
+	size_t emitter_buffer_capacity = 0;
+	int emitter_count = 0; // in the buffer this step.
+	GLuint splat_buffer;
+
+	// Steps simulated since init(), restored with a snapshot.
+	uint64_t step = 0;
+
+	// A snapshot being read back, written to |snapshot_path| on
+	// |snapshot_writer| once every field has arrived, see requestSnapshot().
+	AsyncReadback snapshot_readback;
+	std::vector<SnapshotField> snapshot_fields;
+	int snapshot_fields_pending = 0;
+	std::string snapshot_path = "snapshot.gfds";
+	uint64_t snapshot_step = 0;
+	std::thread snapshot_writer;
+
+	// The colour field recorded at 8 bits every |stream_interval| steps.
+	FrameStreamWriter frame_stream;
+	AsyncReadback stream_readback;
+	std::string stream_path = "replay.gfdr";
+	int stream_interval = 1;
+	int stream_keyframe_interval = 60;
+
+	// Frames recorded to an image sequence or an encoder, see FrameCapture.
+	CaptureSettings capture_settings;
+	FrameCapture frame_capture;
+
+	// Plays a recorded stream back in place of the simulation.
+	FrameStreamReader replay_stream;
+	bool replaying = false;
+	int replay_frame = 0;
+	std::vector<unsigned char> replay_pixels;
 };
 
 State state;
 
-void renderIndicators(GLuint vector_field, Colour colour) {
+void renderIndicators(GLuint vector_field, Colour colour, bool scalar_field) {
 	glUseProgram(state.vector_field_shader.program);
 
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, vector_field);
 	glUniform1i(state.vector_field_shader.vector_field_uniform, 1);
 	glUniform4f(state.vector_field_shader.colour_uniform, colour.r, colour.g, colour.b, 1);
+	glUniform1i(state.vector_field_shader.scalar_field_uniform, scalar_field);
 
 	Size triangle_grid = state.canvas_size / state.indicator_render_inverval;
+	glUniform2i(state.vector_field_shader.triangle_grid_uniform,
+		triangle_grid.width, triangle_grid.height);
 
-	float *triangle_data = new float[triangle_grid.area() * 6];
-	for (int r = 0; r < triangle_grid.height; ++r) {
-		for (int c = 0; c < triangle_grid.width; ++c) {
-			int triangle_index = (c + r * triangle_grid.width) * 6;
-
-			triangle_data[triangle_index + 0]
-				= triangle_data[triangle_index + 2]
-				= triangle_data[triangle_index + 4]
-				= 2.0f * c / (triangle_grid.width - 1) - 1.0f;
-			triangle_data[triangle_index + 1]
-				= triangle_data[triangle_index + 3]
-				= triangle_data[triangle_index + 5]
-				= 2.0f * r / (triangle_grid.height - 1) - 1.0f;
-		}
-	}
+	// The shader places each triangle from gl_VertexID.
+	glBindVertexArray(state.indicator_vertex_array);
+	glDrawArrays(GL_TRIANGLES, 0, triangle_grid.area() * 3);
+	glBindVertexArray(0);
 
-	GLuint vertex_buffer;
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glUseProgram(0);
+}
 
-	glGenBuffers(1, &vertex_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(float) * triangle_grid.area() * 6, triangle_data, GL_STATIC_DRAW);
+// Advects whichever of the colour, velocity and fused divergence targets are
+// non-zero on a grid of |grid_size|.
+void advectPass(AdvectionShader &shader, GLuint colour_target, GLuint velocity_target,
+	GLuint divergence_target, Size grid_size) {
+	glViewport(0, 0, grid_size.width, grid_size.height);
 
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	glBindFramebuffer(GL_FRAMEBUFFER, state.advection_buffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+		GL_TEXTURE_2D, colour_target, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
+		GL_TEXTURE_2D, velocity_target, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2,
+		GL_TEXTURE_2D, divergence_target, 0);
+	GLenum buffers[] = { GL_NONE, GL_NONE, GL_COLOR_ATTACHMENT2 };
+	if (colour_target) {
+		buffers[0] = GL_COLOR_ATTACHMENT0;
+	}
+	if (velocity_target) {
+		buffers[1] = GL_COLOR_ATTACHMENT1;
+	}
+	glDrawBuffers(divergence_target ? 3 : 2, (GLenum*)buffers);
 
-	glDrawArrays(GL_TRIANGLES, 0, triangle_grid.area() * 4);
+	glUseProgram(shader.program);
 
-	delete[] triangle_data;
+	// The mouse is tracked in canvas pixels, velocities are in simulation
+	// texels.
+	float grid_scale = (float)grid_size.width / state.canvas_size.width;
+	float velocity_scale = (float)state.simulation_size.width / state.canvas_size.width;
 
-	glDeleteBuffers(1, &vertex_buffer);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, state.velocity_texture.front());
+	glUniform1i(shader.velocity_uniform, 1);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, state.colour_texture.front());
+	glUniform1i(shader.colour_uniform, 2);
+	glUniform2f(shader.grid_size_uniform, grid_size.x, grid_size.y);
+	glUniform2f(shader.velocity_grid_size_uniform,
+		state.simulation_size.x, state.simulation_size.y);
+	glUniform1i(shader.bicubic_velocity_uniform,
+		state.bicubic_velocity && grid_size.width != state.simulation_size.width);
+	glUniform2f(shader.mouse_position_uniform,
+		state.last_mouse_pos.x * grid_scale, state.last_mouse_pos.y * grid_scale);
+	glUniform2f(shader.mouse_impulse_uniform,
+		state.mouse_frame_impulse.x * velocity_scale, state.mouse_frame_impulse.y * velocity_scale);
+	glUniform1f(shader.impulse_radius_uniform, state.mouse_impulse_radius * grid_scale);
+	glUniform1f(shader.timestep_uniform, state.advection_timestep);
+	if (divergence_target) {
+		glUniform1f(state.fused_advection_shader.divergence_timestep_uniform, 1 / 60.0);
+	}
 
-	glDisableVertexAttribArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glDrawRect(-1, 1, -1, 1, 0);
+	
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glUseProgram(0);
 }
 
-void advect() {
+bool maccormackAdvection() {
+	return state.advection_scheme == AdvectionScheme::MacCormack;
+}
+
+bool fusedAdvection() {
+	return state.fused_advection && !maccormackAdvection();
+}
+
+GLuint createAdvectedTexture(GLenum format, Size size) {
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, size.width, size.height, 0, GL_RGBA, GL_FLOAT, nullptr);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return texture;
+}
+
+// The targets of the forward advection, the back buffers unless MacCormack
+// corrects them afterwards.
+GLuint colourAdvectionTarget() {
+	if (!maccormackAdvection()) {
+		return state.colour_texture.back();
+	}
+	if (!state.advected_colour_texture) {
+		state.advected_colour_texture = createAdvectedTexture(state.colour_format, state.canvas_size);
+	}
+	return state.advected_colour_texture;
+}
+
+GLuint velocityAdvectionTarget() {
+	if (!maccormackAdvection()) {
+		return state.velocity_texture.back();
+	}
+	if (!state.advected_velocity_texture) {
+		state.advected_velocity_texture = createAdvectedTexture(state.velocity_format, state.simulation_size);
+	}
+	return state.advected_velocity_texture;
+}
+
+void maccormackPass(GLuint field, GLuint advected, GLuint target, Size grid_size) {
+	glViewport(0, 0, grid_size.width, grid_size.height);
+
 	glBindFramebuffer(GL_FRAMEBUFFER, state.advection_buffer);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-		GL_TEXTURE_2D, state.colour_texture.back(), 0);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
-		GL_TEXTURE_2D, state.velocity_texture.back(), 0);
-	GLenum buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-	glDrawBuffers(2, (GLenum*)buffers);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, 0, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, 0, 0);
+	GLenum buffers[] = { GL_COLOR_ATTACHMENT0 };
+	glDrawBuffers(1, buffers);
 
-	glUseProgram(state.advection_shader.program);
+	MacCormackShader &shader = state.maccormack_shader;
+	glUseProgram(shader.program);
+
+	float grid_scale = (float)grid_size.width / state.canvas_size.width;
 
 	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, state.velocity_texture.front());
-	glUniform1i(state.advection_shader.velocity_uniform, 1);
+	glBindTexture(GL_TEXTURE_2D, field);
+	glUniform1i(shader.field_uniform, 1);
 	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, state.colour_texture.front());
-	glUniform1i(state.advection_shader.colour_uniform, 2);
-	glUniform2f(state.advection_shader.grid_size_uniform,
-		state.canvas_size.x, state.canvas_size.y);
-	glUniform2f(state.advection_shader.mouse_position_uniform,
-		state.last_mouse_pos.x, state.last_mouse_pos.y);
-	glUniform2f(state.advection_shader.mouse_impulse_uniform,
-		state.mouse_frame_impulse.x, state.mouse_frame_impulse.y);
-	glUniform1f(state.advection_shader.impulse_radius_uniform, state.mouse_impulse_radius);
-	glUniform1f(state.advection_shader.timestep_uniform, 4);
+	glBindTexture(GL_TEXTURE_2D, advected);
+	glUniform1i(shader.advected_uniform, 2);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, state.velocity_texture.front());
+	glUniform1i(shader.velocity_uniform, 3);
+	glUniform2f(shader.grid_size_uniform, grid_size.x, grid_size.y);
+	glUniform2f(shader.velocity_grid_size_uniform, state.simulation_size.x, state.simulation_size.y);
+	// Both backends only filter the velocity bicubically for the colour.
+	glUniform1i(shader.bicubic_velocity_uniform,
+		state.bicubic_velocity && grid_size.width != state.simulation_size.width);
+	glUniform2f(shader.mouse_position_uniform,
+		state.last_mouse_pos.x * grid_scale, state.last_mouse_pos.y * grid_scale);
+	glUniform1f(shader.impulse_radius_uniform, state.mouse_impulse_radius * grid_scale);
+	glUniform1f(shader.timestep_uniform, state.advection_timestep);
 
 	glDrawRect(-1, 1, -1, 1, 0);
-	
+
 	glActiveTexture(GL_TEXTURE1);
 	glBindTexture(GL_TEXTURE_2D, 0);
 	glActiveTexture(GL_TEXTURE2);
 	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, 0);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	glUseProgram(0);
+}
+
+// Corrects the forward advection of both fields into the back buffers, for
+// either backend.
+void correctAdvection() {
+	maccormackPass(state.colour_texture.front(), state.advected_colour_texture,
+		state.colour_texture.back(), state.canvas_size);
+	maccormackPass(state.velocity_texture.front(), state.advected_velocity_texture,
+		state.velocity_texture.back(), state.simulation_size);
+}
+
+void advect() {
+	bool fused = fusedAdvection();
+	AdvectionShader &shader = fused ? state.fused_advection_shader : state.advection_shader;
+	GLuint divergence_target = fused ? state.divergence_texture : 0;
+	GLuint colour_target = colourAdvectionTarget();
+	GLuint velocity_target = velocityAdvectionTarget();
+
+	if (state.simulation_divisor == 1) {
+		advectPass(shader, colour_target, velocity_target, divergence_target, state.canvas_size);
+	} else {
+		advectPass(state.advection_shader, colour_target, 0, 0, state.canvas_size);
+		advectPass(shader, 0, velocity_target, divergence_target, state.simulation_size);
+	}
+	if (maccormackAdvection()) {
+		correctAdvection();
+	}
 
 	state.velocity_texture.flip();
 	state.colour_texture.flip();
 }
 
 void calculateDivergence() {
+	glViewport(0, 0, state.simulation_size.width, state.simulation_size.height);
+
 	glBindFramebuffer(GL_FRAMEBUFFER, state.divergence_buffer);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
 		GL_TEXTURE_2D, state.divergence_texture, 0);
@@ -223,7 +689,7 @@ void calculateDivergence() {
 	glBindTexture(GL_TEXTURE_2D, state.velocity_texture.front());
 	glUniform1i(state.divergence_shader.velocity_uniform, 1);
 	glUniform2f(state.divergence_shader.grid_size_uniform,
-		state.canvas_size.x, state.canvas_size.y);
+		state.simulation_size.x, state.simulation_size.y);
 	glUniform1f(state.divergence_shader.timestep_uniform, 1 / 60.0);
 
 	glDrawRect(-1, 1, -1, 1, 0);
@@ -234,133 +700,1002 @@ void calculateDivergence() {
 	glUseProgram(0);
 }
 
-void calculatePressure() {
-	int jacobi_iterations = 200;
+void relaxPressure(GLuint rhs_texture, FlipBuffer &pressure_texture, Size size,
+	int iterations, float relaxation) {
+	glViewport(0, 0, size.width, size.height);
 
-	// Re-zero the pressure texture.
-	GLfloat *pressure_data = new GLfloat[state.canvas_size.area() * 3]();
-	glBindTexture(GL_TEXTURE_2D, state.pressure_texture.front());
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F,
-		state.canvas_size.width, state.canvas_size.height, 0, GL_RGB, GL_FLOAT, pressure_data);
-	delete[] pressure_data;
-	
 	glUseProgram(state.pressure_shader.program);
 	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, state.divergence_texture);
+	glBindTexture(GL_TEXTURE_2D, rhs_texture);
 	glUniform1i(state.pressure_shader.divergence_uniform, 1);
-	glUniform2f(state.pressure_shader.grid_size_uniform,
-		state.canvas_size.x, state.canvas_size.y);
+	glUniform2f(state.pressure_shader.grid_size_uniform, size.x, size.y);
+	glUniform1f(state.pressure_shader.relaxation_uniform, relaxation);
 
-	for (int i = 0; i < jacobi_iterations; ++i) {
+	for (int i = 0; i < iterations; ++i) {
 		glBindFramebuffer(GL_FRAMEBUFFER, state.pressure_buffer);
 		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-			GL_TEXTURE_2D, state.pressure_texture.back(), 0);
+			GL_TEXTURE_2D, pressure_texture.back(), 0);
 		GLenum buffers[] = { GL_COLOR_ATTACHMENT0 };
 		glDrawBuffers(1, (GLenum*)buffers);
 
 		glActiveTexture(GL_TEXTURE2);
-		glBindTexture(GL_TEXTURE_2D, state.pressure_texture.front());
+		glBindTexture(GL_TEXTURE_2D, pressure_texture.front());
 		glUniform1i(state.pressure_shader.pressure_uniform, 2);
 
 		glDrawRect(-1, 1, -1, 1, 0);
 
 		// Flip the input and output textures.
-		state.pressure_texture.flip();
+		pressure_texture.flip();
 	}
-
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glUseProgram(0);
 }
 
-void normalizeVelocity() {
-	glBindFramebuffer(GL_FRAMEBUFFER, state.velocity_normalization_buffer);
+void vCycle(int level) {
+	const PressureSettings &settings = state.pressure_settings;
+
+	GLuint rhs_texture = level == 0
+		? state.divergence_texture : state.multigrid_levels[level - 1].rhs_texture;
+	FlipBuffer &pressure_texture = level == 0
+		? state.pressure_texture : state.multigrid_levels[level - 1].pressure_texture;
+	Size size = level == 0 ? state.simulation_size : state.multigrid_levels[level - 1].size;
+
+	if (level == (int)state.multigrid_levels.size()) {
+		relaxPressure(rhs_texture, pressure_texture, size,
+			settings.multigrid_coarse_iterations, settings.multigrid_relaxation);
+		return;
+	}
+
+	MultigridLevel &coarse = state.multigrid_levels[level];
+
+	relaxPressure(rhs_texture, pressure_texture, size,
+		settings.multigrid_smoothing_iterations, settings.multigrid_relaxation);
+
+	// Restrict the residual into the coarse right hand side.
+	glViewport(0, 0, coarse.size.width, coarse.size.height);
+	glBindFramebuffer(GL_FRAMEBUFFER, state.pressure_buffer);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
-		GL_TEXTURE_2D, state.velocity_texture.back(), 0);
+		GL_TEXTURE_2D, coarse.rhs_texture, 0);
 	GLenum buffers[] = { GL_COLOR_ATTACHMENT0 };
 	glDrawBuffers(1, (GLenum*)buffers);
 
-	glUseProgram(state.velocity_normalization_shader.program);
-
+	glUseProgram(state.restriction_shader.program);
 	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, state.velocity_texture.front());
-	glUniform1i(state.velocity_normalization_shader.velocity_uniform, 1);
+	glBindTexture(GL_TEXTURE_2D, rhs_texture);
+	glUniform1i(state.restriction_shader.divergence_uniform, 1);
 	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, state.pressure_texture.front());
-	glUniform1i(state.velocity_normalization_shader.pressure_uniform, 2);
-	glUniform2f(state.velocity_normalization_shader.grid_size_uniform,
-		state.canvas_size.x, state.canvas_size.y);
-	glUniform1f(state.velocity_normalization_shader.timestep_uniform, 1 / 60.0);
+	glBindTexture(GL_TEXTURE_2D, pressure_texture.front());
+	glUniform1i(state.restriction_shader.pressure_uniform, 2);
+	glUniform2f(state.restriction_shader.grid_size_uniform, size.x, size.y);
 
 	glDrawRect(-1, 1, -1, 1, 0);
 
+	// Start the coarse correction from zero.
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+		GL_TEXTURE_2D, coarse.pressure_texture.front(), 0);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	vCycle(level + 1);
+
+	// Prolong the coarse correction back onto this level.
+	glViewport(0, 0, size.width, size.height);
+	glBindFramebuffer(GL_FRAMEBUFFER, state.pressure_buffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+		GL_TEXTURE_2D, pressure_texture.back(), 0);
+	glDrawBuffers(1, (GLenum*)buffers);
+
+	glUseProgram(state.prolongation_shader.program);
 	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindTexture(GL_TEXTURE_2D, coarse.pressure_texture.front());
+	glUniform1i(state.prolongation_shader.correction_uniform, 1);
 	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glUseProgram(0);
+	glBindTexture(GL_TEXTURE_2D, pressure_texture.front());
+	glUniform1i(state.prolongation_shader.pressure_uniform, 2);
+	glUniform2f(state.prolongation_shader.grid_size_uniform, size.x, size.y);
+	glUniform2f(state.prolongation_shader.coarse_grid_size_uniform,
+		coarse.size.x, coarse.size.y);
 
-	state.velocity_texture.flip();
-}
+	glDrawRect(-1, 1, -1, 1, 0);
 
-void update() {
-	advect();
-	calculateDivergence();
-	calculatePressure();
-	normalizeVelocity();
+	pressure_texture.flip();
 
-	// Reset the frame impulse.
-	state.mouse_frame_impulse = Vector2(0, 0);
+	relaxPressure(rhs_texture, pressure_texture, size,
+		settings.multigrid_smoothing_iterations, settings.multigrid_relaxation);
 }
 
-void render() {
-	glClear(GL_COLOR_BUFFER_BIT);
-
-	glUseProgram(state.render_shader.program);
+// Returns the RMS residual of the pressure equation on the finest level.
+float pressureResidual() {
+	glViewport(0, 0, state.simulation_size.width, state.simulation_size.height);
+	glBindFramebuffer(GL_FRAMEBUFFER, state.residual_buffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+		GL_TEXTURE_2D, state.residual_texture, 0);
+	GLenum buffers[] = { GL_COLOR_ATTACHMENT0 };
+	glDrawBuffers(1, (GLenum*)buffers);
 
+	glUseProgram(state.residual_shader.program);
 	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, state.colour_texture.front());
-	glUniform1i(state.render_shader.colour_uniform, 1);
+	glBindTexture(GL_TEXTURE_2D, state.divergence_texture);
+	glUniform1i(state.residual_shader.divergence_uniform, 1);
 	glActiveTexture(GL_TEXTURE2);
-	glBindTexture(GL_TEXTURE_2D, state.velocity_texture.front());
-	glUniform1i(state.render_shader.velocity_uniform, 2);
-	glUniform2f(state.render_shader.grid_size_uniform,
-		state.canvas_size.x, state.canvas_size.y);
+	glBindTexture(GL_TEXTURE_2D, state.pressure_texture.front());
+	glUniform1i(state.residual_shader.pressure_uniform, 2);
+	glUniform2f(state.residual_shader.grid_size_uniform,
+		state.simulation_size.x, state.simulation_size.y);
 
 	glDrawRect(-1, 1, -1, 1, 0);
 
-	if (state.render_velocity_indicators) {
-		renderIndicators(state.velocity_texture.front(), Colour(1, 0, 0));
-	}
-
-	if (state.render_pressure_indicators) {
-		renderIndicators(state.pressure_texture.front(), Colour(0, 0, 1));
-	}
-
-	glutSwapBuffers();
-	glutPostRedisplay();
+	// Reduce down the mip chain and read back the single texel at the top.
+	// Non power of two levels round down so this is close to, but not
+	// exactly, the mean.
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glActiveTexture(GL_TEXTURE3);
+	glBindTexture(GL_TEXTURE_2D, state.residual_texture);
+	glGenerateMipmap(GL_TEXTURE_2D);
 
-	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glActiveTexture(GL_TEXTURE2);
+	GLfloat mean_squared = 0;
+	glGetTexImage(GL_TEXTURE_2D, state.residual_levels - 1, GL_RED, GL_FLOAT, &mean_squared);
 	glBindTexture(GL_TEXTURE_2D, 0);
-	glUseProgram(0);
+
+	return std::sqrt(mean_squared);
 }
 
-void tick() {
-	update();
-	render();
+void dispatchGrid(Size size, int tile) {
+	glDispatchCompute((size.width + tile - 1) / tile, (size.height + tile - 1) / tile, 1);
+
+	// Later passes read the results as images, textures or framebuffers.
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT
+		| GL_TEXTURE_FETCH_BARRIER_BIT | GL_FRAMEBUFFER_BARRIER_BIT);
 }
 
-void handleMouseMove(int x, int y) {
-	Point2 new_mouse_pos(x, state.canvas_size.height - y);
+// Indirect dispatches written by tiles.comp, in the order of its commands.
+enum TileDispatch
+{
+	kTileDispatch, // a work group per active tile.
+	kBlockDispatch, // 2x2 work groups of 16x16 per active tile.
+	kColourDispatch, // 16x16 work groups over the colour texels of each active tile.
+	kSettleDispatch, // as kColourDispatch over the tiles leaving the active set.
+};
 
-	state.mouse_frame_impulse = (new_mouse_pos - state.last_mouse_pos) / 10;
-	state.last_mouse_pos = new_mouse_pos;
+bool sparseCompute() {
+	return state.sparse_tiles.enabled && state.backend == Backend::Compute
+		&& state.advection_scheme == AdvectionScheme::SemiLagrangian;
+}
+
+// Dispatches over the tiles of |dispatch| when sparse, otherwise over the
+// whole grid like dispatchGrid().
+void dispatchTiles(Size size, int tile, TileDispatch dispatch) {
+	if (!sparseCompute()) {
+		dispatchGrid(size, tile);
+		return;
+	}
+
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, state.tile_command_buffer);
+	glDispatchComputeIndirect(dispatch * 3 * sizeof(GLuint));
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+
+	// As dispatchGrid(), plus the moving tile flags read by tiles.comp.
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT
+		| GL_FRAMEBUFFER_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+// Builds this step's tile lists and indirect dispatches with tiles.comp, then
+// settles the tiles that left the active set.
+void updateActiveTilesCompute() {
+	// After dense steps any tile may be moving.
+	if (!state.sparse_last_step) {
+		GLuint one = 1;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, state.tile_moving_buffer);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &one);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, state.tile_active_buffer);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &one);
+	}
+
+	// Work group counts, tiles.comp fills in the number of tiles.
+	GLuint colour_groups = kSparseTileSize / 16 * state.simulation_divisor;
+	GLuint commands[] = {
+		0, 1, 1,
+		0, kSparseTileSize / 16, kSparseTileSize / 16,
+		0, colour_groups, colour_groups,
+		0, colour_groups, colour_groups };
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, state.tile_command_buffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(commands), commands);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// The tiles under the impulse radius, in simulation texels.
+	float grid_scale = 1.0f / state.simulation_divisor;
+	float x = state.last_mouse_pos.x * grid_scale;
+	float y = state.last_mouse_pos.y * grid_scale;
+	float radius = state.mouse_impulse_radius * grid_scale;
+	int min_x = (int)std::floor((x - radius) / kSparseTileSize);
+	int min_y = (int)std::floor((y - radius) / kSparseTileSize);
+	int extent_x = (int)std::floor((x + radius) / kSparseTileSize) - min_x;
+	int extent_y = (int)std::floor((y + radius) / kSparseTileSize) - min_y;
+
+	glUseProgram(state.tile_list_shader.program);
+	glUniform2i(state.tile_list_shader.tile_grid_uniform, state.tile_grid.width, state.tile_grid.height);
+	glUniform1i(state.tile_list_shader.margin_uniform, std::max(0, state.sparse_tiles.margin));
+	glUniform2i(state.tile_list_shader.impulse_min_uniform,
+		(min_x % state.tile_grid.width + state.tile_grid.width) % state.tile_grid.width,
+		(min_y % state.tile_grid.height + state.tile_grid.height) % state.tile_grid.height);
+	glUniform2i(state.tile_list_shader.impulse_extent_uniform, extent_x, extent_y);
+	glUniform1i(state.tile_list_shader.emitter_count_uniform, state.emitter_count);
+	glUniform1f(state.tile_list_shader.emitter_scale_uniform, grid_scale);
+
+	// The stages find the lists and flags at the same bindings.
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, state.tile_command_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, state.tile_moving_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, state.tile_active_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, state.active_tile_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, state.settle_tile_buffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, state.emitter_buffer);
+
+	glDispatchCompute((state.tile_grid.area() + 63) / 64, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+	// Flagged again by this step's divergence and velocity normalization.
+	GLuint zero = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, state.tile_moving_buffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glUseProgram(state.tile_settle_shader.program);
+	glBindImageTexture(0, state.colour_texture.front(), 0, GL_FALSE, 0, GL_READ_ONLY, state.colour_format);
+	glBindImageTexture(1, state.colour_texture.back(), 0, GL_FALSE, 0, GL_WRITE_ONLY, state.colour_format);
+	glBindImageTexture(2, state.velocity_texture.front(), 0, GL_FALSE, 0, GL_READ_ONLY, state.velocity_format);
+	glBindImageTexture(3, state.velocity_texture.back(), 0, GL_FALSE, 0, GL_WRITE_ONLY, state.velocity_format);
+	glBindImageTexture(4, state.pressure_texture.front(), 0, GL_FALSE, 0, GL_WRITE_ONLY, state.pressure_format);
+	glBindImageTexture(5, state.pressure_texture.back(), 0, GL_FALSE, 0, GL_WRITE_ONLY, state.pressure_format);
+	glBindImageTexture(6, state.divergence_texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, state.divergence_format);
+	glUniform1i(state.tile_settle_shader.tile_columns_uniform, state.tile_grid.width);
+	glUniform1i(state.tile_settle_shader.tile_colour_scale_uniform, state.simulation_divisor);
+
+	dispatchTiles(state.canvas_size, 16, kSettleDispatch);
+
+	glUseProgram(0);
+}
+
+// Reads back the number of active tiles, which stalls until tiles.comp ran.
+int activeTileCount() {
+	if (!sparseCompute()) {
+		return state.tile_grid.area();
+	}
+	GLuint count = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, state.tile_command_buffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(count), &count);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	return (int)count;
+}
+
+void advectCompute() {
+	glUseProgram(state.advection_compute_shader.program);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, state.velocity_texture.front());
+	glUniform1i(state.advection_compute_shader.velocity_uniform, 1);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, state.colour_texture.front());
+	glUniform1i(state.advection_compute_shader.colour_uniform, 2);
+	glBindImageTexture(0, colourAdvectionTarget(), 0, GL_FALSE, 0,
+		GL_WRITE_ONLY, state.colour_format);
+	glBindImageTexture(1, velocityAdvectionTarget(), 0, GL_FALSE, 0,
+		GL_WRITE_ONLY, state.velocity_format);
+	glUniform2f(state.advection_compute_shader.mouse_position_uniform,
+		state.last_mouse_pos.x, state.last_mouse_pos.y);
+	glUniform2f(state.advection_compute_shader.mouse_impulse_uniform,
+		state.mouse_frame_impulse.x, state.mouse_frame_impulse.y);
+	glUniform1f(state.advection_compute_shader.impulse_radius_uniform, state.mouse_impulse_radius);
+	glUniform1i(state.advection_compute_shader.bicubic_velocity_uniform,
+		state.bicubic_velocity && state.simulation_divisor != 1);
+	glUniform1f(state.advection_compute_shader.timestep_uniform, state.advection_timestep);
+	glUniform1i(state.advection_compute_shader.sparse_tiles_uniform, sparseCompute());
+	glUniform1i(state.advection_compute_shader.tile_columns_uniform, state.tile_grid.width);
+	glUniform1i(state.advection_compute_shader.tile_colour_scale_uniform, state.simulation_divisor);
+
+	dispatchTiles(state.canvas_size, 16, kColourDispatch);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glUseProgram(0);
+
+	if (maccormackAdvection()) {
+		correctAdvection();
+	}
+
+	state.velocity_texture.flip();
+	state.colour_texture.flip();
+}
+
+void calculateDivergenceCompute() {
+	glUseProgram(state.divergence_compute_shader.program);
+
+	glBindImageTexture(0, state.velocity_texture.front(), 0, GL_FALSE, 0,
+		GL_READ_ONLY, state.velocity_format);
+	glBindImageTexture(1, state.divergence_texture, 0, GL_FALSE, 0,
+		GL_WRITE_ONLY, state.divergence_format);
+	glUniform1f(state.divergence_compute_shader.timestep_uniform, 1 / 60.0);
+	glUniform1i(state.divergence_compute_shader.sparse_tiles_uniform, sparseCompute());
+	glUniform1i(state.divergence_compute_shader.tile_columns_uniform, state.tile_grid.width);
+	glUniform1f(state.divergence_compute_shader.threshold_uniform, state.sparse_tiles.divergence_threshold);
+
+	dispatchTiles(state.simulation_size, 16, kBlockDispatch);
+
+	glUseProgram(0);
+}
+
+void relaxPressureCompute(int iterations) {
+	glUseProgram(state.pressure_compute_shader.program);
+
+	glBindImageTexture(1, state.divergence_texture, 0, GL_FALSE, 0,
+		GL_READ_ONLY, state.divergence_format);
+	glUniform1i(state.pressure_compute_shader.sparse_tiles_uniform, sparseCompute());
+	glUniform1i(state.pressure_compute_shader.tile_columns_uniform, state.tile_grid.width);
+
+	while (iterations > 0) {
+		int dispatch_iterations = std::min(iterations, state.compute_jacobi_iterations);
+
+		glBindImageTexture(0, state.pressure_texture.front(), 0, GL_FALSE, 0,
+			GL_READ_ONLY, state.pressure_format);
+		glBindImageTexture(2, state.pressure_texture.back(), 0, GL_FALSE, 0,
+			GL_WRITE_ONLY, state.pressure_format);
+		glUniform1i(state.pressure_compute_shader.iterations_uniform, dispatch_iterations);
+
+		// Matches the tile size in pressure.comp.
+		dispatchTiles(state.simulation_size, 32, kTileDispatch);
+
+		// Flip the input and output textures.
+		state.pressure_texture.flip();
+		iterations -= dispatch_iterations;
+	}
+
+	glUseProgram(0);
+}
+
+void normalizeVelocityCompute() {
+	glUseProgram(state.velocity_normalization_compute_shader.program);
+
+	glBindImageTexture(0, state.velocity_texture.front(), 0, GL_FALSE, 0,
+		GL_READ_ONLY, state.velocity_format);
+	glBindImageTexture(1, state.pressure_texture.front(), 0, GL_FALSE, 0,
+		GL_READ_ONLY, state.pressure_format);
+	glBindImageTexture(2, state.velocity_texture.back(), 0, GL_FALSE, 0,
+		GL_WRITE_ONLY, state.velocity_format);
+	glUniform1f(state.velocity_normalization_compute_shader.timestep_uniform, 1 / 60.0);
+	glUniform1i(state.velocity_normalization_compute_shader.sparse_tiles_uniform, sparseCompute());
+	glUniform1i(state.velocity_normalization_compute_shader.tile_columns_uniform, state.tile_grid.width);
+	glUniform1f(state.velocity_normalization_compute_shader.threshold_uniform, state.sparse_tiles.velocity_threshold);
+
+	dispatchTiles(state.simulation_size, 16, kBlockDispatch);
+
+	glUseProgram(0);
+
+	state.velocity_texture.flip();
+}
+
+void calculatePressure() {
+	const PressureSettings &settings = state.pressure_settings;
+	PressureSolveStats &stats = state.pressure_stats;
+
+	glViewport(0, 0, state.simulation_size.width, state.simulation_size.height);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, state.pressure_buffer);
+	if (!settings.warm_start) {
+		// Re-zero the pressure texture.
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+			GL_TEXTURE_2D, state.pressure_texture.front(), 0);
+		glClear(GL_COLOR_BUFFER_BIT);
+	} else if (settings.warm_start_scale != 1) {
+		// Scale the previous solution into the back buffer.
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+			GL_TEXTURE_2D, state.pressure_texture.back(), 0);
+		GLenum buffers[] = { GL_COLOR_ATTACHMENT0 };
+		glDrawBuffers(1, (GLenum*)buffers);
+
+		glUseProgram(state.scale_shader.program);
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, state.pressure_texture.front());
+		glUniform1i(state.scale_shader.field_uniform, 1);
+		glUniform2f(state.scale_shader.grid_size_uniform,
+			state.simulation_size.x, state.simulation_size.y);
+		glUniform1f(state.scale_shader.scale_uniform, settings.warm_start_scale);
+
+		glDrawRect(-1, 1, -1, 1, 0);
+
+		state.pressure_texture.flip();
+	}
+
+	stats = PressureSolveStats();
+
+	bool converged = false;
+	if (settings.solver == PressureSolver::Multigrid) {
+		while (!converged && stats.iterations < settings.multigrid_cycles) {
+			vCycle(0);
+			++stats.iterations;
+
+			if (settings.residual_tolerance > 0) {
+				stats.residual = pressureResidual();
+				converged = stats.residual <= settings.residual_tolerance;
+			}
+		}
+	} else {
+		int interval = settings.residual_tolerance > 0
+			? std::max(1, settings.residual_check_interval) : settings.jacobi_iterations;
+		while (!converged && stats.iterations < settings.jacobi_iterations) {
+			int iterations = std::min(interval, settings.jacobi_iterations - stats.iterations);
+			if (state.backend == Backend::Compute) {
+				relaxPressureCompute(iterations);
+			} else {
+				relaxPressure(state.divergence_texture, state.pressure_texture, state.simulation_size,
+					iterations, 1);
+			}
+			stats.iterations += iterations;
+
+			if (settings.residual_tolerance > 0) {
+				stats.residual = pressureResidual();
+				converged = stats.residual <= settings.residual_tolerance;
+			}
+		}
+	}
+
+	if (state.report_pressure_convergence) {
+		if (settings.residual_tolerance <= 0) {
+			stats.residual = pressureResidual();
+		}
+		printf("pressure: %d %s, residual %g\n", stats.iterations,
+			settings.solver == PressureSolver::Multigrid ? "cycles" : "iterations", stats.residual);
+	}
+
+	glViewport(0, 0, state.canvas_size.width, state.canvas_size.height);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glUseProgram(0);
+}
+
+void normalizeVelocity() {
+	glViewport(0, 0, state.simulation_size.width, state.simulation_size.height);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, state.velocity_normalization_buffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+		GL_TEXTURE_2D, state.velocity_texture.back(), 0);
+	GLenum buffers[] = { GL_COLOR_ATTACHMENT0 };
+	glDrawBuffers(1, (GLenum*)buffers);
+
+	glUseProgram(state.velocity_normalization_shader.program);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, state.velocity_texture.front());
+	glUniform1i(state.velocity_normalization_shader.velocity_uniform, 1);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, state.pressure_texture.front());
+	glUniform1i(state.velocity_normalization_shader.pressure_uniform, 2);
+	glUniform2f(state.velocity_normalization_shader.grid_size_uniform,
+		state.simulation_size.x, state.simulation_size.y);
+	glUniform1f(state.velocity_normalization_shader.timestep_uniform, 1 / 60.0);
+
+	glDrawRect(-1, 1, -1, 1, 0);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glUseProgram(0);
+
+	state.velocity_texture.flip();
+}
+
+// Copies |state.emitters| into the emitter buffer, growing it a batch at a
+// time so every batch can be bound as a whole uniform block.
+void uploadEmitters() {
+	std::vector<GpuEmitter> data(state.emitters.size());
+	for (size_t i = 0; i < state.emitters.size(); ++i) {
+		const Emitter &emitter = state.emitters[i];
+		GpuEmitter &gpu = data[i];
+		gpu.position_radius[0] = emitter.x;
+		gpu.position_radius[1] = emitter.y;
+		gpu.position_radius[2] = emitter.radius;
+		gpu.position_radius[3] = 0;
+		gpu.force_dye[0] = emitter.force_x;
+		gpu.force_dye[1] = emitter.force_y;
+		gpu.force_dye[2] = emitter.dye;
+		gpu.force_dye[3] = 0;
+		gpu.colour[0] = emitter.red;
+		gpu.colour[1] = emitter.green;
+		gpu.colour[2] = emitter.blue;
+		gpu.colour[3] = 1;
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, state.emitter_buffer);
+	if (data.size() > state.emitter_buffer_capacity) {
+		state.emitter_buffer_capacity = (data.size() + kMaxEmittersPerBatch - 1)
+			/ kMaxEmittersPerBatch * kMaxEmittersPerBatch;
+		glBufferData(GL_UNIFORM_BUFFER, state.emitter_buffer_capacity * sizeof(GpuEmitter), nullptr, GL_STREAM_DRAW);
+	}
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, data.size() * sizeof(GpuEmitter), &data[0]);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	state.emitter_count = (int)data.size();
+}
+
+// Splats the emitters into the current velocity and colour fields as one
+// instanced draw of quads per batch. Velocity is blended additively, the
+// colour mixes towards each emitter's dye while keeping the alpha.
+void applyEmitters() {
+	uploadEmitters();
+
+	glUseProgram(state.splat_shader.program);
+	glBindFramebuffer(GL_FRAMEBUFFER, state.splat_buffer);
+	glBindVertexArray(state.indicator_vertex_array);
+	glEnable(GL_BLEND);
+
+	for (int dye_pass = 0; dye_pass < 2; ++dye_pass) {
+		Size size = dye_pass ? state.canvas_size : state.simulation_size;
+		GLuint target = dye_pass ? state.colour_texture.front() : state.velocity_texture.front();
+		glViewport(0, 0, size.width, size.height);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target, 0);
+		if (dye_pass) {
+			glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ZERO, GL_ONE);
+		} else {
+			glBlendFunc(GL_ONE, GL_ONE);
+		}
+
+		glUniform2f(state.splat_shader.grid_size_uniform, size.x, size.y);
+		glUniform1f(state.splat_shader.grid_scale_uniform, (float)size.width / state.canvas_size.width);
+		glUniform1i(state.splat_shader.dye_pass_uniform, dye_pass);
+
+		for (int first = 0; first < state.emitter_count; first += kMaxEmittersPerBatch) {
+			int count = std::min(state.emitter_count - first, kMaxEmittersPerBatch);
+			glBindBufferRange(GL_UNIFORM_BUFFER, 0, state.emitter_buffer,
+				first * sizeof(GpuEmitter), kMaxEmittersPerBatch * sizeof(GpuEmitter));
+			glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count * 4);
+		}
+	}
+
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+	glDisable(GL_BLEND);
+	glBindBufferBase(GL_UNIFORM_BUFFER, 0, 0);
+	glBindVertexArray(0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glUseProgram(0);
+}
+
+// Snapshot fields in the order they're read back.
+enum SnapshotFieldIndex
+{
+	kVelocitySnapshot,
+	kColourSnapshot,
+	kPressureSnapshot,
+	kSnapshotFieldCount,
+};
+
+void pollSnapshot(bool wait) {
+	state.snapshot_readback.poll(wait, [](int tag, const void *data, size_t bytes) {
+		std::vector<float> &field = state.snapshot_fields[tag].data;
+		memcpy(&field[0], data, std::min(bytes, field.size() * sizeof(float)));
+		--state.snapshot_fields_pending;
+	});
+	if (!state.snapshot_fields.empty() && state.snapshot_fields_pending == 0) {
+		state.snapshot_writer = std::thread([](std::string path, std::vector<SnapshotField> fields,
+			Size canvas_size, int divisor, uint64_t step) {
+			if (writeSnapshot(path.c_str(), canvas_size.width, canvas_size.height, divisor, step, fields)) {
+				printf("Wrote %s at step %llu\n", path.c_str(), (unsigned long long)step);
+			}
+		}, state.snapshot_path, std::move(state.snapshot_fields), state.canvas_size,
+			state.simulation_divisor, state.snapshot_step);
+		state.snapshot_fields.clear();
+	}
+}
+
+// Waits for any snapshot in flight to be read back and written.
+void finishSnapshot() {
+	if (state.snapshot_fields_pending > 0) {
+		pollSnapshot(true);
+	}
+	if (state.snapshot_writer.joinable()) {
+		state.snapshot_writer.join();
+	}
+}
+
+// Queues a readback of the velocity, colour and pressure fields, which
+// pollSnapshot() writes to |path| from a background thread once they've
+// arrived. Divergence and the multigrid levels are recomputed every step.
+bool requestSnapshot(const std::string &path) {
+	if (state.snapshot_fields_pending > 0) {
+		printf("A snapshot is already being read back.\n");
+		return false;
+	}
+	if (state.snapshot_writer.joinable()) {
+		state.snapshot_writer.join();
+	}
+
+	struct FieldSource
+	{
+		const char *name;
+		GLuint texture;
+		GLenum format;
+		int components;
+		Size size;
+	};
+	FieldSource sources[kSnapshotFieldCount] = {
+		{ "velocity", state.velocity_texture.front(), GL_RG, 2, state.simulation_size },
+		{ "colour", state.colour_texture.front(), GL_RGBA, 4, state.canvas_size },
+		{ "pressure", state.pressure_texture.front(), GL_RED, 1, state.simulation_size },
+	};
+
+	state.snapshot_fields.resize(kSnapshotFieldCount);
+	for (int i = 0; i < kSnapshotFieldCount; ++i) {
+		SnapshotField &field = state.snapshot_fields[i];
+		field.name = sources[i].name;
+		field.width = sources[i].size.width;
+		field.height = sources[i].size.height;
+		field.components = sources[i].components;
+		field.data.resize((size_t)sources[i].size.area() * sources[i].components);
+		state.snapshot_readback.readTexture(sources[i].texture, sources[i].format, GL_FLOAT,
+			field.data.size() * sizeof(float), i);
+	}
+	state.snapshot_fields_pending = kSnapshotFieldCount;
+	state.snapshot_path = path;
+	state.snapshot_step = state.step;
+	return true;
+}
+
+// Reads the canvas size and simulation divisor of |path| so the window and
+// fields can be created to match before restoreSnapshot().
+bool readSnapshotSize(const char *path, Size *canvas_size, int *simulation_divisor) {
+	Snapshot snapshot;
+	if (!snapshot.load(path)) {
+		return false;
+	}
+	*canvas_size = Size(snapshot.header().canvas_width, snapshot.header().canvas_height);
+	*simulation_divisor = std::max(1, (int)snapshot.header().simulation_divisor);
+	return true;
+}
+
+// Uploads |field| into both copies of |texture|.
+bool restoreField(const Snapshot &snapshot, const char *name, int components, GLenum format,
+	Size size, FlipBuffer &texture) {
+	const SnapshotFieldHeader *field = snapshot.field(name, components);
+	if (!field || field->width != size.width || field->height != size.height) {
+		fprintf(stderr, "Snapshot %s field doesn't match a %dx%d grid\n", name, size.width, size.height);
+		return false;
+	}
+	GLuint textures[] = { texture.front(), texture.back() };
+	for (GLuint handle : textures) {
+		glBindTexture(GL_TEXTURE_2D, handle);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size.width, size.height, format, GL_FLOAT,
+			snapshot.fieldData(*field));
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return true;
+}
+
+// Replaces the simulation state with the snapshot at |path|, which must
+// have the current canvas size and simulation divisor. The file is mapped,
+// so only the pages uploaded are read from disk.
+bool restoreSnapshot(const char *path) {
+	Snapshot snapshot;
+	if (!snapshot.load(path)) {
+		return false;
+	}
+	const SnapshotHeader &header = snapshot.header();
+	if (header.canvas_width != state.canvas_size.width || header.canvas_height != state.canvas_size.height
+		|| (int)header.simulation_divisor != state.simulation_divisor) {
+		fprintf(stderr, "%s is %dx%d with divisor %u, the canvas is %dx%d with divisor %d\n", path,
+			header.canvas_width, header.canvas_height, header.simulation_divisor,
+			state.canvas_size.width, state.canvas_size.height, state.simulation_divisor);
+		return false;
+	}
+
+	if (!restoreField(snapshot, "velocity", 2, GL_RG, state.simulation_size, state.velocity_texture)
+		|| !restoreField(snapshot, "colour", 4, GL_RGBA, state.canvas_size, state.colour_texture)
+		|| !restoreField(snapshot, "pressure", 1, GL_RED, state.simulation_size, state.pressure_texture)) {
+		return false;
+	}
+
+	// Every tile is simulated on the next step to rebuild the tile list.
+	state.sparse_last_step = false;
+	state.step = header.step;
+	return true;
+}
+
+bool startStream(const std::string &path) {
+	if (!state.frame_stream.open(path.c_str(), state.canvas_size.width, state.canvas_size.height,
+		state.stream_keyframe_interval)) {
+		return false;
+	}
+	state.stream_path = path;
+	return true;
+}
+
+void pollStream(bool wait) {
+	state.stream_readback.poll(wait, [](int, const void *data, size_t) {
+		state.frame_stream.write((const unsigned char*)data);
+	});
+}
+
+void stopStream() {
+	if (!state.frame_stream.isOpen()) {
+		return;
+	}
+	pollStream(true);
+	uint64_t raw_bytes = state.frame_stream.rawBytes();
+	uint64_t encoded_bytes = state.frame_stream.encodedBytes();
+	if (state.frame_stream.close()) {
+		printf("Wrote %s, %.2f MB from %.2f MB\n", state.stream_path.c_str(),
+			encoded_bytes / 1048576.0, raw_bytes / 1048576.0);
+	}
+}
+
+// Queues the colour field for the frame stream. Frames are only waited on
+// when the GPU is a whole ring of readbacks behind.
+void recordStreamFrame() {
+	pollStream(false);
+	if (state.step % state.stream_interval != 0) {
+		return;
+	}
+	size_t bytes = (size_t)state.canvas_size.area() * 3;
+	if (!state.stream_readback.readTexture(state.colour_texture.front(), GL_RGB, GL_UNSIGNED_BYTE, bytes, 0)) {
+		pollStream(true);
+		state.stream_readback.readTexture(state.colour_texture.front(), GL_RGB, GL_UNSIGNED_BYTE, bytes, 0);
+	}
+}
+
+// Reads the frame size of |path| so the window and fields can be created to
+// match before startReplay().
+bool readStreamSize(const char *path, Size *canvas_size) {
+	FrameStreamReader stream;
+	if (!stream.open(path)) {
+		return false;
+	}
+	*canvas_size = Size(stream.width(), stream.height());
+	return true;
+}
+
+// Replays the stream at |path| into the colour field, which must have the
+// stream's frame size.
+bool startReplay(const char *path) {
+	if (!state.replay_stream.open(path)) {
+		return false;
+	}
+	if (state.replay_stream.width() != state.canvas_size.width
+		|| state.replay_stream.height() != state.canvas_size.height) {
+		fprintf(stderr, "%s is %dx%d, the canvas is %dx%d\n", path,
+			state.replay_stream.width(), state.replay_stream.height(),
+			state.canvas_size.width, state.canvas_size.height);
+		return false;
+	}
+	if (state.replay_stream.frameCount() == 0) {
+		fprintf(stderr, "%s has no frames\n", path);
+		return false;
+	}
+	state.replaying = true;
+	state.replay_frame = 0;
+	state.replay_pixels.resize((size_t)state.replay_stream.width() * state.replay_stream.height() * 3);
+	return true;
+}
+
+// Shows the next frame of the replay in place of a simulation step, looping
+// at the end.
+void replayStep() {
+	if (!state.replay_stream.read(state.replay_frame, &state.replay_pixels[0])) {
+		state.replaying = false;
+		return;
+	}
+	state.replay_frame = (state.replay_frame + 1) % state.replay_stream.frameCount();
+
+	glBindTexture(GL_TEXTURE_2D, state.colour_texture.front());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, state.replay_stream.width(), state.replay_stream.height(),
+		GL_RGB, GL_UNSIGNED_BYTE, &state.replay_pixels[0]);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void update() {
+	GpuStageTimer &timer = state.gpu_timer;
+
+	state.emitter_script.emittersAt(state.step, &state.emitters);
+	state.emitter_count = 0;
+	if (!state.emitters.empty()) {
+		timer.begin(state.stages.splat);
+		applyEmitters();
+		timer.end();
+	}
+
+	bool sparse = sparseCompute();
+	if (sparse) {
+		timer.begin(state.stages.tiles);
+		updateActiveTilesCompute();
+		timer.end();
+	}
+	state.sparse_last_step = sparse;
+
+	if (state.backend == Backend::Compute) {
+		timer.begin(state.stages.advect);
+		advectCompute();
+		timer.end();
+		timer.begin(state.stages.divergence);
+		calculateDivergenceCompute();
+		timer.end();
+	} else {
+		timer.begin(state.stages.advect);
+		advect();
+		timer.end();
+		if (!fusedAdvection()) {
+			timer.begin(state.stages.divergence);
+			calculateDivergence();
+			timer.end();
+		}
+	}
+
+	timer.begin(state.stages.pressure);
+	calculatePressure();
+	timer.end();
+
+	timer.begin(state.stages.normalize);
+	if (state.backend == Backend::Compute) {
+		normalizeVelocityCompute();
+	} else {
+		normalizeVelocity();
+	}
+	timer.end();
+
+	// Reset the frame impulse and emitters.
+	state.mouse_frame_impulse = Vector2(0, 0);
+	state.emitters.clear();
+
+	++state.step;
+	if (state.frame_stream.isOpen()) {
+		recordStreamFrame();
+	}
+}
+
+void render() {
+	glViewport(0, 0, state.canvas_size.width, state.canvas_size.height);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glUseProgram(state.render_shader.program);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, state.colour_texture.front());
+	glUniform1i(state.render_shader.colour_uniform, 1);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, state.velocity_texture.front());
+	glUniform1i(state.render_shader.velocity_uniform, 2);
+	glUniform2f(state.render_shader.grid_size_uniform,
+		state.canvas_size.x, state.canvas_size.y);
+	glUniform2f(state.render_shader.velocity_grid_size_uniform,
+		state.simulation_size.x, state.simulation_size.y);
+	glUniform1i(state.render_shader.quality_uniform, (int)state.render_quality);
+
+	state.gpu_timer.begin(state.stages.render);
+	if (state.render_quality == RenderQuality::Mip) {
+		// The colour textures only filter their mips through this sampler.
+		glActiveTexture(GL_TEXTURE1);
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glBindSampler(1, state.colour_mip_sampler);
+	}
+	glDrawRect(-1, 1, -1, 1, 0);
+	glBindSampler(1, 0);
+	state.gpu_timer.end();
+
+	if (state.render_velocity_indicators || state.render_pressure_indicators) {
+		state.gpu_timer.begin(state.stages.indicators);
+		if (state.render_velocity_indicators) {
+			renderIndicators(state.velocity_texture.front(), Colour(1, 0, 0), false);
+		}
+
+		if (state.render_pressure_indicators) {
+			renderIndicators(state.pressure_texture.front(), Colour(0, 0, 1), true);
+		}
+		state.gpu_timer.end();
+	}
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE2);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glUseProgram(0);
+}
+
+void renderProfilerOverlay() {
+	const StageProfiler &profiler = state.profiler;
+
+	char line[128];
+	int y = state.canvas_size.height - 20;
+	glColor3f(1, 1, 1);
+	glWindowPos2i(10, y);
+	glutBitmapString(GLUT_BITMAP_8_BY_13, (const unsigned char*)"stage          p50    p95    p99 ms  dropped");
+	for (int stage = 0; stage < profiler.stageCount(); ++stage) {
+		const RollingHistogram &histogram = profiler.histogram(stage);
+		if (histogram.count() == 0) {
+			continue;
+		}
+		snprintf(line, sizeof(line), "%-12s %6.2f %6.2f %6.2f %8d", profiler.stageName(stage).c_str(),
+			histogram.percentile(50), histogram.percentile(95), histogram.percentile(99),
+			profiler.dropped(stage));
+		y -= 15;
+		glWindowPos2i(10, y);
+		glutBitmapString(GLUT_BITMAP_8_BY_13, (const unsigned char*)line);
+	}
+}
+
+void reportFrameTime() {
+	auto now = std::chrono::steady_clock::now();
+	double frame_ms = std::chrono::duration<double, std::milli>(now - state.last_frame_time).count();
+	state.profiler.record(state.stages.frame, frame_ms);
+	state.frame_time_ms += frame_ms;
+	state.frame_time_samples++;
+	state.last_frame_time = now;
+
+	if (state.frame_time_samples < state.frame_time_report_interval) {
+		return;
+	}
+
+	// Over the same frames as the frame time, so a warm start toggle only
+	// mixes the two modes for one report.
+	double pressure_ms = state.profiler.takeIntervalMean(state.stages.pressure);
+	if (state.report_frame_time) {
+		printf("%s start: frame %.2f ms, pressure %.2f ms\n",
+			state.pressure_settings.warm_start ? "warm" : "cold",
+			state.frame_time_ms / state.frame_time_samples, pressure_ms);
+		if (sparseCompute()) {
+			printf("%d/%d active tiles\n", activeTileCount(), state.tile_grid.area());
+		}
+	}
+
+	state.frame_time_ms = 0;
+	state.frame_time_samples = 0;
+}
+
+// Captures the current frame when one is due. Headless runs don't render
+// every step, so the framebuffer source renders the frames it captures.
+void captureFrame(bool rendered) {
+	FrameCapture &capture = state.frame_capture;
+	capture.poll();
+	if (!capture.frameDue()) {
+		return;
+	}
+	if (!rendered && state.capture_settings.source == CaptureSource::Framebuffer) {
+		render();
+	}
+	capture.capture(state.colour_texture.front());
+}
+
+void tick() {
+	state.gpu_timer.beginFrame();
+
+	if (state.replaying) {
+		replayStep();
+	} else {
+		update();
+	}
+	render();
+	if (state.snapshot_fields_pending > 0) {
+		pollSnapshot(false);
+	}
+
+	if (state.render_profiler_overlay) {
+		renderProfilerOverlay();
+	}
+
+	if (state.frame_capture.isActive()) {
+		captureFrame(true);
+	}
+
+	glutSwapBuffers();
+	glutPostRedisplay();
+
+	reportFrameTime();
+}
+
+void handleMouseMove(int x, int y) {
+	Point2 new_mouse_pos(x, state.canvas_size.height - y);
+
+	state.mouse_frame_impulse = (new_mouse_pos - state.last_mouse_pos) / 10;
+	state.last_mouse_pos = new_mouse_pos;
 }
 
 void handleMouseButton(int button, int button_state, int x, int y) {
@@ -380,6 +1715,9 @@ void handlePressNormalKeys(unsigned char key, int x, int y) {
 		case 'q':
 		case 'Q':
 		case 27:
+			finishSnapshot();
+			stopStream();
+			state.frame_capture.stop();
 			exit(EXIT_SUCCESS);
 		case 'v':
 		case 'V':
@@ -399,7 +1737,411 @@ void handlePressNormalKeys(unsigned char key, int x, int y) {
 		case 'B':
 			state.indicator_render_inverval++;
 			break;
+		case 'm':
+		case 'M':
+			state.pressure_settings.solver =
+				state.pressure_settings.solver == PressureSolver::Multigrid
+				? PressureSolver::Jacobi : PressureSolver::Multigrid;
+			break;
+		case 'w':
+		case 'W':
+			state.pressure_settings.warm_start =
+				!state.pressure_settings.warm_start;
+			break;
+		case 't':
+		case 'T':
+			state.report_frame_time = !state.report_frame_time;
+			break;
+		case 'u':
+		case 'U':
+			state.fused_advection = !state.fused_advection;
+			break;
+		case 'k':
+		case 'K':
+			if (!state.compute_supported) {
+				printf("Compute shaders are not supported.\n");
+				break;
+			}
+			state.backend = state.backend == Backend::Compute ? Backend::Fragment : Backend::Compute;
+			break;
+		case 'r':
+		case 'R':
+			state.report_pressure_convergence =
+				!state.report_pressure_convergence;
+			break;
+		case 'p':
+		case 'P':
+			state.render_profiler_overlay = !state.render_profiler_overlay;
+			break;
+		case 'a':
+		case 'A':
+			state.sparse_tiles.enabled = !state.sparse_tiles.enabled;
+			if (state.sparse_tiles.enabled && state.backend != Backend::Compute) {
+				printf("Sparse tiles only apply to the compute backend.\n");
+			}
+			break;
+		case 'e':
+		case 'E':
+			state.advection_scheme = state.advection_scheme == AdvectionScheme::MacCormack
+				? AdvectionScheme::SemiLagrangian : AdvectionScheme::MacCormack;
+			printf("Advection: %s\n", advectionSchemeName(state.advection_scheme));
+			break;
+		case 'l':
+		case 'L':
+			state.bicubic_velocity = !state.bicubic_velocity;
+			break;
+		case 'g':
+		case 'G':
+			state.render_quality = (RenderQuality)(((int)state.render_quality + 1) % 3);
+			printf("Render quality: %s\n", renderQualityName(state.render_quality));
+			break;
+		case 'x':
+		case 'X':
+			if (state.profiler.writeCsv("profile.csv") && state.profiler.writeJson("profile.json")) {
+				printf("Wrote profile.csv and profile.json\n");
+			}
+			break;
+		case 's':
+		case 'S':
+			requestSnapshot(state.snapshot_path);
+			break;
+		case 'o':
+		case 'O':
+			finishSnapshot();
+			if (restoreSnapshot(state.snapshot_path.c_str())) {
+				printf("Restored %s at step %llu\n", state.snapshot_path.c_str(), (unsigned long long)state.step);
+			}
+			break;
+		case 'h':
+		case 'H':
+			if (state.frame_capture.isActive()) {
+				state.frame_capture.stop();
+			} else if (state.frame_capture.start(state.capture_settings,
+				state.canvas_size.width, state.canvas_size.height)) {
+				printf("Capturing to %s\n", state.capture_settings.output.c_str());
+			}
+			break;
+		case 'j':
+		case 'J':
+			if (state.frame_stream.isOpen()) {
+				stopStream();
+			} else if (startStream(state.stream_path)) {
+				printf("Recording %s\n", state.stream_path.c_str());
+			}
+			break;
+	}
+}
+
+// Queues the compute backend for the current field formats, which are baked
+// into its image declarations.
+void addComputeShaders(ProgramBatch &batch) {
+	glDeleteProgram(state.advection_compute_shader.program);
+	glDeleteProgram(state.divergence_compute_shader.program);
+	glDeleteProgram(state.pressure_compute_shader.program);
+	glDeleteProgram(state.velocity_normalization_compute_shader.program);
+	glDeleteProgram(state.tile_list_shader.program);
+	glDeleteProgram(state.tile_settle_shader.program);
+
+	state.compute_supported = GLEW_VERSION_4_3 || GLEW_ARB_compute_shader;
+	if (state.compute_supported) {
+		std::string defines = std::string()
+			+ "#define COLOUR_FORMAT " + imageFormatQualifier(state.colour_format) + "\n"
+			+ "#define VELOCITY_FORMAT " + imageFormatQualifier(state.velocity_format) + "\n"
+			+ "#define DIVERGENCE_FORMAT " + imageFormatQualifier(state.divergence_format) + "\n"
+			+ "#define PRESSURE_FORMAT " + imageFormatQualifier(state.pressure_format) + "\n"
+			+ "#define MAX_ITERATIONS " + std::to_string(state.compute_jacobi_iterations) + "\n";
+
+		batch.addCompute(&state.advection_compute_shader.program, "advection.comp", defines);
+		batch.addCompute(&state.divergence_compute_shader.program, "divergence.comp", defines);
+		batch.addCompute(&state.pressure_compute_shader.program, "pressure.comp", defines);
+		batch.addCompute(&state.velocity_normalization_compute_shader.program, "velocity_normalization.comp", defines);
+		batch.addCompute(&state.tile_list_shader.program, "tiles.comp", defines);
+		batch.addCompute(&state.tile_settle_shader.program, "tile_settle.comp", defines);
+	}
+}
+
+// Looks up the compute backend's uniforms once its programs are linked.
+void getComputeUniforms() {
+	if (state.compute_supported) {
+		state.advection_compute_shader.velocity_uniform = glGetUniform(state.advection_compute_shader, "velocity_sampler");
+		state.advection_compute_shader.colour_uniform = glGetUniform(state.advection_compute_shader, "colour_sampler");
+		state.advection_compute_shader.mouse_position_uniform = glGetUniform(state.advection_compute_shader, "mouse_position");
+		state.advection_compute_shader.mouse_impulse_uniform = glGetUniform(state.advection_compute_shader, "mouse_impulse");
+		state.advection_compute_shader.impulse_radius_uniform = glGetUniform(state.advection_compute_shader, "impulse_radius");
+		state.advection_compute_shader.bicubic_velocity_uniform = glGetUniform(state.advection_compute_shader, "bicubic_velocity");
+		state.advection_compute_shader.timestep_uniform = glGetUniform(state.advection_compute_shader, "timestep");
+		state.advection_compute_shader.sparse_tiles_uniform = glGetUniform(state.advection_compute_shader, "sparse_tiles");
+		state.advection_compute_shader.tile_columns_uniform = glGetUniform(state.advection_compute_shader, "tile_columns");
+		state.advection_compute_shader.tile_colour_scale_uniform = glGetUniform(state.advection_compute_shader, "tile_colour_scale");
+
+		state.divergence_compute_shader.timestep_uniform = glGetUniform(state.divergence_compute_shader, "timestep");
+		state.divergence_compute_shader.sparse_tiles_uniform = glGetUniform(state.divergence_compute_shader, "sparse_tiles");
+		state.divergence_compute_shader.tile_columns_uniform = glGetUniform(state.divergence_compute_shader, "tile_columns");
+		state.divergence_compute_shader.threshold_uniform = glGetUniform(state.divergence_compute_shader, "threshold");
+
+		state.pressure_compute_shader.iterations_uniform = glGetUniform(state.pressure_compute_shader, "iterations");
+		state.pressure_compute_shader.sparse_tiles_uniform = glGetUniform(state.pressure_compute_shader, "sparse_tiles");
+		state.pressure_compute_shader.tile_columns_uniform = glGetUniform(state.pressure_compute_shader, "tile_columns");
+
+		state.velocity_normalization_compute_shader.timestep_uniform = glGetUniform(state.velocity_normalization_compute_shader, "timestep");
+		state.velocity_normalization_compute_shader.sparse_tiles_uniform = glGetUniform(state.velocity_normalization_compute_shader, "sparse_tiles");
+		state.velocity_normalization_compute_shader.tile_columns_uniform = glGetUniform(state.velocity_normalization_compute_shader, "tile_columns");
+		state.velocity_normalization_compute_shader.threshold_uniform = glGetUniform(state.velocity_normalization_compute_shader, "threshold");
+
+		state.tile_list_shader.tile_grid_uniform = glGetUniform(state.tile_list_shader, "tile_grid");
+		state.tile_list_shader.margin_uniform = glGetUniform(state.tile_list_shader, "margin");
+		state.tile_list_shader.impulse_min_uniform = glGetUniform(state.tile_list_shader, "impulse_min");
+		state.tile_list_shader.emitter_count_uniform = glGetUniform(state.tile_list_shader, "emitter_count");
+		state.tile_list_shader.emitter_scale_uniform = glGetUniform(state.tile_list_shader, "emitter_scale");
+		state.tile_list_shader.impulse_extent_uniform = glGetUniform(state.tile_list_shader, "impulse_extent");
+
+		state.tile_settle_shader.tile_columns_uniform = glGetUniform(state.tile_settle_shader, "tile_columns");
+		state.tile_settle_shader.tile_colour_scale_uniform = glGetUniform(state.tile_settle_shader, "tile_colour_scale");
+
+		state.compute_supported = state.advection_compute_shader.program
+			&& state.divergence_compute_shader.program
+			&& state.pressure_compute_shader.program
+			&& state.velocity_normalization_compute_shader.program
+			&& state.tile_list_shader.program
+			&& state.tile_settle_shader.program;
+	}
+}
+
+// (Re)compiles the compute backend for the current field formats.
+void loadComputeShaders() {
+	ProgramBatch batch(state.shader_cache);
+	addComputeShaders(batch);
+	batch.link();
+	getComputeUniforms();
+}
+
+// Fills the fields on the GPU instead of uploading host arrays, zero
+// velocity, divergence and pressure and the striped dye of init_fields.frag.
+void initializeFields() {
+	GLuint framebuffer;
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	GLenum buffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+
+	const GLfloat zero[] = { 0, 0, 0, 0 };
+	GLuint zeroed[] = {
+		state.velocity_texture.back(), state.velocity_texture.front(), state.divergence_texture,
+		state.pressure_texture.back(), state.pressure_texture.front() };
+	glDrawBuffers(1, buffers);
+	for (GLuint texture : zeroed) {
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+		glClearBufferfv(GL_COLOR, 0, zero);
+	}
+
+	// Both colour buffers in one pass.
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+		GL_TEXTURE_2D, state.colour_texture.back(), 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
+		GL_TEXTURE_2D, state.colour_texture.front(), 0);
+	glDrawBuffers(2, buffers);
+	glViewport(0, 0, state.canvas_size.width, state.canvas_size.height);
+	glUseProgram(state.init_fields_shader.program);
+	glDrawRect(-1, 1, -1, 1, 0);
+	glUseProgram(0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &framebuffer);
+}
+
+// Creates the simulation textures in the current formats and sizes with the
+// initial velocity, colour and pressure.
+void createFields() {
+	// Velocity texture.
+	glGenTextures(2, state.velocity_texture.buffers);
+	GLuint velocity_textures[] = { state.velocity_texture.back(), state.velocity_texture.front() };
+	for (GLuint texture : velocity_textures) {
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexImage2D(GL_TEXTURE_2D, 0, state.velocity_format,
+			state.simulation_size.width, state.simulation_size.height, 0, GL_RGB, GL_FLOAT, NULL);
+	}
+
+	// Colour texture.
+	glGenTextures(2, state.colour_texture.buffers);
+	GLuint colour_textures[] = { state.colour_texture.back(), state.colour_texture.front() };
+	for (GLuint texture : colour_textures) {
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, state.colour_mip_levels - 1);
+		glTexImage2D(GL_TEXTURE_2D, 0, state.colour_format,
+			state.canvas_size.width, state.canvas_size.height, 0, GL_RGB, GL_FLOAT, NULL);
+	}
+
+	// Divergence texture.
+	glGenTextures(1, &state.divergence_texture);
+	glBindTexture(GL_TEXTURE_2D, state.divergence_texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, state.divergence_format,
+		state.simulation_size.width, state.simulation_size.height, 0, GL_RED, GL_FLOAT, NULL);
+
+	// Pressure texture.
+	glGenTextures(2, state.pressure_texture.buffers);
+	GLuint pressure_textures[] = { state.pressure_texture.back(), state.pressure_texture.front() };
+	for (GLuint texture : pressure_textures) {
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, state.pressure_format,
+			state.simulation_size.width, state.simulation_size.height, 0, GL_RED, GL_FLOAT, NULL);
+	}
+
+	initializeFields();
+
+	// Multigrid levels, coarsened while the grid splits into the interleaved
+	// lattices of the pressure stencil, see restriction.frag.
+	Size level_size = state.simulation_size;
+	while (level_size.width % 2 == 0 && level_size.height % 2 == 0
+		&& level_size.width >= 16 && level_size.height >= 16) {
+		level_size = Size(level_size.width / 4 * 2, level_size.height / 4 * 2);
+
+		MultigridLevel level;
+		level.size = level_size;
+		glGenTextures(1, &level.rhs_texture);
+		glGenTextures(2, level.pressure_texture.buffers);
+		GLuint textures[] = {
+			level.rhs_texture, level.pressure_texture.back(), level.pressure_texture.front() };
+		for (GLuint texture : textures) {
+			glBindTexture(GL_TEXTURE_2D, texture);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexImage2D(GL_TEXTURE_2D, 0, state.pressure_format,
+				level_size.width, level_size.height, 0, GL_RED, GL_FLOAT, NULL);
+		}
+		state.multigrid_levels.push_back(level);
+	}
+
+	// Residual texture, with a full mip chain for the reduction.
+	state.residual_levels = 1;
+	while ((std::max(state.simulation_size.width, state.simulation_size.height) >> state.residual_levels) > 0) {
+		++state.residual_levels;
+	}
+	glGenTextures(1, &state.residual_texture);
+	glBindTexture(GL_TEXTURE_2D, state.residual_texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F,
+		state.simulation_size.width, state.simulation_size.height, 0, GL_RED, GL_FLOAT, NULL);
+	glGenerateMipmap(GL_TEXTURE_2D);
+
+	// Sparse tile buffers, the tiles also have to cover the colour texels past
+	// a multiple of the divisor.
+	int colour_tile_size = kSparseTileSize * state.simulation_divisor;
+	state.tile_grid = Size(
+		std::max((state.simulation_size.width + kSparseTileSize - 1) / kSparseTileSize,
+			(state.canvas_size.width + colour_tile_size - 1) / colour_tile_size),
+		std::max((state.simulation_size.height + kSparseTileSize - 1) / kSparseTileSize,
+			(state.canvas_size.height + colour_tile_size - 1) / colour_tile_size));
+	// Only the compute backend uses them, shader storage buffers need GL 4.3.
+	GLuint tile_buffers[5] = { 0, 0, 0, 0, 0 };
+	if (state.compute_supported) {
+		GLsizeiptr tile_bytes = state.tile_grid.area() * sizeof(GLuint);
+		glGenBuffers(5, tile_buffers);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, tile_buffers[0]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, 12 * sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+		for (int i = 1; i < 5; ++i) {
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, tile_buffers[i]);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, tile_bytes, NULL, GL_DYNAMIC_COPY);
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+	state.tile_command_buffer = tile_buffers[0];
+	state.tile_moving_buffer = tile_buffers[1];
+	state.tile_active_buffer = tile_buffers[2];
+	state.active_tile_buffer = tile_buffers[3];
+	state.settle_tile_buffer = tile_buffers[4];
+	state.sparse_last_step = false;
+}
+
+void deleteFields() {
+	glDeleteTextures(2, state.velocity_texture.buffers);
+	glDeleteTextures(2, state.colour_texture.buffers);
+	glDeleteTextures(1, &state.divergence_texture);
+	glDeleteTextures(2, state.pressure_texture.buffers);
+	glDeleteTextures(1, &state.residual_texture);
+	if (state.advected_velocity_texture) {
+		glDeleteTextures(1, &state.advected_velocity_texture);
+		glDeleteTextures(1, &state.advected_colour_texture);
+		state.advected_velocity_texture = 0;
+		state.advected_colour_texture = 0;
+	}
+	for (MultigridLevel &level : state.multigrid_levels) {
+		glDeleteTextures(1, &level.rhs_texture);
+		glDeleteTextures(2, level.pressure_texture.buffers);
+	}
+	state.multigrid_levels.clear();
+
+	GLuint tile_buffers[] = { state.tile_command_buffer, state.tile_moving_buffer,
+		state.tile_active_buffer, state.active_tile_buffer, state.settle_tile_buffer };
+	glDeleteBuffers(5, tile_buffers);
+}
+
+const char *precisionName(Precision precision) {
+	switch (precision) {
+		case Precision::Full: return "full";
+		case Precision::Half: return "half";
+		case Precision::Packed: return "packed";
+	}
+	return "";
+}
+
+// Sets the field formats of a preset, takes effect from the next
+// createFields(). Pressure keeps R32F in every preset since the solvers
+// accumulate many small corrections into it.
+void applyPrecision(Precision precision) {
+	switch (precision) {
+		case Precision::Full:
+			state.velocity_format = GL_RG32F;
+			state.colour_format = GL_RGBA32F;
+			state.divergence_format = GL_R32F;
+			state.pressure_format = GL_R32F;
+			break;
+		case Precision::Half:
+			state.velocity_format = GL_RG16F;
+			state.colour_format = GL_RGBA16F;
+			state.divergence_format = GL_R16F;
+			state.pressure_format = GL_R32F;
+			break;
+		case Precision::Packed:
+			state.velocity_format = GL_RG16F;
+			state.colour_format = GL_RGB10_A2;
+			state.divergence_format = GL_R16F;
+			state.pressure_format = GL_R32F;
+			break;
+	}
+}
+
+// Sets |format| from an image format qualifier with |components| channels,
+// an empty qualifier leaves it unchanged.
+bool overrideFormat(const std::string &qualifier, int components, GLenum *format) {
+	if (qualifier.empty()) {
+		return true;
 	}
+	GLenum override_format = internalFormatFromQualifier(qualifier);
+	int channels = qualifier == "rgb10_a2" ? 4 : (int)qualifier.find_first_of("0123456789");
+	if (override_format == GL_NONE || channels != components) {
+		fprintf(stderr, "Unsupported format %s\n", qualifier.c_str());
+		return false;
+	}
+	*format = override_format;
+	return true;
 }
 
 void init() {
@@ -409,159 +2151,1048 @@ void init() {
 	glClearColor(0.0, 0.0, 0.0, 0.0);
 	glClear(GL_COLOR_BUFFER_BIT);
 
-	glutDisplayFunc(tick);
-
-	glutIgnoreKeyRepeat(1);
-	glutMotionFunc(handleMouseMove);
-	glutMouseFunc(handleMouseButton);
-	glutKeyboardFunc(handlePressNormalKeys);
+	auto start = std::chrono::steady_clock::now();
+
+	// Every program is built up front, see ProgramBatch.
+	enableParallelShaderCompile();
+	ProgramBatch programs(state.shader_cache);
+	programs.add(&state.advection_shader.program, "advection.vert", "advection.frag");
+	programs.add(&state.fused_advection_shader.program, "fused_advection.vert", "fused_advection.frag");
+	programs.add(&state.render_shader.program, "render.vert", "render.frag");
+	programs.add(&state.vector_field_shader.program, "vector_field.vert", "vector_field.frag");
+	programs.add(&state.divergence_shader.program, "divergence.vert", "divergence.frag");
+	programs.add(&state.pressure_shader.program, "pressure.vert", "pressure.frag");
+	programs.add(&state.residual_shader.program, "residual.vert", "residual.frag");
+	programs.add(&state.scale_shader.program, "scale.vert", "scale.frag");
+	programs.add(&state.restriction_shader.program, "restriction.vert", "restriction.frag");
+	programs.add(&state.prolongation_shader.program, "prolongation.vert", "prolongation.frag");
+	programs.add(&state.velocity_normalization_shader.program, "velocity_normalization.vert", "velocity_normalization.frag");
+	programs.add(&state.maccormack_shader.program, "maccormack.vert", "maccormack.frag");
+	programs.add(&state.splat_shader.program, "splat.vert", "splat.frag");
+	programs.add(&state.init_fields_shader.program, "init_fields.vert", "init_fields.frag");
+	addComputeShaders(programs);
+	programs.link();
+	state.startup.programs = programs.stats();
 
 	// Advection shader.
-	state.advection_shader.program = glLoadShader("advection.vert", "advection.frag");
 	state.advection_shader.velocity_uniform = glGetUniform(state.advection_shader, "velocity_sampler");
 	state.advection_shader.colour_uniform = glGetUniform(state.advection_shader, "colour_sampler");
 	state.advection_shader.grid_size_uniform = glGetUniform(state.advection_shader, "grid_size");
+	state.advection_shader.velocity_grid_size_uniform = glGetUniform(state.advection_shader, "velocity_grid_size");
+	state.advection_shader.bicubic_velocity_uniform = glGetUniform(state.advection_shader, "bicubic_velocity");
 	state.advection_shader.mouse_position_uniform = glGetUniform(state.advection_shader, "mouse_position");
 	state.advection_shader.mouse_impulse_uniform = glGetUniform(state.advection_shader, "mouse_impulse");
 	state.advection_shader.impulse_radius_uniform = glGetUniform(state.advection_shader, "impulse_radius");
 	state.advection_shader.timestep_uniform = glGetUniform(state.advection_shader, "timestep");
 
+	// Fused advection and divergence shader.
+	state.fused_advection_shader.velocity_uniform = glGetUniform(state.fused_advection_shader, "velocity_sampler");
+	state.fused_advection_shader.colour_uniform = glGetUniform(state.fused_advection_shader, "colour_sampler");
+	state.fused_advection_shader.grid_size_uniform = glGetUniform(state.fused_advection_shader, "grid_size");
+	state.fused_advection_shader.velocity_grid_size_uniform = glGetUniform(state.fused_advection_shader, "velocity_grid_size");
+	state.fused_advection_shader.bicubic_velocity_uniform = glGetUniform(state.fused_advection_shader, "bicubic_velocity");
+	state.fused_advection_shader.mouse_position_uniform = glGetUniform(state.fused_advection_shader, "mouse_position");
+	state.fused_advection_shader.mouse_impulse_uniform = glGetUniform(state.fused_advection_shader, "mouse_impulse");
+	state.fused_advection_shader.impulse_radius_uniform = glGetUniform(state.fused_advection_shader, "impulse_radius");
+	state.fused_advection_shader.timestep_uniform = glGetUniform(state.fused_advection_shader, "timestep");
+	state.fused_advection_shader.divergence_timestep_uniform = glGetUniform(state.fused_advection_shader, "divergence_timestep");
+
 	// Render shader.
-	state.render_shader.program = glLoadShader("render.vert", "render.frag");
 	state.render_shader.velocity_uniform = glGetUniform(state.render_shader, "velocity_sampler");
 	state.render_shader.colour_uniform = glGetUniform(state.render_shader, "colour_sampler");
 	state.render_shader.grid_size_uniform = glGetUniform(state.render_shader, "grid_size");
+	state.render_shader.velocity_grid_size_uniform = glGetUniform(state.render_shader, "velocity_grid_size");
+	state.render_shader.quality_uniform = glGetUniform(state.render_shader, "quality");
+
+	glGenSamplers(1, &state.colour_mip_sampler);
+	glSamplerParameteri(state.colour_mip_sampler, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glSamplerParameteri(state.colour_mip_sampler, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glSamplerParameteri(state.colour_mip_sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glSamplerParameteri(state.colour_mip_sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 
 	// Velocity Indicator shader.
-	state.vector_field_shader.program = glLoadShader("vector_field.vert", "vector_field.frag");
 	state.vector_field_shader.vector_field_uniform = glGetUniform(state.vector_field_shader, "vector_field");
 	state.vector_field_shader.colour_uniform = glGetUniform(state.vector_field_shader, "colour");
+	state.vector_field_shader.scalar_field_uniform = glGetUniform(state.vector_field_shader, "scalar_field");
+	state.vector_field_shader.triangle_grid_uniform = glGetUniform(state.vector_field_shader, "triangle_grid");
+	glGenVertexArrays(1, &state.indicator_vertex_array);
 
 	// Divergence shader.
-	state.divergence_shader.program = glLoadShader("divergence.vert", "divergence.frag");
 	state.divergence_shader.velocity_uniform = glGetUniform(state.divergence_shader, "velocity_sampler");
 	state.divergence_shader.grid_size_uniform = glGetUniform(state.divergence_shader, "grid_size");
 	state.divergence_shader.timestep_uniform = glGetUniform(state.divergence_shader, "timestep");
 
 	// Pressure shader.
-	state.pressure_shader.program = glLoadShader("pressure.vert", "pressure.frag");
 	state.pressure_shader.divergence_uniform = glGetUniform(state.pressure_shader, "divergence_sampler");
 	state.pressure_shader.grid_size_uniform = glGetUniform(state.pressure_shader, "grid_size");
 	state.pressure_shader.pressure_uniform = glGetUniform(state.pressure_shader, "pressure_sampler");
+	state.pressure_shader.relaxation_uniform = glGetUniform(state.pressure_shader, "relaxation");
+
+	// Residual shader.
+	state.residual_shader.divergence_uniform = glGetUniform(state.residual_shader, "divergence_sampler");
+	state.residual_shader.pressure_uniform = glGetUniform(state.residual_shader, "pressure_sampler");
+	state.residual_shader.grid_size_uniform = glGetUniform(state.residual_shader, "grid_size");
+
+	// Scale shader.
+	state.scale_shader.field_uniform = glGetUniform(state.scale_shader, "field_sampler");
+	state.scale_shader.grid_size_uniform = glGetUniform(state.scale_shader, "grid_size");
+	state.scale_shader.scale_uniform = glGetUniform(state.scale_shader, "scale");
+
+	// Multigrid restriction shader.
+	state.restriction_shader.divergence_uniform = glGetUniform(state.restriction_shader, "divergence_sampler");
+	state.restriction_shader.pressure_uniform = glGetUniform(state.restriction_shader, "pressure_sampler");
+	state.restriction_shader.grid_size_uniform = glGetUniform(state.restriction_shader, "grid_size");
+
+	// Multigrid prolongation shader.
+	state.prolongation_shader.pressure_uniform = glGetUniform(state.prolongation_shader, "pressure_sampler");
+	state.prolongation_shader.correction_uniform = glGetUniform(state.prolongation_shader, "correction_sampler");
+	state.prolongation_shader.grid_size_uniform = glGetUniform(state.prolongation_shader, "grid_size");
+	state.prolongation_shader.coarse_grid_size_uniform = glGetUniform(state.prolongation_shader, "coarse_grid_size");
 
 	// Velocity Normalization shader.
-	state.velocity_normalization_shader.program = glLoadShader("velocity_normalization.vert", "velocity_normalization.frag");
 	state.velocity_normalization_shader.velocity_uniform = glGetUniform(state.velocity_normalization_shader, "velocity_sampler");
 	state.velocity_normalization_shader.pressure_uniform = glGetUniform(state.velocity_normalization_shader, "pressure_sampler");
 	state.velocity_normalization_shader.grid_size_uniform = glGetUniform(state.velocity_normalization_shader, "grid_size");
 	state.velocity_normalization_shader.timestep_uniform = glGetUniform(state.velocity_normalization_shader, "timestep");
 
-	// Velocity texture.
-	glGenTextures(2, state.velocity_texture.buffers);
-	GLfloat *velocity_data = new GLfloat[state.canvas_size.area() * 3]();
-	glBindTexture(GL_TEXTURE_2D, state.velocity_texture.back());
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F,
-		state.canvas_size.width, state.canvas_size.height, 0, GL_RGB, GL_FLOAT, velocity_data);
-	for (int x = 0; x < state.canvas_size.width; ++x) {
-		for (int y = 0; y < state.canvas_size.height; ++y) {
-			int i = (x + y * state.canvas_size.width) * 3;
-			velocity_data[i + 0] = 0;
-			velocity_data[i + 1] = 0;
-			velocity_data[i + 2] = 0;
-		}
-	}
-	glBindTexture(GL_TEXTURE_2D, state.velocity_texture.front());
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F,
-		state.canvas_size.width, state.canvas_size.height, 0, GL_RGB, GL_FLOAT, velocity_data);
-	delete[] velocity_data;
-
-	// Colour texture.
-	glGenTextures(2, state.colour_texture.buffers);
-	GLfloat *colour_data = new GLfloat[state.canvas_size.area() * 3]();
-	glBindTexture(GL_TEXTURE_2D, state.colour_texture.back());
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F,
-		state.canvas_size.width, state.canvas_size.height, 0, GL_RGB, GL_FLOAT, colour_data);
-	for (int x = 0; x < state.canvas_size.width; ++x) {
-		for (int y = 0; y < state.canvas_size.height; ++y) {
-			int i = (x + y * state.canvas_size.width) * 3;
-			colour_data[i + 0] = ((x + y) % 100) < 50;
-			colour_data[i + 1] = (x % 100) < 50;
-			colour_data[i + 2] = (y % 100) < 50;
-		}
-	}
-	glBindTexture(GL_TEXTURE_2D, state.colour_texture.front());
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F,
-		state.canvas_size.width, state.canvas_size.height, 0, GL_RGB, GL_FLOAT, colour_data);
-	delete[] colour_data;
-
-	// Divergence texture.
-	glGenTextures(1, &state.divergence_texture);
-	GLfloat *divergence_data = new GLfloat[state.canvas_size.area() * 3]();
-	glBindTexture(GL_TEXTURE_2D, state.divergence_texture);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F,
-		state.canvas_size.width, state.canvas_size.height, 0, GL_RGB, GL_FLOAT, divergence_data);
-	delete[] divergence_data;
-
-	// Pressure texture.
-	glGenTextures(2, state.pressure_texture.buffers);
-	GLfloat *pressure_data = new GLfloat[state.canvas_size.area() * 3]();
-	glBindTexture(GL_TEXTURE_2D, state.pressure_texture.back());
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F,
-		state.canvas_size.width, state.canvas_size.height, 0, GL_RGB, GL_FLOAT, pressure_data);
-	glBindTexture(GL_TEXTURE_2D, state.pressure_texture.front());
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F,
-		state.canvas_size.width, state.canvas_size.height, 0, GL_RGB, GL_FLOAT, pressure_data);
-	delete[] pressure_data;
+	// MacCormack advection correction shader.
+	state.maccormack_shader.field_uniform = glGetUniform(state.maccormack_shader, "field_sampler");
+	state.maccormack_shader.advected_uniform = glGetUniform(state.maccormack_shader, "advected_sampler");
+	state.maccormack_shader.velocity_uniform = glGetUniform(state.maccormack_shader, "velocity_sampler");
+	state.maccormack_shader.grid_size_uniform = glGetUniform(state.maccormack_shader, "grid_size");
+	state.maccormack_shader.velocity_grid_size_uniform = glGetUniform(state.maccormack_shader, "velocity_grid_size");
+	state.maccormack_shader.bicubic_velocity_uniform = glGetUniform(state.maccormack_shader, "bicubic_velocity");
+	state.maccormack_shader.mouse_position_uniform = glGetUniform(state.maccormack_shader, "mouse_position");
+	state.maccormack_shader.impulse_radius_uniform = glGetUniform(state.maccormack_shader, "impulse_radius");
+	state.maccormack_shader.timestep_uniform = glGetUniform(state.maccormack_shader, "timestep");
+
+	// Emitter splat shader.
+	state.splat_shader.grid_size_uniform = glGetUniform(state.splat_shader, "grid_size");
+	state.splat_shader.grid_scale_uniform = glGetUniform(state.splat_shader, "grid_scale");
+	state.splat_shader.dye_pass_uniform = glGetUniform(state.splat_shader, "dye_pass");
+	glUniformBlockBinding(state.splat_shader.program,
+		glGetUniformBlockIndex(state.splat_shader.program, "EmitterBlock"), 0);
+
+	// Starts with a batch so it can always be bound.
+	glGenBuffers(1, &state.emitter_buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, state.emitter_buffer);
+	state.emitter_buffer_capacity = kMaxEmittersPerBatch;
+	glBufferData(GL_UNIFORM_BUFFER, state.emitter_buffer_capacity * sizeof(GpuEmitter), nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	auto fields_start = std::chrono::steady_clock::now();
+	createFields();
+	glFinish();
+	state.startup.field_seconds = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - fields_start).count();
+	getComputeUniforms();
 
 	glGenFramebuffers(1, &state.advection_buffer);
 	glGenFramebuffers(1, &state.divergence_buffer);
 	glGenFramebuffers(1, &state.pressure_buffer);
+	glGenFramebuffers(1, &state.residual_buffer);
+	glGenFramebuffers(1, &state.splat_buffer);
 	glGenFramebuffers(1, &state.velocity_normalization_buffer);
+
+	// Per-stage timer queries.
+	state.stages.splat = state.profiler.addStage("splat");
+	state.stages.tiles = state.profiler.addStage("tiles");
+	state.stages.advect = state.profiler.addStage("advect");
+	state.stages.divergence = state.profiler.addStage("divergence");
+	state.stages.pressure = state.profiler.addStage("pressure");
+	state.stages.normalize = state.profiler.addStage("normalize");
+	state.stages.render = state.profiler.addStage("render");
+	state.stages.indicators = state.profiler.addStage("indicators");
+	state.stages.frame = state.profiler.addStage("frame");
+	state.gpu_timer.init(&state.profiler);
+	state.last_frame_time = std::chrono::steady_clock::now();
+
+	state.snapshot_readback.init(kSnapshotFieldCount);
+	state.stream_readback.init(3);
+
+	state.startup.seconds = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+// Deletes every program built by init() and zeroes its name, which a later
+// init() may hand out again.
+void deletePrograms() {
+	Shader *shaders[] = {
+		&state.advection_shader, &state.fused_advection_shader, &state.render_shader,
+		&state.vector_field_shader, &state.divergence_shader, &state.pressure_shader,
+		&state.velocity_normalization_shader, &state.residual_shader, &state.scale_shader,
+		&state.restriction_shader, &state.prolongation_shader, &state.splat_shader,
+		&state.maccormack_shader, &state.init_fields_shader,
+		&state.advection_compute_shader, &state.divergence_compute_shader,
+		&state.pressure_compute_shader, &state.velocity_normalization_compute_shader,
+		&state.tile_list_shader, &state.tile_settle_shader };
+	for (Shader *shader : shaders) {
+		glDeleteProgram(shader->program);
+		shader->program = 0;
+	}
 }
 
 void cleanup() {
-	glDeleteTextures(2, state.velocity_texture.buffers);
-	glDeleteTextures(2, state.colour_texture.buffers);
-	glDeleteTextures(1, &state.divergence_texture);
-	glDeleteTextures(2, state.pressure_texture.buffers);
+	finishSnapshot();
+	stopStream();
+	state.frame_capture.stop();
+	state.snapshot_readback.destroy();
+	state.stream_readback.destroy();
+	deleteFields();
 	glDeleteFramebuffers(1, &state.advection_buffer);
 	glDeleteFramebuffers(1, &state.divergence_buffer);
 	glDeleteFramebuffers(1, &state.pressure_buffer);
+	glDeleteFramebuffers(1, &state.residual_buffer);
+	glDeleteFramebuffers(1, &state.splat_buffer);
 	glDeleteFramebuffers(1, &state.velocity_normalization_buffer);
+	glDeleteBuffers(1, &state.emitter_buffer);
+	state.gpu_timer.destroy();
+	glDeleteVertexArrays(1, &state.indicator_vertex_array);
+	glDeleteSamplers(1, &state.colour_mip_sampler);
+	deletePrograms();
+}
+
+// Prints where init() spent its time.
+void printStartup() {
+	const StartupStats &startup = state.startup;
+	printf("startup %.1f ms, %d programs from the cache and %d compiled in %.1f ms, fields %.1f ms\n",
+		startup.seconds * 1000, startup.programs.cached, startup.programs.compiled,
+		startup.programs.seconds * 1000, startup.field_seconds * 1000);
+}
+
+// Writes RGB float rows, bottom up, as a binary PPM.
+bool writePpm(const char *path, const GLfloat *colour_data, Size size) {
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		return false;
+	}
+	fprintf(file, "P6\n%d %d\n255\n", size.width, size.height);
+
+	// PPM rows run top to bottom.
+	std::vector<unsigned char> row(size.width * 3);
+	for (int y = size.height - 1; y >= 0; --y) {
+		const GLfloat *src = &colour_data[y * size.width * 3];
+		for (int i = 0; i < size.width * 3; ++i) {
+			row[i] = (unsigned char)(std::min(std::max(src[i], 0.0f), 1.0f) * 255 + 0.5f);
+		}
+		fwrite(&row[0], 1, row.size(), file);
+	}
+
+	fclose(file);
+	return true;
+}
+
+// Writes the colour field as a binary PPM.
+bool writeColourField(const char *path) {
+	std::vector<GLfloat> colour_data(state.canvas_size.area() * 3);
+	glBindTexture(GL_TEXTURE_2D, state.colour_texture.front());
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, &colour_data[0]);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	return writePpm(path, &colour_data[0], state.canvas_size);
+}
+
+// Renders |frames| frames at every quality and prints their GPU time.
+void benchmarkRenderQuality(int frames) {
+	RenderQuality saved_quality = state.render_quality;
+
+	printf("%-10s %9s %9s %9s\n", "quality", "p50 ms", "p95 ms", "wall ms");
+	for (int quality = 0; quality < 3; ++quality) {
+		state.render_quality = (RenderQuality)quality;
+		state.profiler.clear();
+
+		glFinish();
+		auto start = std::chrono::steady_clock::now();
+		for (int frame = 0; frame < frames; ++frame) {
+			state.gpu_timer.beginFrame();
+			render();
+		}
+		glFinish();
+		double wall_ms = std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - start).count();
+		state.gpu_timer.finish();
+
+		const RollingHistogram &histogram = state.profiler.histogram(state.stages.render);
+		printf("%-10s %9.3f %9.3f %9.3f\n", renderQualityName(state.render_quality),
+			histogram.percentile(50), histogram.percentile(95), wall_ms / frames);
+	}
+
+	state.render_quality = saved_quality;
+}
+
+// The simulation fields read back as floats, see precisionReport().
+struct FieldSnapshot
+{
+	std::vector<GLfloat> colour; // RGB, the alpha is unused.
+	std::vector<GLfloat> velocity;
+	std::vector<GLfloat> pressure;
+	double ms_per_step = 0;
+};
+
+std::vector<GLfloat> readField(GLuint texture, GLenum format, int components, Size size) {
+	std::vector<GLfloat> data(size.area() * components);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glGetTexImage(GL_TEXTURE_2D, 0, format, GL_FLOAT, &data[0]);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return data;
+}
+
+FieldSnapshot readFields() {
+	FieldSnapshot snapshot;
+	snapshot.colour = readField(state.colour_texture.front(), GL_RGB, 3, state.canvas_size);
+	snapshot.velocity = readField(state.velocity_texture.front(), GL_RG, 2, state.simulation_size);
+	snapshot.pressure = readField(state.pressure_texture.front(), GL_RED, 1, state.simulation_size);
+	return snapshot;
+}
+
+// Texture memory of each field in the current formats, including both copies
+// of flip buffers, the colour mips and the multigrid levels.
+struct FieldMemory
+{
+	size_t colour = 0;
+	size_t velocity = 0;
+	size_t divergence = 0;
+	size_t pressure = 0;
+
+	size_t total() const { return colour + velocity + divergence + pressure; }
+};
+
+FieldMemory fieldMemory() {
+	size_t colour_texels = 0;
+	for (int level = 0; level < state.colour_mip_levels; ++level) {
+		colour_texels += (size_t)std::max(state.canvas_size.width >> level, 1)
+			* std::max(state.canvas_size.height >> level, 1);
+	}
+	size_t pressure_texels = (size_t)state.simulation_size.area() * 2;
+	for (const MultigridLevel &level : state.multigrid_levels) {
+		pressure_texels += (size_t)level.size.area() * 3;
+	}
+
+	FieldMemory memory;
+	memory.colour = colour_texels * 2 * bytesPerTexel(state.colour_format);
+	memory.velocity = (size_t)state.simulation_size.area() * 2 * bytesPerTexel(state.velocity_format);
+	memory.divergence = (size_t)state.simulation_size.area() * bytesPerTexel(state.divergence_format);
+	if (state.advected_velocity_texture) {
+		memory.colour += (size_t)state.canvas_size.area() * bytesPerTexel(state.colour_format);
+		memory.velocity += (size_t)state.simulation_size.area() * bytesPerTexel(state.velocity_format);
+	}
+	memory.pressure = pressure_texels * bytesPerTexel(state.pressure_format);
+	return memory;
+}
+
+void printFieldError(const char *name, const std::vector<GLfloat> &field,
+	const std::vector<GLfloat> &reference, size_t bytes, size_t reference_bytes) {
+	double error_sum = 0;
+	double reference_sum = 0;
+	double max_error = 0;
+	for (size_t i = 0; i < field.size(); ++i) {
+		double error = std::abs((double)field[i] - reference[i]);
+		error_sum += error * error;
+		reference_sum += (double)reference[i] * reference[i];
+		max_error = std::max(max_error, error);
+	}
+	double rms = std::sqrt(error_sum / field.size());
+	double reference_rms = std::sqrt(reference_sum / field.size());
+	printf("%-10s %12.3g %12.3g %10.3g%% %8.2f %8.2f\n", name, rms, max_error,
+		reference_rms > 0 ? rms / reference_rms * 100 : 0.0,
+		reference_bytes / 1048576.0, bytes / 1048576.0);
+}
+
+// Compares the fields after a run at the current formats against a full
+// precision |reference| of the same run.
+void precisionReport(const FieldSnapshot &reference, const FieldMemory &reference_memory,
+	double ms_per_step) {
+	FieldSnapshot snapshot = readFields();
+	FieldMemory memory = fieldMemory();
+
+	printf("precision report against full precision (velocity %s, colour %s, divergence %s, pressure %s)\n",
+		imageFormatQualifier(state.velocity_format), imageFormatQualifier(state.colour_format),
+		imageFormatQualifier(state.divergence_format), imageFormatQualifier(state.pressure_format));
+	printf("%-10s %12s %12s %11s %8s %8s\n", "field", "rms error", "max error", "relative", "fp32 MB", "MB");
+	printFieldError("colour", snapshot.colour, reference.colour, memory.colour, reference_memory.colour);
+	printFieldError("velocity", snapshot.velocity, reference.velocity, memory.velocity, reference_memory.velocity);
+	printFieldError("pressure", snapshot.pressure, reference.pressure, memory.pressure, reference_memory.pressure);
+	printf("%-10s %46.2f %8.2f\n", "divergence",
+		reference_memory.divergence / 1048576.0, memory.divergence / 1048576.0);
+	printf("%-10s %46.2f %8.2f\n", "total", reference_memory.total() / 1048576.0, memory.total() / 1048576.0);
+	printf("%.3f ms/step, %.3f ms/step at full precision\n", ms_per_step, reference.ms_per_step);
+}
+
+void headlessStep(const RunConfig &config) {
+	state.last_mouse_pos = Point2(config.impulse_x, config.impulse_y);
+	state.mouse_frame_impulse = Vector2(config.impulse_dx, config.impulse_dy);
+
+	state.gpu_timer.beginFrame();
+	update();
+}
+
+// Mean squared difference between neighbouring dye texels, which blurring
+// removes first.
+double dyeGradientEnergy(const std::vector<GLfloat> &colour, Size size) {
+	double energy = 0;
+	for (int y = 0; y < size.height; ++y) {
+		for (int x = 0; x < size.width; ++x) {
+			int i = (y * size.width + x) * 3;
+			int right = (y * size.width + (x + 1) % size.width) * 3;
+			int up = (((y + 1) % size.height) * size.width + x) * 3;
+			for (int c = 0; c < 3; ++c) {
+				double dx = (double)colour[right + c] - colour[i + c];
+				double dy = (double)colour[up + c] - colour[i + c];
+				energy += dx * dx + dy * dy;
+			}
+		}
+	}
+	return energy / size.area();
+}
+
+// Mean squared velocity in canvas pixels per step.
+double kineticEnergy(const std::vector<GLfloat> &velocity) {
+	double energy = 0;
+	for (GLfloat component : velocity) {
+		energy += (double)component * component;
+	}
+	double scale = state.simulation_divisor;
+	return velocity.empty() ? 0.0 : energy * scale * scale / (velocity.size() / 2);
+}
+
+double colourRmsDifference(const std::vector<GLfloat> &colour, const std::vector<GLfloat> &reference) {
+	double sum = 0;
+	for (size_t i = 0; i < colour.size(); ++i) {
+		double difference = (double)colour[i] - reference[i];
+		sum += difference * difference;
+	}
+	return colour.empty() ? 0.0 : std::sqrt(sum / colour.size());
+}
+
+// Runs |config.steps| with each scheme and grid in turn and prints how much
+// dye detail and kinetic energy survive against semi-Lagrangian advection at
+// the configured grid, with the step time and field memory of each.
+void advectionReport(const RunConfig &config) {
+	struct Variant
+	{
+		AdvectionScheme scheme;
+		int divisor;
+	};
+	Variant variants[] = {
+		{ AdvectionScheme::SemiLagrangian, config.simulation_divisor },
+		{ AdvectionScheme::SemiLagrangian, config.simulation_divisor * 2 },
+		{ AdvectionScheme::MacCormack, config.simulation_divisor * 2 },
+		{ AdvectionScheme::MacCormack, config.simulation_divisor },
+	};
+
+	FieldSnapshot reference;
+	double reference_gradient = 0;
+	double reference_kinetic = 0;
+	printf("advection report, %d steps at %dx%d\n", config.steps, config.width, config.height);
+	printf("%-16s %10s %9s %8s %10s %10s %10s\n",
+		"scheme", "grid", "ms/step", "MB", "detail", "kinetic", "rms diff");
+	for (const Variant &variant : variants) {
+		state.advection_scheme = variant.scheme;
+		state.simulation_divisor = variant.divisor;
+		state.simulation_size = state.canvas_size / state.simulation_divisor;
+		deleteFields();
+		createFields();
+		loadComputeShaders();
+		state.step = 0;
+
+		glFinish();
+		auto start = std::chrono::steady_clock::now();
+		for (int step = 0; step < config.steps; ++step) {
+			headlessStep(config);
+		}
+		glFinish();
+		double ms = std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - start).count();
+		state.gpu_timer.finish();
+		state.profiler.clear();
+
+		FieldSnapshot snapshot = readFields();
+		double gradient = dyeGradientEnergy(snapshot.colour, state.canvas_size);
+		double kinetic = kineticEnergy(snapshot.velocity);
+		if (&variant == &variants[0]) {
+			reference = snapshot;
+			reference_gradient = gradient;
+			reference_kinetic = kinetic;
+		}
+
+		char grid[32];
+		snprintf(grid, sizeof(grid), "%dx%d", state.simulation_size.width, state.simulation_size.height);
+		printf("%-16s %10s %9.3f %8.2f %9.1f%% %9.1f%% %10.4f\n",
+			advectionSchemeName(variant.scheme), grid,
+			config.steps > 0 ? ms / config.steps : 0.0, fieldMemory().total() / 1048576.0,
+			reference_gradient > 0 ? gradient / reference_gradient * 100 : 0.0,
+			reference_kinetic > 0 ? kinetic / reference_kinetic * 100 : 0.0,
+			colourRmsDifference(snapshot.colour, reference.colour));
+	}
+}
+
+// Runs |run| |steps| times and returns the wall time per step.
+double timeSteps(int steps, const std::function<void()> &run, const std::function<void()> &finish) {
+	finish();
+	auto start = std::chrono::steady_clock::now();
+	for (int step = 0; step < steps; ++step) {
+		run();
+	}
+	finish();
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	return steps > 0 ? ms / steps : 0.0;
+}
+
+// Interleaves member |member|'s rows of the CPU atlas as RGB.
+std::vector<GLfloat> cpuEnsembleColour(CpuEnsemble &ensemble, int member) {
+	int size = ensemble.size();
+	std::vector<GLfloat> colour((size_t)size * size * 3);
+	for (int y = 0; y < size; ++y) {
+		for (int x = 0; x < size; ++x) {
+			for (int c = 0; c < 3; ++c) {
+				colour[((size_t)y * size + x) * 3 + c] = ensemble.colour(c).front().at(x, member * size + y);
+			}
+		}
+	}
+	return colour;
+}
+
+// Steps every member of |config.ensemble| together for |config.steps| and
+// prints the combined throughput. With ensemble.report each member is also
+// run on its own through the single simulation path, CpuSolver or the GPU
+// pipeline with Jacobi pressure, for comparison.
+int runEnsemble(const RunConfig &config) {
+	const EnsembleSettings &settings = config.ensemble;
+	std::vector<EnsembleMember> members = ensembleMembers(config);
+	Size size(settings.size, settings.size);
+
+	auto writeMembers = [&](int step, const std::function<std::vector<GLfloat>(int member)> &colour) {
+		for (int member = 0; member < settings.members; ++member) {
+			char path[512];
+			snprintf(path, sizeof(path), "%s_m%03d_%06d.ppm", config.output_prefix.c_str(), member, step);
+			writePpm(path, &colour(member)[0], size);
+		}
+	};
+	bool output = config.output_interval > 0;
+
+	double ensemble_ms = 0;
+	double separate_ms = 0;
+	if (settings.cpu) {
+		CpuEnsemble ensemble(settings.size, members);
+		auto memberColour = [&](int member) { return cpuEnsembleColour(ensemble, member); };
+		for (int step = 0; step < config.steps; ++step) {
+			auto start = std::chrono::steady_clock::now();
+			ensemble.step();
+			ensemble_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			if (output && (step + 1) % config.output_interval == 0) {
+				writeMembers(step + 1, memberColour);
+			}
+		}
+
+		for (size_t i = 0; settings.report && i < members.size(); ++i) {
+			const EnsembleMember &member = members[i];
+			CpuSolver solver(settings.size, settings.size);
+			solver.settings.pressure.jacobi_iterations = member.jacobi_iterations;
+			solver.settings.advection_scale = member.advection_timestep * 60;
+			solver.settings.impulse_radius = member.impulse_radius;
+			separate_ms += timeSteps(config.steps, [&] {
+				solver.setImpulse(member.impulse_x, member.impulse_y, member.impulse_dx, member.impulse_dy);
+				solver.step(1 / 60.0f);
+			}, [] {});
+		}
+	} else {
+		OffscreenContext context;
+		if (!context.create(settings.size, settings.size)) {
+			return EXIT_FAILURE;
+		}
+		glewExperimental = GL_TRUE;
+		if (glewInit() != GLEW_OK) {
+			fprintf(stderr, "Failed to initialize GLEW\n");
+			return EXIT_FAILURE;
+		}
+		printf("%s, %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+
+		state.canvas_size = size;
+		state.simulation_size = size;
+		state.shader_cache = config.shader_cache;
+		init();
+		if (!state.compute_supported) {
+			fprintf(stderr, "Ensembles require compute shaders\n");
+			cleanup();
+			return EXIT_FAILURE;
+		}
+
+		GpuEnsemble ensemble;
+		if (!ensemble.create(settings.size, members)) {
+			cleanup();
+			return EXIT_FAILURE;
+		}
+		std::vector<GLfloat> colour;
+		auto memberColour = [&](int member) {
+			return std::vector<GLfloat>(colour.begin() + (size_t)member * size.area() * 3,
+				colour.begin() + (size_t)(member + 1) * size.area() * 3);
+		};
+		glFinish();
+		for (int step = 0; step < config.steps; ++step) {
+			auto start = std::chrono::steady_clock::now();
+			ensemble.step();
+			glFinish();
+			ensemble_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			if (output && (step + 1) % config.output_interval == 0) {
+				colour = ensemble.readColour();
+				writeMembers(step + 1, memberColour);
+			}
+		}
+		ensemble.destroy();
+
+		for (size_t i = 0; settings.report && i < members.size(); ++i) {
+			const EnsembleMember &member = members[i];
+			deleteFields();
+			createFields();
+			RunConfig single = config;
+			single.impulse_x = member.impulse_x;
+			single.impulse_y = member.impulse_y;
+			single.impulse_dx = member.impulse_dx;
+			single.impulse_dy = member.impulse_dy;
+			state.mouse_impulse_radius = member.impulse_radius;
+			state.pressure_settings = PressureSettings();
+			state.pressure_settings.jacobi_iterations = member.jacobi_iterations;
+			state.advection_timestep = member.advection_timestep;
+			state.backend = config.compute_backend ? Backend::Compute : Backend::Fragment;
+			separate_ms += timeSteps(config.steps, [&] { headlessStep(single); }, [] { glFinish(); });
+			state.gpu_timer.finish();
+		}
+		cleanup();
+	}
+
+	double ms_per_step = config.steps > 0 ? ensemble_ms / config.steps : 0.0;
+	double member_steps = (double)settings.members * config.steps;
+	printf("%d members of %dx%d, %d steps (%s)\n", settings.members, size.width, size.height,
+		config.steps, settings.cpu ? "cpu atlas" : "gpu texture array");
+	printf("total %.3f s, %.3f ms/step, %.1f member steps/s, %.1f Mcells/s\n",
+		ensemble_ms / 1000, ms_per_step,
+		ensemble_ms > 0 ? member_steps / ensemble_ms * 1000 : 0.0,
+		ensemble_ms > 0 ? member_steps * size.area() / ensemble_ms / 1000 : 0.0);
+	if (settings.report && separate_ms > 0) {
+		printf("%d separate runs %.3f ms/step (%s), speedup %.2fx\n",
+			settings.members, separate_ms,
+			settings.cpu ? "cpu solver" : config.compute_backend ? "compute backend" : "fragment backend",
+			ms_per_step > 0 ? separate_ms / ms_per_step : 0.0);
+	}
+	return EXIT_SUCCESS;
+}
+
+// Runs |config.steps| fixed timesteps in an offscreen context as fast as
+// the GPU allows and prints timing statistics.
+int runHeadless(const char *config_path) {
+	RunConfig config;
+	if (!loadRunConfig(config_path, &config)) {
+		return EXIT_FAILURE;
+	}
+	if (config.ensemble.members > 0) {
+		return runEnsemble(config);
+	}
+
+	if (!config.snapshot_input.empty()) {
+		Size canvas_size;
+		if (!readSnapshotSize(config.snapshot_input.c_str(), &canvas_size, &config.simulation_divisor)) {
+			return EXIT_FAILURE;
+		}
+		config.width = canvas_size.width;
+		config.height = canvas_size.height;
+	}
+
+	state.canvas_size = Size(config.width, config.height);
+	state.simulation_divisor = config.simulation_divisor;
+	state.simulation_size = state.canvas_size / state.simulation_divisor;
+	state.bicubic_velocity = config.bicubic_velocity;
+	state.pressure_settings = config.pressure;
+	state.fused_advection = config.fused_advection;
+	state.advection_scheme = config.advection;
+	state.sparse_tiles = config.sparse;
+	state.mouse_impulse_radius = config.impulse_radius;
+	state.stream_interval = std::max(1, config.stream_interval);
+	state.stream_keyframe_interval = config.stream_keyframe_interval;
+	state.capture_settings = config.capture;
+	state.shader_cache = config.shader_cache;
+
+	applyPrecision(config.precision);
+	if (!overrideFormat(config.velocity_format, 2, &state.velocity_format)
+		|| !overrideFormat(config.colour_format, 4, &state.colour_format)
+		|| !overrideFormat(config.divergence_format, 1, &state.divergence_format)
+		|| !overrideFormat(config.pressure_format, 1, &state.pressure_format)) {
+		return EXIT_FAILURE;
+	}
+	GLenum formats[] = {
+		state.velocity_format, state.colour_format, state.divergence_format, state.pressure_format };
+	if (config.precision_report) {
+		applyPrecision(Precision::Full);
+	}
+
+	OffscreenContext context;
+	if (!context.create(config.width, config.height)) {
+		return EXIT_FAILURE;
+	}
+	glewExperimental = GL_TRUE;
+	if (glewInit() != GLEW_OK) {
+		fprintf(stderr, "Failed to initialize GLEW\n");
+		return EXIT_FAILURE;
+	}
+	printf("%s, %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+
+	init();
+	printStartup();
+
+	if (config.compute_backend) {
+		if (!state.compute_supported) {
+			fprintf(stderr, "Compute shaders are not supported\n");
+			cleanup();
+			return EXIT_FAILURE;
+		}
+		state.backend = Backend::Compute;
+	} else if (config.sparse.enabled) {
+		fprintf(stderr, "Sparse tiles require the compute backend\n");
+		cleanup();
+		return EXIT_FAILURE;
+	}
+
+	if (config.advection_report) {
+		advectionReport(config);
+		cleanup();
+		return EXIT_SUCCESS;
+	}
+
+	// The reference run, after which the fields are recreated in the
+	// configured formats for the run proper.
+	FieldSnapshot reference;
+	FieldMemory reference_memory;
+	if (config.precision_report) {
+		glFinish();
+		auto reference_start = std::chrono::steady_clock::now();
+		for (int step = 0; step < config.steps; ++step) {
+			headlessStep(config);
+		}
+		glFinish();
+		double reference_ms = std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - reference_start).count();
+		state.gpu_timer.finish();
+		state.profiler.clear();
+
+		reference = readFields();
+		reference.ms_per_step = config.steps > 0 ? reference_ms / config.steps : 0.0;
+		reference_memory = fieldMemory();
+
+		state.velocity_format = formats[0];
+		state.colour_format = formats[1];
+		state.divergence_format = formats[2];
+		state.pressure_format = formats[3];
+		deleteFields();
+		createFields();
+		loadComputeShaders();
+		state.step = 0;
+	}
+
+	if (!config.snapshot_input.empty() && !restoreSnapshot(config.snapshot_input.c_str())) {
+		cleanup();
+		return EXIT_FAILURE;
+	}
+	if (!config.stream_output.empty() && !startStream(config.stream_output)) {
+		cleanup();
+		return EXIT_FAILURE;
+	}
+	if (!config.emitter_script.empty()
+		&& !state.emitter_script.load(config.emitter_script.c_str(), config.width, config.height)) {
+		cleanup();
+		return EXIT_FAILURE;
+	}
+	if (config.capture_enabled && !state.frame_capture.start(config.capture, config.width, config.height)) {
+		cleanup();
+		return EXIT_FAILURE;
+	}
+
+	// Output is written between steps and excluded from the step time.
+	double step_seconds = 0;
+	double output_seconds = 0;
+	int outputs = 0;
+	glFinish();
+	auto step_start = std::chrono::steady_clock::now();
+	for (int step = 0; step < config.steps; ++step) {
+		headlessStep(config);
+		if (state.frame_capture.isActive()) {
+			captureFrame(false);
+		}
+
+		if (config.output_interval > 0 && (step + 1) % config.output_interval == 0) {
+			glFinish();
+			auto output_start = std::chrono::steady_clock::now();
+			step_seconds += std::chrono::duration<double>(output_start - step_start).count();
+
+			char path[512];
+			snprintf(path, sizeof(path), "%s_%06d.ppm", config.output_prefix.c_str(), step + 1);
+			if (writeColourField(path)) {
+				++outputs;
+			}
+
+			step_start = std::chrono::steady_clock::now();
+			output_seconds += std::chrono::duration<double>(step_start - output_start).count();
+		}
+	}
+	glFinish();
+	step_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - step_start).count();
+
+	state.gpu_timer.finish();
+	stopStream();
+	state.frame_capture.stop();
+	if (!config.snapshot_output.empty()) {
+		requestSnapshot(config.snapshot_output);
+		finishSnapshot();
+	}
+
+	double cells = (double)state.simulation_size.area() * config.steps;
+	printf("%d steps of %dx%d simulated at %dx%d (%s backend, %s pressure, %s precision)\n", config.steps,
+		config.width, config.height, state.simulation_size.width, state.simulation_size.height,
+		state.backend == Backend::Compute ? "compute" : "fragment",
+		state.pressure_settings.solver == PressureSolver::Multigrid ? "multigrid" : "jacobi",
+		precisionName(config.precision));
+	if (sparseCompute()) {
+		printf("%d/%d tiles active after the last step\n", activeTileCount(), state.tile_grid.area());
+	}
+	printf("total %.3f s, %.3f ms/step, %.1f steps/s, %.1f Mcells/s\n",
+		step_seconds, config.steps > 0 ? step_seconds * 1000 / config.steps : 0.0,
+		step_seconds > 0 ? config.steps / step_seconds : 0.0,
+		step_seconds > 0 ? cells / step_seconds / 1e6 : 0.0);
+	if (outputs > 0) {
+		printf("wrote %d frames in %.3f s\n", outputs, output_seconds);
+	}
+
+	if (config.precision_report) {
+		precisionReport(reference, reference_memory, config.steps > 0 ? step_seconds * 1000 / config.steps : 0.0);
+	}
+
+	// GPU time per stage.
+	state.profiler.print();
+	if (!config.profile_output.empty()) {
+		const std::string &path = config.profile_output;
+		bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+		if (json ? !state.profiler.writeJson(path.c_str()) : !state.profiler.writeCsv(path.c_str())) {
+			cleanup();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (config.render_benchmark_frames > 0) {
+		benchmarkRenderQuality(config.render_benchmark_frames);
+	}
+
+	cleanup();
+	return EXIT_SUCCESS;
+}
+
+// Times restarting, cleanup() and init(), with the program cache bypassed
+// and then warm from the first init(). The driver may still have its own
+// cache of compiled shaders.
+void benchmarkStartup(const RunConfig &config, std::vector<BenchmarkResult> *results) {
+	std::string shader_cache = state.shader_cache;
+	auto measure = [&](const char *stage) {
+		results->push_back(measureStage(config.benchmark, "gl", state.canvas_size.width, stage, [] {
+			cleanup();
+			// init() adds its stages again.
+			state.profiler = StageProfiler();
+			init();
+		}, [] { glFinish(); }));
+		printf("gl %dx%d %s: %.3f ms\n", state.canvas_size.width, state.canvas_size.height,
+			stage, results->back().ms_per_frame);
+	};
+
+	state.shader_cache.clear();
+	measure("startup_uncached");
+	state.shader_cache = shader_cache;
+	measure("startup_cached");
+}
+
+// Measures each stage of |backend| in isolation, every pressure solver and
+// a full step at each benchmark size, see benchmarkCpuSolver().
+void benchmarkGpu(const RunConfig &config, Backend backend, std::vector<BenchmarkResult> *results) {
+	const BenchmarkSettings &settings = config.benchmark;
+	const char *name = backend == Backend::Compute ? "compute" : "fragment";
+	bool compute = backend == Backend::Compute;
+	auto finish = [] { glFinish(); };
+
+	state.backend = backend;
+	for (int size : settings.sizes) {
+		state.canvas_size = Size(size, size);
+		state.simulation_divisor = 1;
+		state.simulation_size = state.canvas_size;
+		deleteFields();
+		createFields();
+		loadComputeShaders();
+		state.step = 0;
+
+		// The impulse is configured for the config's canvas.
+		RunConfig scaled = config;
+		scaled.impulse_x *= (float)size / config.width;
+		scaled.impulse_y *= (float)size / config.height;
+		state.mouse_impulse_radius = config.impulse_radius * size / config.width;
+		for (int step = 0; step < settings.warmup_steps; ++step) {
+			headlessStep(scaled);
+		}
+
+		auto measure = [&](const char *stage, const std::function<void()> &run) {
+			results->push_back(measureStage(settings, name, size, stage, run, finish));
+			printf("%s %dx%d %s: %.3f ms\n", name, size, size, stage, results->back().ms_per_frame);
+		};
+
+		measure("advect", [&] { compute ? advectCompute() : advect(); });
+		measure("divergence", [&] { compute ? calculateDivergenceCompute() : calculateDivergence(); });
+
+		// Cold started as on the CPU.
+		PressureSettings &pressure = state.pressure_settings;
+		pressure.warm_start = false;
+		pressure.residual_tolerance = 0;
+		pressure.solver = PressureSolver::Jacobi;
+		measure("pressure_jacobi", [&] { calculatePressure(); });
+		pressure.solver = PressureSolver::Multigrid;
+		measure("pressure_multigrid", [&] { calculatePressure(); });
+		pressure = config.pressure;
+
+		measure("normalize", [&] { compute ? normalizeVelocityCompute() : normalizeVelocity(); });
+		measure("render", [&] {
+			state.gpu_timer.beginFrame();
+			render();
+		});
+		measure("step", [&] { headlessStep(scaled); });
+
+		state.gpu_timer.finish();
+		state.profiler.clear();
+	}
+}
+
+// Runs the stage benchmark configured by |config_path| on the CPU solver and
+// the GPU backends, writes the results and compares them with the baseline.
+// Fails when any stage regressed.
+int runBenchmark(const char *config_path) {
+	RunConfig config;
+	if (!loadRunConfig(config_path, &config)) {
+		return EXIT_FAILURE;
+	}
+	const BenchmarkSettings &settings = config.benchmark;
+
+	std::vector<BenchmarkResult> baseline;
+	if (!settings.baseline.empty() && !readBenchmarkResults(settings.baseline.c_str(), &baseline)) {
+		return EXIT_FAILURE;
+	}
+
+	std::vector<BenchmarkResult> results;
+	if (settings.cpu) {
+		benchmarkCpuSolver(config, &results);
+	}
+	benchmarkDomainScaling(config, &results);
+
+	if (settings.fragment || settings.compute) {
+		// Large enough for the render stage to cover every size.
+		int largest = *std::max_element(settings.sizes.begin(), settings.sizes.end());
+		OffscreenContext context;
+		if (!context.create(largest, largest)) {
+			return EXIT_FAILURE;
+		}
+		glewExperimental = GL_TRUE;
+		if (glewInit() != GLEW_OK) {
+			fprintf(stderr, "Failed to initialize GLEW\n");
+			return EXIT_FAILURE;
+		}
+		printf("%s, %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+
+		state.canvas_size = Size(settings.sizes[0], settings.sizes[0]);
+		state.simulation_size = state.canvas_size;
+		state.pressure_settings = config.pressure;
+		state.shader_cache = config.shader_cache;
+		init();
+		benchmarkStartup(config, &results);
+
+		if (settings.fragment) {
+			benchmarkGpu(config, Backend::Fragment, &results);
+		}
+		if (settings.compute) {
+			if (state.compute_supported) {
+				benchmarkGpu(config, Backend::Compute, &results);
+			} else {
+				printf("Compute shaders are not supported, skipping the compute backend.\n");
+			}
+		}
+		cleanup();
+	}
+
+	if (!settings.output.empty() && !writeBenchmarkResults(settings.output.c_str(), results)) {
+		return EXIT_FAILURE;
+	}
+
+	int regressions = compareBenchmarkResults(results, baseline, settings.threshold);
+	if (regressions > 0) {
+		printf("%d stages regressed by more than %.1f%%\n", regressions, settings.threshold);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
 }
 
 int main(int argc, char **argv) {
 	srand((unsigned int)time(NULL));
 
+	if (argc == 3 && strcmp(argv[1], "--headless") == 0) {
+		return runHeadless(argv[2]);
+	}
+	if (argc == 3 && strcmp(argv[1], "--benchmark") == 0) {
+		return runBenchmark(argv[2]);
+	}
+
 	state.canvas_size = Size(1080, 720);
+	const char *restore_path = nullptr;
+	const char *replay_path = nullptr;
+	const char *emitter_path = nullptr;
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "--restore") == 0) {
+			restore_path = argv[i + 1];
+		} else if (strcmp(argv[i], "--replay") == 0) {
+			replay_path = argv[i + 1];
+		} else if (strcmp(argv[i], "--emitters") == 0) {
+			emitter_path = argv[i + 1];
+		} else if (strcmp(argv[i], "--capture-format") == 0) {
+			if (strcmp(argv[i + 1], "exr") == 0) {
+				state.capture_settings.format = CaptureFormat::Exr;
+			} else if (strcmp(argv[i + 1], "pipe") == 0) {
+				state.capture_settings.format = CaptureFormat::Pipe;
+			}
+		} else if (strcmp(argv[i], "--capture-source") == 0) {
+			state.capture_settings.source = strcmp(argv[i + 1], "colour") == 0
+				? CaptureSource::Colour : CaptureSource::Framebuffer;
+		} else if (strcmp(argv[i], "--capture-output") == 0) {
+			state.capture_settings.output = argv[i + 1];
+		} else if (strcmp(argv[i], "--shader-cache") == 0) {
+			state.shader_cache = argv[i + 1];
+		} else if (strcmp(argv[i], "--simulation-divisor") == 0) {
+			state.simulation_divisor = std::max(1, atoi(argv[i + 1]));
+		} else if (strcmp(argv[i], "--advection") == 0) {
+			state.advection_scheme = strcmp(argv[i + 1], "maccormack") == 0
+				? AdvectionScheme::MacCormack : AdvectionScheme::SemiLagrangian;
+		} else if (strcmp(argv[i], "--precision") == 0) {
+			Precision precision = Precision::Full;
+			if (strcmp(argv[i + 1], "half") == 0) {
+				precision = Precision::Half;
+			} else if (strcmp(argv[i + 1], "packed") == 0) {
+				precision = Precision::Packed;
+			}
+			applyPrecision(precision);
+		}
+	}
+
+	// A snapshot's canvas and divisor win over the other options, whatever
+	// their order, since its fields have to fit the textures.
+	if (restore_path) {
+		if (!readSnapshotSize(restore_path, &state.canvas_size, &state.simulation_divisor)) {
+			return EXIT_FAILURE;
+		}
+	} else if (replay_path && !readStreamSize(replay_path, &state.canvas_size)) {
+		return EXIT_FAILURE;
+	}
+	state.simulation_size = state.canvas_size / state.simulation_divisor;
+	if (emitter_path && !state.emitter_script.load(emitter_path, state.canvas_size.width, state.canvas_size.height)) {
+		return EXIT_FAILURE;
+	}
 
 	glutInit(&argc, argv);
 	glutInitDisplayMode(GLUT_DEPTH | GLUT_DOUBLE | GLUT_RGBA);
@@ -571,6 +3202,19 @@ int main(int argc, char **argv) {
 	glewInit();
 
 	init();
+	printStartup();
+	if ((restore_path && !restoreSnapshot(restore_path))
+		|| (replay_path && !startReplay(replay_path))) {
+		cleanup();
+		return EXIT_FAILURE;
+	}
+
+	glutDisplayFunc(tick);
+
+	glutIgnoreKeyRepeat(1);
+	glutMotionFunc(handleMouseMove);
+	glutMouseFunc(handleMouseButton);
+	glutKeyboardFunc(handlePressNormalKeys);
 
 	glutMainLoop();
 
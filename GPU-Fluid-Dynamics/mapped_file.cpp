@@ -0,0 +1,129 @@
+/*
+* Copyright (c) 2017 Owen Glofcheski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#include "mapped_file.hpp"
+
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char *path) {
+	close();
+
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		file = nullptr;
+		fprintf(stderr, "Failed to open %s\n", path);
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		fprintf(stderr, "Failed to map %s\n", path);
+		close();
+		return false;
+	}
+
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping) {
+		mapped_data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+	if (!mapped_data) {
+		fprintf(stderr, "Failed to map %s\n", path);
+		close();
+		return false;
+	}
+	mapped_size = (size_t)size.QuadPart;
+	return true;
+}
+
+void MappedFile::close() {
+	if (mapped_data) {
+		UnmapViewOfFile(mapped_data);
+	}
+	if (mapping) {
+		CloseHandle(mapping);
+	}
+	if (file) {
+		CloseHandle(file);
+	}
+	mapped_data = nullptr;
+	mapped_size = 0;
+	mapping = nullptr;
+	file = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const char *path) {
+	close();
+
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		fprintf(stderr, "Failed to map %s\n", path);
+		::close(fd);
+		return false;
+	}
+
+	// The mapping keeps the file alive after the descriptor is closed.
+	void *data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (data == MAP_FAILED) {
+		fprintf(stderr, "Failed to map %s\n", path);
+		return false;
+	}
+
+	mapped_data = (const unsigned char*)data;
+	mapped_size = (size_t)info.st_size;
+	return true;
+}
+
+void MappedFile::close() {
+	if (mapped_data) {
+		munmap((void*)mapped_data, mapped_size);
+	}
+	mapped_data = nullptr;
+	mapped_size = 0;
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef _MAPPED_FILE_HPP_
+#define _MAPPED_FILE_HPP_
+
+#include <cstddef>
+
+// A read-only memory mapping of a whole file. Pages are only read from disk
+// when first touched, so opening a large file costs next to nothing.
+class MappedFile
+{
+public:
+	MappedFile() {}
+	~MappedFile();
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	// Returns false and prints the error on failure.
+	bool open(const char *path);
+	void close();
+
+	const unsigned char *data() const { return mapped_data; }
+	size_t size() const { return mapped_size; }
+
+private:
+	const unsigned char *mapped_data = nullptr;
+	size_t mapped_size = 0;
+
+#ifdef _WIN32
+	void *file = nullptr;
+	void *mapping = nullptr;
+#endif
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,110 @@
+/*
+* Copyright (c) 2017 Owen Glofcheski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#include "offscreen_context.hpp"
+
+#include <cstdio>
+#include <EGL\eglext.h>
+
+OffscreenContext::~OffscreenContext() {
+	destroy();
+}
+
+bool OffscreenContext::create(int width, int height) {
+	display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (!eglInitialize(display, NULL, NULL)) {
+		// Without a display server fall back to Mesa's surfaceless platform.
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		display = getPlatformDisplay
+			? getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL)
+			: EGL_NO_DISPLAY;
+		if (!eglInitialize(display, NULL, NULL)) {
+			fprintf(stderr, "Failed to initialize EGL: 0x%x\n", eglGetError());
+			display = EGL_NO_DISPLAY;
+			return false;
+		}
+	}
+
+	EGLint config_attributes[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8,
+		EGL_GREEN_SIZE, 8,
+		EGL_BLUE_SIZE, 8,
+		EGL_NONE,
+	};
+	EGLConfig config;
+	EGLint config_count = 0;
+	if (!eglChooseConfig(display, config_attributes, &config, 1, &config_count) || config_count == 0) {
+		fprintf(stderr, "No EGL config with pbuffer and OpenGL support\n");
+		destroy();
+		return false;
+	}
+
+	EGLint surface_attributes[] = {
+		EGL_WIDTH, width,
+		EGL_HEIGHT, height,
+		EGL_NONE,
+	};
+	surface = eglCreatePbufferSurface(display, config, surface_attributes);
+	if (surface == EGL_NO_SURFACE) {
+		fprintf(stderr, "Failed to create pbuffer: 0x%x\n", eglGetError());
+		destroy();
+		return false;
+	}
+
+	// The shaders rely on the compatibility profile, as does the window.
+	eglBindAPI(EGL_OPENGL_API);
+	context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+	if (context == EGL_NO_CONTEXT) {
+		fprintf(stderr, "Failed to create context: 0x%x\n", eglGetError());
+		destroy();
+		return false;
+	}
+
+	if (!eglMakeCurrent(display, surface, surface, context)) {
+		fprintf(stderr, "Failed to make context current: 0x%x\n", eglGetError());
+		destroy();
+		return false;
+	}
+	return true;
+}
+
+void OffscreenContext::destroy() {
+	if (display == EGL_NO_DISPLAY) {
+		return;
+	}
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (context != EGL_NO_CONTEXT) {
+		eglDestroyContext(display, context);
+	}
+	if (surface != EGL_NO_SURFACE) {
+		eglDestroySurface(display, surface);
+	}
+	eglTerminate(display);
+
+	display = EGL_NO_DISPLAY;
+	surface = EGL_NO_SURFACE;
+	context = EGL_NO_CONTEXT;
+}
\ No newline at end of file
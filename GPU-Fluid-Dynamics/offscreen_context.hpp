@@ -0,0 +1,26 @@
+#ifndef _OFFSCREEN_CONTEXT_HPP_
+#define _OFFSCREEN_CONTEXT_HPP_
+
+#include <EGL\egl.h>
+
+// An OpenGL compatibility context backed by a pbuffer rather than a window,
+// for running without a display server. Works with any EGL implementation,
+// including Mesa's llvmpipe through the surfaceless platform. GLEW has to be
+// built with GLEW_EGL on platforms where it otherwise loads through GLX.
+class OffscreenContext
+{
+public:
+	~OffscreenContext();
+
+	// Creates the context and makes it current. Returns false and prints the
+	// EGL error on failure.
+	bool create(int width, int height);
+	void destroy();
+
+private:
+	EGLDisplay display = EGL_NO_DISPLAY;
+	EGLSurface surface = EGL_NO_SURFACE;
+	EGLContext context = EGL_NO_CONTEXT;
+};
+
+#endif
\ No newline at end of file
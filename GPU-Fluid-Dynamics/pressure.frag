@@ -5,6 +5,8 @@ uniform vec2 grid_size;
 
 uniform float timestep;
 
+uniform float relaxation;
+
 void main()
 {
 	vec2 e_x = vec2(1.0 / grid_size.x, 0.0);
@@ -13,13 +15,11 @@ void main()
 
 	float divergence = texture2D(divergence_sampler, uv).x;
 
-	float pL = texture2D(pressure_sampler, uv - 2 * e_x).x;
-	float pR = texture2D(pressure_sampler, uv + 2 * e_x).x;
-	float pB = texture2D(pressure_sampler, uv - 2 * e_y).x;
-	float pT = texture2D(pressure_sampler, uv + 2 * e_y).x;
-
-	gl_FragData[0].x = (divergence + pL + pR + pB + pT) / 4;
+	float p = texture2D(pressure_sampler, uv).x;
+	float pL = texture2D(pressure_sampler, uv - 2.0 * e_x).x;
+	float pR = texture2D(pressure_sampler, uv + 2.0 * e_x).x;
+	float pB = texture2D(pressure_sampler, uv - 2.0 * e_y).x;
+	float pT = texture2D(pressure_sampler, uv + 2.0 * e_y).x;
 
-	// Add a y component so it can be rendered.
-	gl_FragData[0].y = gl_FragData[0].x * 20;
+	gl_FragData[0].x = mix(p, (divergence + pL + pR + pB + pT) / 4.0, relaxation);
 }
\ No newline at end of file
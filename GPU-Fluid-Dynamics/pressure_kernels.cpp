@@ -0,0 +1,233 @@
+/*
+* Copyright (c) 2017 Owen Glofcheski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#include "pressure_kernels.hpp"
+
+#include <algorithm>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define PRESSURE_KERNEL_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PRESSURE_KERNEL_SSE
+#endif
+
+namespace {
+
+#if defined(PRESSURE_KERNEL_AVX)
+const int kLanes = 8;
+#elif defined(PRESSURE_KERNEL_SSE)
+const int kLanes = 4;
+#else
+const int kLanes = 1;
+#endif
+
+inline float jacobiCell(const float *rhs, const float *bottom, const float *row, const float *top,
+	int x, int left, int right, float relaxation) {
+	float jacobi = (rhs[x] + row[left] + row[right] + bottom[x] + top[x]) / 4;
+	return relaxation == 1 ? jacobi : row[x] + relaxation * (jacobi - row[x]);
+}
+
+inline int wrapLeft(int x, int width) {
+	return x >= 2 ? x - 2 : x - 2 + width;
+}
+
+inline int wrapRight(int x, int width) {
+	return x + 2 < width ? x + 2 : x + 2 - width;
+}
+
+} // namespace
+
+void jacobiRow(const float *rhs, const float *bottom, const float *row, const float *top,
+	float *out, int width, float relaxation) {
+	jacobiSpan(rhs, bottom, row, top, out, width, 0, width, relaxation);
+}
+
+void jacobiSpan(const float *rhs, const float *bottom, const float *row, const float *top,
+	float *out, int width, int span_begin, int span_end, float relaxation) {
+	// Columns whose neighbours wrap are done separately.
+	int begin = std::max(span_begin, 2);
+	int inner_end = std::min(span_end, width - 2);
+	int end = begin + (inner_end - begin > 0 ? (inner_end - begin) / kLanes * kLanes : 0);
+
+	for (int x = span_begin; x < begin && x < span_end; ++x) {
+		out[x] = jacobiCell(rhs, bottom, row, top, x, wrapLeft(x, width), wrapRight(x, width), relaxation);
+	}
+
+#if defined(PRESSURE_KERNEL_AVX)
+	__m256 quarter = _mm256_set1_ps(0.25f);
+	__m256 weight = _mm256_set1_ps(relaxation);
+	for (int x = begin; x < end; x += kLanes) {
+		__m256 sum = _mm256_add_ps(_mm256_loadu_ps(rhs + x), _mm256_loadu_ps(row + x - 2));
+		sum = _mm256_add_ps(sum, _mm256_loadu_ps(row + x + 2));
+		sum = _mm256_add_ps(sum, _mm256_loadu_ps(bottom + x));
+		sum = _mm256_add_ps(sum, _mm256_loadu_ps(top + x));
+		__m256 jacobi = _mm256_mul_ps(sum, quarter);
+		if (relaxation != 1) {
+			__m256 centre = _mm256_loadu_ps(row + x);
+			jacobi = _mm256_add_ps(centre, _mm256_mul_ps(weight, _mm256_sub_ps(jacobi, centre)));
+		}
+		_mm256_storeu_ps(out + x, jacobi);
+	}
+#elif defined(PRESSURE_KERNEL_SSE)
+	__m128 quarter = _mm_set1_ps(0.25f);
+	__m128 weight = _mm_set1_ps(relaxation);
+	for (int x = begin; x < end; x += kLanes) {
+		__m128 sum = _mm_add_ps(_mm_loadu_ps(rhs + x), _mm_loadu_ps(row + x - 2));
+		sum = _mm_add_ps(sum, _mm_loadu_ps(row + x + 2));
+		sum = _mm_add_ps(sum, _mm_loadu_ps(bottom + x));
+		sum = _mm_add_ps(sum, _mm_loadu_ps(top + x));
+		__m128 jacobi = _mm_mul_ps(sum, quarter);
+		if (relaxation != 1) {
+			__m128 centre = _mm_loadu_ps(row + x);
+			jacobi = _mm_add_ps(centre, _mm_mul_ps(weight, _mm_sub_ps(jacobi, centre)));
+		}
+		_mm_storeu_ps(out + x, jacobi);
+	}
+#else
+	for (int x = begin; x < end; ++x) {
+		out[x] = jacobiCell(rhs, bottom, row, top, x, x - 2, x + 2, relaxation);
+	}
+#endif
+
+	for (int x = end > begin ? end : begin; x < span_end; ++x) {
+		out[x] = jacobiCell(rhs, bottom, row, top, x, wrapLeft(x, width), wrapRight(x, width), relaxation);
+	}
+}
+
+void redBlackRow(const float *rhs, const float *bottom, float *row, const float *top,
+	int width, int y, int colour, float relaxation) {
+	// Cells of this colour are the pairs of columns where (x >> 1) & 1 matches.
+	int parity = (colour + (y >> 1)) & 1;
+
+	// Vectors start on a multiple of four so the lane pattern is fixed.
+	int begin = 4;
+	int end = begin + (width - 6 > 0 ? (width - 6) / kLanes * kLanes : 0);
+
+	for (int x = 0; x < begin && x < width; ++x) {
+		if (((x >> 1) & 1) == parity) {
+			row[x] = jacobiCell(rhs, bottom, row, top, x, wrapLeft(x, width), wrapRight(x, width), relaxation);
+		}
+	}
+
+#if defined(PRESSURE_KERNEL_AVX)
+	__m256 quarter = _mm256_set1_ps(0.25f);
+	__m256 weight = _mm256_set1_ps(relaxation);
+	__m256 mask = parity
+		? _mm256_castsi256_ps(_mm256_setr_epi32(0, 0, -1, -1, 0, 0, -1, -1))
+		: _mm256_castsi256_ps(_mm256_setr_epi32(-1, -1, 0, 0, -1, -1, 0, 0));
+	// The next vector is loaded before storing the current one. Its left
+	// neighbours overlap the store but are of the other colour so unchanged,
+	// and loading first avoids a failed store forward on every iteration.
+	__m256 centre, sum;
+	if (begin < end) {
+		centre = _mm256_loadu_ps(row + begin);
+		sum = _mm256_add_ps(_mm256_loadu_ps(rhs + begin), _mm256_loadu_ps(row + begin - 2));
+		sum = _mm256_add_ps(sum, _mm256_loadu_ps(row + begin + 2));
+		sum = _mm256_add_ps(sum, _mm256_loadu_ps(bottom + begin));
+		sum = _mm256_add_ps(sum, _mm256_loadu_ps(top + begin));
+	}
+	for (int x = begin; x < end; x += kLanes) {
+		__m256 jacobi = _mm256_mul_ps(sum, quarter);
+		if (relaxation != 1) {
+			jacobi = _mm256_add_ps(centre, _mm256_mul_ps(weight, _mm256_sub_ps(jacobi, centre)));
+		}
+		__m256 result = _mm256_blendv_ps(centre, jacobi, mask);
+
+		int next = x + kLanes;
+		if (next < end) {
+			centre = _mm256_loadu_ps(row + next);
+			sum = _mm256_add_ps(_mm256_loadu_ps(rhs + next), _mm256_loadu_ps(row + next - 2));
+			sum = _mm256_add_ps(sum, _mm256_loadu_ps(row + next + 2));
+			sum = _mm256_add_ps(sum, _mm256_loadu_ps(bottom + next));
+			sum = _mm256_add_ps(sum, _mm256_loadu_ps(top + next));
+		}
+
+		_mm256_storeu_ps(row + x, result);
+	}
+#elif defined(PRESSURE_KERNEL_SSE)
+	__m128 quarter = _mm_set1_ps(0.25f);
+	__m128 weight = _mm_set1_ps(relaxation);
+	__m128 mask = parity
+		? _mm_castsi128_ps(_mm_setr_epi32(0, 0, -1, -1))
+		: _mm_castsi128_ps(_mm_setr_epi32(-1, -1, 0, 0));
+	// Load ahead of the store, see the AVX path.
+	__m128 centre, sum;
+	if (begin < end) {
+		centre = _mm_loadu_ps(row + begin);
+		sum = _mm_add_ps(_mm_loadu_ps(rhs + begin), _mm_loadu_ps(row + begin - 2));
+		sum = _mm_add_ps(sum, _mm_loadu_ps(row + begin + 2));
+		sum = _mm_add_ps(sum, _mm_loadu_ps(bottom + begin));
+		sum = _mm_add_ps(sum, _mm_loadu_ps(top + begin));
+	}
+	for (int x = begin; x < end; x += kLanes) {
+		__m128 jacobi = _mm_mul_ps(sum, quarter);
+		if (relaxation != 1) {
+			jacobi = _mm_add_ps(centre, _mm_mul_ps(weight, _mm_sub_ps(jacobi, centre)));
+		}
+		__m128 result = _mm_or_ps(_mm_and_ps(mask, jacobi), _mm_andnot_ps(mask, centre));
+
+		int next = x + kLanes;
+		if (next < end) {
+			centre = _mm_loadu_ps(row + next);
+			sum = _mm_add_ps(_mm_loadu_ps(rhs + next), _mm_loadu_ps(row + next - 2));
+			sum = _mm_add_ps(sum, _mm_loadu_ps(row + next + 2));
+			sum = _mm_add_ps(sum, _mm_loadu_ps(bottom + next));
+			sum = _mm_add_ps(sum, _mm_loadu_ps(top + next));
+		}
+
+		_mm_storeu_ps(row + x, result);
+	}
+#else
+	for (int x = begin; x < end; ++x) {
+		if (((x >> 1) & 1) == parity) {
+			row[x] = jacobiCell(rhs, bottom, row, top, x, x - 2, x + 2, relaxation);
+		}
+	}
+#endif
+
+	for (int x = end > begin ? end : begin; x < width; ++x) {
+		if (((x >> 1) & 1) == parity) {
+			row[x] = jacobiCell(rhs, bottom, row, top, x, wrapLeft(x, width), wrapRight(x, width), relaxation);
+		}
+	}
+}
+
+double residualRow(const float *rhs, const float *bottom, const float *row, const float *top,
+	int width) {
+	return residualSpan(rhs, bottom, row, top, width, 0, width);
+}
+
+double residualSpan(const float *rhs, const float *bottom, const float *row, const float *top,
+	int width, int begin, int end) {
+	double sum = 0;
+	for (int x = begin; x < end; ++x) {
+		float pL = row[wrapLeft(x, width)];
+		float pR = row[wrapRight(x, width)];
+
+		float r = rhs[x] - (4 * row[x] - pL - pR - bottom[x] - top[x]);
+		sum += r * r;
+	}
+	return sum;
+}
@@ -0,0 +1,33 @@
+#ifndef _PRESSURE_KERNELS_HPP_
+#define _PRESSURE_KERNELS_HPP_
+
+// Single row kernels for the pressure stencil in pressure.frag. |bottom|,
+// |row| and |top| are pressure rows y - 2, y and y + 2 and columns wrap
+// around |width|. Vectorized with AVX or SSE when the build enables them,
+// all paths perform the same operations in the same order so results are
+// bit identical to the scalar fallback.
+
+// Writes one (optionally weighted) Jacobi iteration of |row| into |out|.
+void jacobiRow(const float *rhs, const float *bottom, const float *row, const float *top,
+	float *out, int width, float relaxation);
+
+// jacobiRow() restricted to the columns [|begin|, |end|), neighbours still
+// wrap around |width|.
+void jacobiSpan(const float *rhs, const float *bottom, const float *row, const float *top,
+	float *out, int width, int begin, int end, float relaxation);
+
+// Red-black Gauss-Seidel for the stride two stencil, where a cell's colour is
+// ((x >> 1) + (y >> 1)) & 1. Updates the cells of |row| (row y) with the
+// given colour in place, neighbours are always of the other colour.
+void redBlackRow(const float *rhs, const float *bottom, float *row, const float *top,
+	int width, int y, int colour, float relaxation);
+
+// Returns the sum of squared residuals over |row|.
+double residualRow(const float *rhs, const float *bottom, const float *row, const float *top,
+	int width);
+
+// residualRow() over the columns [|begin|, |end|).
+double residualSpan(const float *rhs, const float *bottom, const float *row, const float *top,
+	int width, int begin, int end);
+
+#endif
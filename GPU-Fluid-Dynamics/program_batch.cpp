@@ -0,0 +1,317 @@
+/*
+* Copyright (c) 2017 Owen Glofcheski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#include "program_batch.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "compute_shader.hpp"
+
+namespace {
+
+const char kBinaryMagic[4] = { 'G', 'F', 'P', 'B' };
+const uint32_t kBinaryVersion = 1;
+
+// Precedes the driver's binary in a cache file.
+struct BinaryHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t key;
+	uint32_t format;
+	uint32_t length;
+};
+
+// 64 bit FNV-1a.
+uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+	const unsigned char *bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; ++i) {
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	}
+	return hash;
+}
+
+uint64_t hashString(uint64_t hash, const char *string) {
+	// Includes the terminator so concatenations can't collide.
+	return hashBytes(hash, string ? string : "", string ? strlen(string) + 1 : 1);
+}
+
+bool programBinariesSupported() {
+	if (!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary) {
+		return false;
+	}
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	return formats > 0;
+}
+
+void printShaderLog(GLuint shader, const std::string &path) {
+	GLint status = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (status == GL_TRUE) {
+		return;
+	}
+	GLint length = 0;
+	glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+	std::vector<char> log(length + 1);
+	glGetShaderInfoLog(shader, length, NULL, &log[0]);
+	fprintf(stderr, "Failed to compile %s:\n%s\n", path.c_str(), &log[0]);
+}
+
+} // namespace
+
+ProgramBatch::ProgramBatch(const std::string &cache_directory)
+	: cache_directory(cache_directory) {
+}
+
+void ProgramBatch::add(GLuint *program, const char *vertex_path, const char *fragment_path) {
+	Entry entry;
+	entry.program = program;
+	entry.types.push_back(GL_VERTEX_SHADER);
+	entry.types.push_back(GL_FRAGMENT_SHADER);
+	entry.paths.push_back(vertex_path);
+	entry.paths.push_back(fragment_path);
+	entries.push_back(entry);
+}
+
+void ProgramBatch::addCompute(GLuint *program, const char *path, const std::string &defines) {
+	Entry entry;
+	entry.program = program;
+	entry.types.push_back(GL_COMPUTE_SHADER);
+	entry.paths.push_back(path);
+	entry.defines = defines;
+	entries.push_back(entry);
+}
+
+bool ProgramBatch::link() {
+	auto start = std::chrono::steady_clock::now();
+	batch_stats = ProgramBatchStats();
+
+	if (!cache_directory.empty() && !programBinariesSupported()) {
+		cache_directory.clear();
+	}
+	if (!cache_directory.empty()) {
+#ifdef _WIN32
+		_mkdir(cache_directory.c_str());
+#else
+		mkdir(cache_directory.c_str(), 0755);
+#endif
+	}
+
+	uint64_t driver = 14695981039346656037ull;
+	driver = hashString(driver, (const char*)glGetString(GL_VENDOR));
+	driver = hashString(driver, (const char*)glGetString(GL_RENDERER));
+	driver = hashString(driver, (const char*)glGetString(GL_VERSION));
+	driver = hashString(driver, (const char*)glGetString(GL_SHADING_LANGUAGE_VERSION));
+
+	std::vector<Entry*> missing;
+	std::vector<Entry*> cached;
+	for (Entry &entry : entries) {
+		entry.sources.assign(entry.paths.size(), std::string());
+		entry.key = driver;
+		bool read = true;
+		for (size_t i = 0; i < entry.paths.size(); ++i) {
+			read = read && readShaderSource(entry.paths[i].c_str(), entry.defines, &entry.sources[i]);
+			entry.key = hashBytes(entry.key, &entry.types[i], sizeof(GLenum));
+			entry.key = hashString(entry.key, entry.sources[i].c_str());
+		}
+
+		*entry.program = 0;
+		if (!read) {
+			++batch_stats.failed;
+			continue;
+		}
+
+		FILE *file = cache_directory.empty() ? nullptr : fopen(binaryPath(entry).c_str(), "rb");
+		if (file) {
+			fclose(file);
+			cached.push_back(&entry);
+		} else {
+			missing.push_back(&entry);
+		}
+	}
+
+	// Start every compile before restoring or waiting on anything.
+	for (Entry *entry : missing) {
+		compile(*entry);
+	}
+	for (Entry *entry : cached) {
+		if (restore(*entry)) {
+			++batch_stats.cached;
+		} else {
+			compile(*entry);
+			missing.push_back(entry);
+		}
+	}
+
+	for (Entry *entry : missing) {
+		if (finish(*entry)) {
+			++batch_stats.compiled;
+			save(*entry);
+		} else {
+			++batch_stats.failed;
+		}
+	}
+
+	batch_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return batch_stats.failed == 0;
+}
+
+void ProgramBatch::compile(Entry &entry) {
+	GLuint program = glCreateProgram();
+	entry.shaders.clear();
+	for (size_t i = 0; i < entry.types.size(); ++i) {
+		GLuint shader = glCreateShader(entry.types[i]);
+		const char *source = entry.sources[i].c_str();
+		glShaderSource(shader, 1, &source, NULL);
+		glCompileShader(shader);
+		glAttachShader(program, shader);
+		entry.shaders.push_back(shader);
+	}
+	if (!cache_directory.empty()) {
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+
+	// Compile and link status are only queried in finish().
+	glLinkProgram(program);
+	*entry.program = program;
+}
+
+bool ProgramBatch::restore(const Entry &entry) {
+	FILE *file = fopen(binaryPath(entry).c_str(), "rb");
+	if (!file) {
+		return false;
+	}
+
+	BinaryHeader header;
+	std::vector<char> binary;
+	bool read = fread(&header, sizeof(header), 1, file) == 1
+		&& memcmp(header.magic, kBinaryMagic, sizeof(header.magic)) == 0
+		&& header.version == kBinaryVersion && header.key == entry.key && header.length > 0;
+	if (read) {
+		binary.resize(header.length);
+		read = fread(&binary[0], 1, binary.size(), file) == binary.size();
+	}
+	fclose(file);
+	if (!read) {
+		return false;
+	}
+
+	// Drivers reject binaries they can no longer load.
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, header.format, &binary[0], (GLsizei)binary.size());
+	GLint status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (status != GL_TRUE) {
+		glDeleteProgram(program);
+		return false;
+	}
+	*entry.program = program;
+	return true;
+}
+
+bool ProgramBatch::finish(Entry &entry) {
+	GLuint program = *entry.program;
+	GLint status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+
+	for (size_t i = 0; i < entry.shaders.size(); ++i) {
+		if (status != GL_TRUE) {
+			printShaderLog(entry.shaders[i], entry.paths[i]);
+		}
+		glDetachShader(program, entry.shaders[i]);
+		glDeleteShader(entry.shaders[i]);
+	}
+	entry.shaders.clear();
+
+	if (status != GL_TRUE) {
+		GLint length = 0;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+		std::vector<char> log(length + 1);
+		glGetProgramInfoLog(program, length, NULL, &log[0]);
+		fprintf(stderr, "Failed to link %s:\n%s\n", entry.paths.back().c_str(), &log[0]);
+		glDeleteProgram(program);
+		*entry.program = 0;
+		return false;
+	}
+	return true;
+}
+
+void ProgramBatch::save(const Entry &entry) {
+	if (cache_directory.empty()) {
+		return;
+	}
+
+	GLint length = 0;
+	glGetProgramiv(*entry.program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return;
+	}
+	std::vector<char> binary(length);
+	BinaryHeader header;
+	memcpy(header.magic, kBinaryMagic, sizeof(header.magic));
+	header.version = kBinaryVersion;
+	header.key = entry.key;
+	GLenum format = 0;
+	glGetProgramBinary(*entry.program, length, &length, &format, &binary[0]);
+	header.format = format;
+	header.length = (uint32_t)length;
+
+	// Written aside and renamed so concurrent runs never read half a file.
+	std::string path = binaryPath(entry);
+	std::string temporary = path + ".tmp";
+	FILE *file = fopen(temporary.c_str(), "wb");
+	if (!file) {
+		return;
+	}
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(&binary[0], 1, length, file) == (size_t)length;
+#ifdef _WIN32
+	// rename() doesn't replace a stale binary there.
+	remove(path.c_str());
+#endif
+	if (fclose(file) != 0 || !written || rename(temporary.c_str(), path.c_str()) != 0) {
+		remove(temporary.c_str());
+	}
+}
+
+std::string ProgramBatch::binaryPath(const Entry &entry) const {
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)entry.key);
+	return cache_directory + "/" + name;
+}
+
+void enableParallelShaderCompile() {
+	if (GLEW_KHR_parallel_shader_compile) {
+		// The driver's choice of thread count.
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+	}
+}
@@ -0,0 +1,68 @@
+#ifndef _PROGRAM_BATCH_HPP_
+#define _PROGRAM_BATCH_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Utility\gl.hpp"
+
+// Where the programs of a ProgramBatch came from.
+struct ProgramBatchStats
+{
+	int cached = 0; // restored from a program binary.
+	int compiled = 0;
+	int failed = 0;
+	double seconds = 0;
+};
+
+// Builds a set of programs together at startup. Programs whose binary was
+// saved by an earlier run are restored with glProgramBinary, keyed by a hash
+// of the driver strings and every stage's source so a driver update or an
+// edited shader misses. The rest are all compiled and linked before any of
+// them is waited on, which lets drivers with GL_KHR_parallel_shader_compile
+// build them concurrently, and are saved for the next run.
+class ProgramBatch
+{
+public:
+	// |cache_directory| empty compiles everything and saves nothing.
+	explicit ProgramBatch(const std::string &cache_directory);
+
+	// Sets |*program| in link(), to 0 if it failed.
+	void add(GLuint *program, const char *vertex_path, const char *fragment_path);
+	void addCompute(GLuint *program, const char *path, const std::string &defines);
+
+	// Returns false if any program failed, after printing its log.
+	bool link();
+
+	const ProgramBatchStats &stats() const { return batch_stats; }
+
+private:
+	struct Entry
+	{
+		GLuint *program;
+		std::vector<GLenum> types;
+		std::vector<std::string> paths;
+		std::string defines;
+
+		std::vector<std::string> sources;
+		std::vector<GLuint> shaders;
+		uint64_t key;
+	};
+
+	void compile(Entry &entry);
+	bool restore(const Entry &entry);
+	bool finish(Entry &entry);
+	void save(const Entry &entry);
+	std::string binaryPath(const Entry &entry) const;
+
+	std::string cache_directory;
+	std::vector<Entry> entries;
+	ProgramBatchStats batch_stats;
+};
+
+// Lets the driver compile shaders on as many threads as it likes, when it
+// supports GL_KHR_parallel_shader_compile. Once per context.
+void enableParallelShaderCompile();
+
+#endif
\ No newline at end of file
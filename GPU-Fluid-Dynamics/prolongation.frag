@@ -0,0 +1,18 @@
+uniform sampler2D pressure_sampler;
+uniform sampler2D correction_sampler;
+
+uniform vec2 grid_size;
+uniform vec2 coarse_grid_size;
+
+void main()
+{
+	vec2 uv = gl_FragCoord.xy / grid_size;
+
+	// Inverse of the lattice mapping in restriction.frag.
+	vec2 fine = floor(gl_FragCoord.xy);
+	vec2 coarse = min(2.0 * floor(fine / 4.0), coarse_grid_size - 2.0) + mod(fine, 2.0);
+
+	float correction = texture2D(correction_sampler, (coarse + 0.5) / coarse_grid_size).x;
+
+	gl_FragData[0].x = texture2D(pressure_sampler, uv).x + correction;
+}
\ No newline at end of file
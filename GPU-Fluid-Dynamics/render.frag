@@ -1,20 +1,59 @@
+#version 130
+
 uniform sampler2D velocity_sampler;
 uniform sampler2D colour_sampler;
 
 uniform vec2 grid_size;
+uniform vec2 velocity_grid_size;
+
+// 0 takes the full 100 taps, 1 scales the tap count with the blur length and
+// 2 takes at most kMipTaps taps from the colour mip matching their spacing.
+uniform int quality;
+
+const float kAdaptiveTapSpacing = 2.0; // pixels.
+const float kMipTaps = 16.0;
+const float kMaxColourLod = 2.0;
 
 void main()
 {
-	vec2 velocity = texture2D(velocity_sampler, gl_TexCoord[0].st).xy;
+	// In canvas pixels.
+	vec2 velocity = texture2D(velocity_sampler, gl_TexCoord[0].st).xy
+		* (grid_size / velocity_grid_size);
 
 	vec2 step = velocity / grid_size * 2.0;
 
 	// Pseudo motion blur.
 	vec3 colour_accum = texture2D(colour_sampler, gl_TexCoord[0].st).xyz;
-	for (int i = 0; i < 100; ++i) {
-		colour_accum += texture2D(colour_sampler, gl_TexCoord[0].st - step * i).xyz;
+	if (quality == 0) {
+		for (int i = 0; i < 100; ++i) {
+			colour_accum += texture2D(colour_sampler, gl_TexCoord[0].st - step * float(i)).xyz;
+		}
+		colour_accum /= 100.0;
+	} else {
+		// The full path covers 100 steps of 2 * |velocity| pixels.
+		float blur_length = 200.0 * length(velocity);
+
+		int taps;
+		float lod = 0.0;
+		if (quality == 1) {
+			taps = int(clamp(ceil(blur_length / kAdaptiveTapSpacing), 1.0, 100.0));
+		} else {
+			// Texels of the chosen mip roughly span the gap between taps.
+			float mip_taps = clamp(ceil(blur_length / exp2(kMaxColourLod)), 1.0, kMipTaps);
+			taps = int(mip_taps);
+			lod = clamp(log2(blur_length / mip_taps), 0.0, kMaxColourLod);
+		}
+
+		vec2 tap_step = step * (100.0 / float(taps));
+		for (int i = 0; i < taps; ++i) {
+			// An explicit level, the implicit one would follow the change
+			// in tap position between neighbouring pixels.
+			colour_accum += textureLod(colour_sampler, gl_TexCoord[0].st - tap_step * float(i), lod).xyz;
+		}
+
+		// Same gain as the full path, 101 taps over 100.
+		colour_accum *= 1.01 / float(taps + 1);
 	}
-	colour_accum /= 100.0;
 
 	gl_FragColor.xyz = colour_accum;
 }
\ No newline at end of file
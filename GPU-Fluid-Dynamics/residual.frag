@@ -0,0 +1,24 @@
+uniform sampler2D divergence_sampler;
+uniform sampler2D pressure_sampler;
+
+uniform vec2 grid_size;
+
+void main()
+{
+	vec2 e_x = vec2(1.0 / grid_size.x, 0.0);
+	vec2 e_y = vec2(0.0, 1.0 / grid_size.y);
+	vec2 uv = gl_FragCoord.xy / grid_size;
+
+	float divergence = texture2D(divergence_sampler, uv).x;
+
+	float p = texture2D(pressure_sampler, uv).x;
+	float pL = texture2D(pressure_sampler, uv - 2.0 * e_x).x;
+	float pR = texture2D(pressure_sampler, uv + 2.0 * e_x).x;
+	float pB = texture2D(pressure_sampler, uv - 2.0 * e_y).x;
+	float pT = texture2D(pressure_sampler, uv + 2.0 * e_y).x;
+
+	float r = divergence - (4.0 * p - pL - pR - pB - pT);
+
+	// Squared so the mip chain averages down to the mean squared residual.
+	gl_FragData[0].x = r * r;
+}
\ No newline at end of file
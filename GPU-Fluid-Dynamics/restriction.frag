@@ -0,0 +1,46 @@
+uniform sampler2D divergence_sampler;
+uniform sampler2D pressure_sampler;
+
+uniform vec2 grid_size;
+
+float residual(vec2 texel)
+{
+	vec2 e_x = vec2(1.0 / grid_size.x, 0.0);
+	vec2 e_y = vec2(0.0, 1.0 / grid_size.y);
+	vec2 uv = (texel + 0.5) / grid_size;
+
+	float divergence = texture2D(divergence_sampler, uv).x;
+
+	float p = texture2D(pressure_sampler, uv).x;
+	float pL = texture2D(pressure_sampler, uv - 2.0 * e_x).x;
+	float pR = texture2D(pressure_sampler, uv + 2.0 * e_x).x;
+	float pB = texture2D(pressure_sampler, uv - 2.0 * e_y).x;
+	float pT = texture2D(pressure_sampler, uv + 2.0 * e_y).x;
+
+	return divergence - (4.0 * p - pL - pR - pB - pT);
+}
+
+void main()
+{
+	// The pressure stencil splits the grid into four interleaved lattices,
+	// a coarse texel c covers the fine texels 2c - p and 2c - p + 2 of its
+	// own lattice p along each axis. The last coarse texel of an odd lattice
+	// also covers 2c - p + 4.
+	vec2 coarse = floor(gl_FragCoord.xy);
+	vec2 fine = 2.0 * coarse - mod(coarse, 2.0);
+	vec2 coarse_size = 2.0 * floor(grid_size / 4.0);
+	vec2 extent = 2.0 + step(coarse_size - 2.0, coarse) * (grid_size - 2.0 * coarse_size);
+
+	// Averaging the residuals and scaling by the squared ratio of grid
+	// spacings leaves just the sum, the transpose of the prolongation.
+	float sum = 0.0;
+	for (int j = 0; j < 3; ++j) {
+		for (int i = 0; i < 3; ++i) {
+			vec2 offset = 2.0 * vec2(i, j);
+			if (offset.x <= extent.x && offset.y <= extent.y) {
+				sum += residual(fine + offset);
+			}
+		}
+	}
+	gl_FragData[0].x = sum;
+}
\ No newline at end of file
@@ -0,0 +1,317 @@
+/*
+* Copyright (c) 2017 Owen Glofcheski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#include "run_config.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+bool parseValue(const std::string &text, int *value) {
+	std::istringstream stream(text);
+	return (stream >> *value) && stream.eof();
+}
+
+bool parseValue(const std::string &text, float *value) {
+	std::istringstream stream(text);
+	return (stream >> *value) && stream.eof();
+}
+
+bool parseValue(const std::string &text, bool *value) {
+	if (text == "true" || text == "1") {
+		*value = true;
+		return true;
+	}
+	if (text == "false" || text == "0") {
+		*value = false;
+		return true;
+	}
+	return false;
+}
+
+// A comma separated list, e.g. "256,512,1024".
+bool parseValue(const std::string &text, std::vector<int> *value) {
+	value->clear();
+	std::istringstream stream(text);
+	std::string item;
+	while (std::getline(stream, item, ',')) {
+		int number;
+		if (!parseValue(item, &number) || number <= 0) {
+			return false;
+		}
+		value->push_back(number);
+	}
+	return !value->empty();
+}
+
+bool parseValue(const std::string &text, std::string *value) {
+	*value = text;
+	return !text.empty();
+}
+
+bool parseValue(const std::string &text, PressureSolver *value) {
+	if (text == "jacobi") {
+		*value = PressureSolver::Jacobi;
+		return true;
+	}
+	if (text == "multigrid") {
+		*value = PressureSolver::Multigrid;
+		return true;
+	}
+	return false;
+}
+
+bool parseValue(const std::string &text, AdvectionScheme *value) {
+	if (text == "semi_lagrangian") {
+		*value = AdvectionScheme::SemiLagrangian;
+		return true;
+	}
+	if (text == "maccormack") {
+		*value = AdvectionScheme::MacCormack;
+		return true;
+	}
+	return false;
+}
+
+bool parseValue(const std::string &text, Precision *value) {
+	if (text == "full") {
+		*value = Precision::Full;
+		return true;
+	}
+	if (text == "half") {
+		*value = Precision::Half;
+		return true;
+	}
+	if (text == "packed") {
+		*value = Precision::Packed;
+		return true;
+	}
+	return false;
+}
+
+bool parseValue(const std::string &text, CaptureSource *value) {
+	if (text == "colour") {
+		*value = CaptureSource::Colour;
+		return true;
+	}
+	if (text == "framebuffer") {
+		*value = CaptureSource::Framebuffer;
+		return true;
+	}
+	return false;
+}
+
+bool parseValue(const std::string &text, CaptureFormat *value) {
+	if (text == "png") {
+		*value = CaptureFormat::Png;
+		return true;
+	}
+	if (text == "exr") {
+		*value = CaptureFormat::Exr;
+		return true;
+	}
+	if (text == "pipe") {
+		*value = CaptureFormat::Pipe;
+		return true;
+	}
+	return false;
+}
+
+std::string trim(const std::string &text) {
+	size_t begin = text.find_first_not_of(" \t\r");
+	if (begin == std::string::npos) {
+		return std::string();
+	}
+	size_t end = text.find_last_not_of(" \t\r");
+	return text.substr(begin, end - begin + 1);
+}
+
+template <typename T>
+bool setValue(const std::string &key, const std::string &value, const char *name, T *member, bool *matched) {
+	if (key != name) {
+		return true;
+	}
+	*matched = true;
+	return parseValue(value, member);
+}
+
+bool setValue(RunConfig *config, const std::string &key, const std::string &value) {
+	PressureSettings &pressure = config->pressure;
+	SparseTileSettings &sparse = config->sparse;
+	CaptureSettings &capture = config->capture;
+	BenchmarkSettings &benchmark = config->benchmark;
+	EnsembleSettings &ensemble = config->ensemble;
+
+	bool matched = false;
+	bool valid = setValue(key, value, "width", &config->width, &matched)
+		&& setValue(key, value, "height", &config->height, &matched)
+		&& setValue(key, value, "steps", &config->steps, &matched)
+		&& setValue(key, value, "simulation_divisor", &config->simulation_divisor, &matched)
+		&& setValue(key, value, "bicubic_velocity", &config->bicubic_velocity, &matched)
+		&& setValue(key, value, "precision", &config->precision, &matched)
+		&& setValue(key, value, "velocity_format", &config->velocity_format, &matched)
+		&& setValue(key, value, "colour_format", &config->colour_format, &matched)
+		&& setValue(key, value, "divergence_format", &config->divergence_format, &matched)
+		&& setValue(key, value, "pressure_format", &config->pressure_format, &matched)
+		&& setValue(key, value, "precision_report", &config->precision_report, &matched)
+		&& setValue(key, value, "compute_backend", &config->compute_backend, &matched)
+		&& setValue(key, value, "fused_advection", &config->fused_advection, &matched)
+		&& setValue(key, value, "advection", &config->advection, &matched)
+		&& setValue(key, value, "advection_report", &config->advection_report, &matched)
+		&& setValue(key, value, "pressure.solver", &pressure.solver, &matched)
+		&& setValue(key, value, "pressure.jacobi_iterations", &pressure.jacobi_iterations, &matched)
+		&& setValue(key, value, "pressure.multigrid_cycles", &pressure.multigrid_cycles, &matched)
+		&& setValue(key, value, "pressure.multigrid_smoothing_iterations", &pressure.multigrid_smoothing_iterations, &matched)
+		&& setValue(key, value, "pressure.multigrid_coarse_iterations", &pressure.multigrid_coarse_iterations, &matched)
+		&& setValue(key, value, "pressure.multigrid_relaxation", &pressure.multigrid_relaxation, &matched)
+		&& setValue(key, value, "pressure.residual_tolerance", &pressure.residual_tolerance, &matched)
+		&& setValue(key, value, "pressure.residual_check_interval", &pressure.residual_check_interval, &matched)
+		&& setValue(key, value, "pressure.warm_start", &pressure.warm_start, &matched)
+		&& setValue(key, value, "pressure.warm_start_scale", &pressure.warm_start_scale, &matched)
+		&& setValue(key, value, "sparse.enabled", &sparse.enabled, &matched)
+		&& setValue(key, value, "sparse.velocity_threshold", &sparse.velocity_threshold, &matched)
+		&& setValue(key, value, "sparse.divergence_threshold", &sparse.divergence_threshold, &matched)
+		&& setValue(key, value, "sparse.margin", &sparse.margin, &matched)
+		&& setValue(key, value, "impulse_x", &config->impulse_x, &matched)
+		&& setValue(key, value, "impulse_y", &config->impulse_y, &matched)
+		&& setValue(key, value, "impulse_dx", &config->impulse_dx, &matched)
+		&& setValue(key, value, "impulse_dy", &config->impulse_dy, &matched)
+		&& setValue(key, value, "impulse_radius", &config->impulse_radius, &matched)
+		&& setValue(key, value, "emitter_script", &config->emitter_script, &matched)
+		&& setValue(key, value, "output_interval", &config->output_interval, &matched)
+		&& setValue(key, value, "output_prefix", &config->output_prefix, &matched)
+		&& setValue(key, value, "snapshot_input", &config->snapshot_input, &matched)
+		&& setValue(key, value, "snapshot_output", &config->snapshot_output, &matched)
+		&& setValue(key, value, "stream_output", &config->stream_output, &matched)
+		&& setValue(key, value, "stream_interval", &config->stream_interval, &matched)
+		&& setValue(key, value, "stream_keyframe_interval", &config->stream_keyframe_interval, &matched)
+		&& setValue(key, value, "capture.enabled", &config->capture_enabled, &matched)
+		&& setValue(key, value, "capture.source", &capture.source, &matched)
+		&& setValue(key, value, "capture.format", &capture.format, &matched)
+		&& setValue(key, value, "capture.output", &capture.output, &matched)
+		&& setValue(key, value, "capture.interval", &capture.interval, &matched)
+		&& setValue(key, value, "capture.latency", &capture.latency, &matched)
+		&& setValue(key, value, "capture.queue_frames", &capture.queue_frames, &matched)
+		&& setValue(key, value, "profile_output", &config->profile_output, &matched)
+		&& setValue(key, value, "shader_cache", &config->shader_cache, &matched)
+		&& setValue(key, value, "render_benchmark_frames", &config->render_benchmark_frames, &matched)
+		&& setValue(key, value, "benchmark.sizes", &benchmark.sizes, &matched)
+		&& setValue(key, value, "benchmark.cpu", &benchmark.cpu, &matched)
+		&& setValue(key, value, "benchmark.fragment", &benchmark.fragment, &matched)
+		&& setValue(key, value, "benchmark.compute", &benchmark.compute, &matched)
+		&& setValue(key, value, "benchmark.warmup_steps", &benchmark.warmup_steps, &matched)
+		&& setValue(key, value, "benchmark.frames", &benchmark.frames, &matched)
+		&& setValue(key, value, "benchmark.max_seconds", &benchmark.max_seconds, &matched)
+		&& setValue(key, value, "benchmark.output", &benchmark.output, &matched)
+		&& setValue(key, value, "benchmark.baseline", &benchmark.baseline, &matched)
+		&& setValue(key, value, "benchmark.threshold", &benchmark.threshold, &matched)
+		&& setValue(key, value, "benchmark.domain_workers", &benchmark.domain_workers, &matched)
+		&& setValue(key, value, "benchmark.domain_size", &benchmark.domain_size, &matched)
+		&& setValue(key, value, "benchmark.domain_iterations", &benchmark.domain_iterations, &matched)
+		&& setValue(key, value, "benchmark.domain_overlap", &benchmark.domain_overlap, &matched)
+		&& setValue(key, value, "benchmark.domain_pin_threads", &benchmark.domain_pin_threads, &matched)
+		&& setValue(key, value, "ensemble.members", &ensemble.members, &matched)
+		&& setValue(key, value, "ensemble.size", &ensemble.size, &matched)
+		&& setValue(key, value, "ensemble.cpu", &ensemble.cpu, &matched)
+		&& setValue(key, value, "ensemble.impulse_dx_step", &ensemble.impulse_dx_step, &matched)
+		&& setValue(key, value, "ensemble.impulse_dy_step", &ensemble.impulse_dy_step, &matched)
+		&& setValue(key, value, "ensemble.impulse_radius_step", &ensemble.impulse_radius_step, &matched)
+		&& setValue(key, value, "ensemble.advection_timestep_step", &ensemble.advection_timestep_step, &matched)
+		&& setValue(key, value, "ensemble.jacobi_iterations_step", &ensemble.jacobi_iterations_step, &matched)
+		&& setValue(key, value, "ensemble.report", &ensemble.report, &matched);
+	return matched && valid;
+}
+
+} // namespace
+
+bool loadRunConfig(const char *path, RunConfig *config) {
+	std::ifstream file(path);
+	if (!file) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		return false;
+	}
+
+	std::string line;
+	int line_number = 0;
+	while (std::getline(file, line)) {
+		++line_number;
+
+		line = trim(line.substr(0, line.find('#')));
+		if (line.empty()) {
+			continue;
+		}
+
+		size_t separator = line.find('=');
+		if (separator == std::string::npos) {
+			fprintf(stderr, "%s:%d: expected key = value\n", path, line_number);
+			return false;
+		}
+
+		std::string key = trim(line.substr(0, separator));
+		std::string value = trim(line.substr(separator + 1));
+		if (!setValue(config, key, value)) {
+			fprintf(stderr, "%s:%d: invalid setting '%s'\n", path, line_number, line.c_str());
+			return false;
+		}
+	}
+
+	if (config->width <= 0 || config->height <= 0 || config->steps < 0
+		|| config->simulation_divisor < 1) {
+		fprintf(stderr, "%s: invalid grid size, divisor or step count\n", path);
+		return false;
+	}
+	if (config->ensemble.members < 0 || config->ensemble.size <= 0) {
+		fprintf(stderr, "%s: invalid ensemble\n", path);
+		return false;
+	}
+	const BenchmarkSettings &benchmark = config->benchmark;
+	if (benchmark.domain_size < 4 || benchmark.domain_iterations < 0
+		|| std::any_of(benchmark.domain_workers.begin(), benchmark.domain_workers.end(),
+			[](int workers) { return workers < 1; })) {
+		fprintf(stderr, "%s: invalid domain scaling benchmark\n", path);
+		return false;
+	}
+	return true;
+}
+
+std::vector<EnsembleMember> ensembleMembers(const RunConfig &config) {
+	const EnsembleSettings &ensemble = config.ensemble;
+
+	std::vector<EnsembleMember> members(ensemble.members);
+	for (int i = 0; i < ensemble.members; ++i) {
+		EnsembleMember &member = members[i];
+		member.impulse_x = config.impulse_x * ensemble.size / config.width;
+		member.impulse_y = config.impulse_y * ensemble.size / config.height;
+		member.impulse_dx = config.impulse_dx + i * ensemble.impulse_dx_step;
+		member.impulse_dy = config.impulse_dy + i * ensemble.impulse_dy_step;
+		member.impulse_radius = (config.impulse_radius + i * ensemble.impulse_radius_step)
+			* ensemble.size / config.width;
+		member.advection_timestep = 4 + i * ensemble.advection_timestep_step;
+		member.jacobi_iterations = std::max(0,
+			config.pressure.jacobi_iterations + i * ensemble.jacobi_iterations_step);
+	}
+	return members;
+}
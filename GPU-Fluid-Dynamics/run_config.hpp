@@ -0,0 +1,205 @@
+#ifndef _RUN_CONFIG_HPP_
+#define _RUN_CONFIG_HPP_
+
+#include <string>
+#include <vector>
+
+#include "solver_settings.hpp"
+
+// Storage format presets for the simulation textures, see applyPrecision().
+enum class Precision
+{
+	Full,
+	Half,
+	Packed,
+};
+
+enum class CaptureSource
+{
+	Colour, // the dye field.
+	Framebuffer, // the rendered frame, including blur and indicators.
+};
+
+enum class CaptureFormat
+{
+	Png,
+	Exr, // floats, only meaningful for the colour source.
+	Pipe, // raw rgb24 frames written to a command's stdin.
+};
+
+// Frame capture, see FrameCapture.
+struct CaptureSettings
+{
+	CaptureSource source = CaptureSource::Framebuffer;
+	CaptureFormat format = CaptureFormat::Png;
+
+	// The file prefix for image sequences, or the command frames are piped
+	// to with {width} and {height} replaced, e.g.
+	// "ffmpeg -f rawvideo -pix_fmt rgb24 -s {width}x{height} -i - out.mp4".
+	std::string output = "capture";
+
+	int interval = 1; // frames or steps between captures.
+
+	// Readbacks in flight, frames are written this many frames late.
+	int latency = 3;
+
+	// Frames waiting for the writer thread before capture blocks.
+	int queue_frames = 8;
+};
+
+// The stage benchmark run by --benchmark, see benchmark.hpp.
+struct BenchmarkSettings
+{
+	// Square grid edges, every stage runs at each.
+	std::vector<int> sizes = { 256, 512, 1024, 2048, 4096 };
+
+	bool cpu = true;
+	bool fragment = true;
+	bool compute = false;
+
+	// Full steps run at each size before measuring.
+	int warmup_steps = 4;
+
+	// A stage is measured over |frames| runs or until it has taken
+	// |max_seconds|, whichever comes first, and at least once.
+	int frames = 10;
+	float max_seconds = 2;
+
+	// Results are written as CSV to |output| and compared against
+	// |baseline|, a previous output, when set. A stage more than |threshold|
+	// percent slower than the baseline is a regression.
+	std::string output = "benchmark.csv";
+	std::string baseline;
+	float threshold = 10;
+
+	// Strong and weak scaling of the domain decomposed Jacobi solve, see
+	// DomainSolver, at each worker count. Strong scaling splits one
+	// |domain_size| grid, weak scaling grows the grid's area with the worker
+	// count from |domain_size| at the first. Empty skips it.
+	std::vector<int> domain_workers;
+	int domain_size = 1024;
+	int domain_iterations = 50;
+	bool domain_overlap = true;
+	bool domain_pin_threads = false;
+};
+
+// Many independent simulations stepped together, see GpuEnsemble and
+// CpuEnsemble. Member i starts from the config's impulse, advection timestep
+// and Jacobi iterations plus i times each step below, so a parameter sweep is
+// a single run.
+struct EnsembleSettings
+{
+	int members = 0; // 0 runs a single simulation.
+	int size = 256; // grid edge of every member.
+	bool cpu = false; // a CPU atlas rather than texture array layers.
+
+	float impulse_dx_step = 0;
+	float impulse_dy_step = 0;
+	float impulse_radius_step = 0;
+	float advection_timestep_step = 0;
+	int jacobi_iterations_step = 0;
+
+	// Also runs every member alone through the single simulation path and
+	// compares the ensemble's throughput with those separate runs.
+	bool report = false;
+};
+
+// A fixed step batch run without a window, see runHeadless().
+struct RunConfig
+{
+	int width = 1080;
+	int height = 720;
+
+	int steps = 600;
+
+	// Velocity and pressure run on a grid this many times coarser than the
+	// colour, see State::simulation_size.
+	int simulation_divisor = 1;
+	bool bicubic_velocity = false;
+
+	// The per-field formats are image format qualifiers such as "rg16f" and
+	// override the preset when set.
+	Precision precision = Precision::Full;
+	std::string velocity_format;
+	std::string colour_format;
+	std::string divergence_format;
+	std::string pressure_format;
+
+	// Runs the steps at full precision first and reports the error of every
+	// field, the texture memory and the step time against it.
+	bool precision_report = false;
+
+	bool compute_backend = false;
+	bool fused_advection = false;
+	AdvectionScheme advection = AdvectionScheme::SemiLagrangian;
+
+	// Runs the steps with semi-Lagrangian advection at the configured grid
+	// first, then both schemes on a grid twice as coarse and MacCormack at
+	// the configured one, and compares their detail and step time.
+	bool advection_report = false;
+
+	PressureSettings pressure;
+
+	// Requires the compute backend.
+	SparseTileSettings sparse;
+
+	// A constant impulse applied every step in place of the mouse, pixels.
+	float impulse_x = 540;
+	float impulse_y = 360;
+	float impulse_dx = 1;
+	float impulse_dy = 0;
+	float impulse_radius = 40;
+
+	// Emitters applied each step, see EmitterScript. Empty disables.
+	std::string emitter_script;
+
+	// Writes the colour field as |output_prefix|_<step>.ppm every
+	// |output_interval| steps, 0 disables output.
+	int output_interval = 0;
+	std::string output_prefix = "frame";
+
+	// Starts from a snapshot, whose canvas size and simulation divisor
+	// replace the configured ones, and saves one after the last step.
+	// Empty disables.
+	std::string snapshot_input;
+	std::string snapshot_output;
+
+	// Records the colour field every |stream_interval| steps as a compressed
+	// frame stream for --replay, with a keyframe every
+	// |stream_keyframe_interval| frames. Empty disables.
+	std::string stream_output;
+	int stream_interval = 1;
+	int stream_keyframe_interval = 60;
+
+	// Captures a frame every |capture.interval| steps when enabled, the
+	// framebuffer source renders those steps.
+	bool capture_enabled = false;
+	CaptureSettings capture;
+
+	// Linked program binaries are cached in this directory, see
+	// ProgramBatch. Empty, the default, compiles every program from source.
+	std::string shader_cache;
+
+	// Per-stage GPU timings, written as JSON when the path ends in .json and
+	// CSV otherwise. Empty disables.
+	std::string profile_output;
+
+	// Renders this many frames at each render quality after the run and
+	// compares their GPU time, 0 skips the benchmark.
+	int render_benchmark_frames = 0;
+
+	BenchmarkSettings benchmark;
+
+	EnsembleSettings ensemble;
+};
+
+// Reads "key = value" lines, '#' starts a comment. Keys match the RunConfig
+// and PressureSettings members, e.g. "pressure.solver = multigrid". Unknown
+// keys or malformed values print an error and return false.
+bool loadRunConfig(const char *path, RunConfig *config);
+
+// The members of |config.ensemble|, with the impulse position and radius
+// scaled from the config's canvas to the member grid.
+std::vector<EnsembleMember> ensembleMembers(const RunConfig &config);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,12 @@
+uniform sampler2D field_sampler;
+
+uniform vec2 grid_size;
+
+uniform float scale;
+
+void main()
+{
+	vec2 uv = gl_FragCoord.xy / grid_size;
+
+	gl_FragData[0] = texture2D(field_sampler, uv) * scale;
+}
\ No newline at end of file
@@ -0,0 +1,5 @@
+void main()
+{
+    gl_Position = gl_Vertex;
+	gl_TexCoord[0] = gl_MultiTexCoord0;
+}
\ No newline at end of file
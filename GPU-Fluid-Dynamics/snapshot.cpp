@@ -0,0 +1,143 @@
+/*
+* Copyright (c) 2017 Owen Glofcheski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#include "snapshot.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+const uint64_t kSnapshotAlignment = 4096;
+
+uint64_t alignUp(uint64_t offset) {
+	return (offset + kSnapshotAlignment - 1) / kSnapshotAlignment * kSnapshotAlignment;
+}
+
+} // namespace
+
+bool writeSnapshot(const char *path, int canvas_width, int canvas_height,
+	int simulation_divisor, uint64_t step, const std::vector<SnapshotField> &fields) {
+	SnapshotHeader header;
+	memcpy(header.magic, kSnapshotMagic, sizeof(header.magic));
+	header.version = kSnapshotVersion;
+	header.field_count = (uint32_t)fields.size();
+	header.simulation_divisor = (uint32_t)simulation_divisor;
+	header.canvas_width = canvas_width;
+	header.canvas_height = canvas_height;
+	header.step = step;
+
+	std::vector<SnapshotFieldHeader> field_headers(fields.size());
+	uint64_t offset = sizeof(header) + fields.size() * sizeof(SnapshotFieldHeader);
+	for (size_t i = 0; i < fields.size(); ++i) {
+		SnapshotFieldHeader &field_header = field_headers[i];
+		memset(&field_header, 0, sizeof(field_header));
+		strncpy(field_header.name, fields[i].name.c_str(), sizeof(field_header.name) - 1);
+		field_header.width = fields[i].width;
+		field_header.height = fields[i].height;
+		field_header.components = fields[i].components;
+		field_header.offset = alignUp(offset);
+		field_header.bytes = fields[i].data.size() * sizeof(float);
+		offset = field_header.offset + field_header.bytes;
+	}
+
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		return false;
+	}
+
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1
+		&& (field_headers.empty()
+			|| fwrite(&field_headers[0], sizeof(SnapshotFieldHeader), field_headers.size(), file) == field_headers.size());
+
+	// Padded up to each offset rather than seeking, fseek() takes a long which
+	// is 32 bit on Windows.
+	static const char padding[kSnapshotAlignment] = {};
+	uint64_t position = sizeof(header) + fields.size() * sizeof(SnapshotFieldHeader);
+	for (size_t i = 0; i < fields.size() && written; ++i) {
+		size_t pad = (size_t)(field_headers[i].offset - position);
+		written = fwrite(padding, 1, pad, file) == pad
+			&& fwrite(&fields[i].data[0], 1, field_headers[i].bytes, file) == field_headers[i].bytes;
+		position = field_headers[i].offset + field_headers[i].bytes;
+	}
+
+	if (fclose(file) != 0 || !written) {
+		fprintf(stderr, "Failed to write %s\n", path);
+		return false;
+	}
+	return true;
+}
+
+bool Snapshot::load(const char *path) {
+	fields.clear();
+	if (!file.open(path)) {
+		return false;
+	}
+
+	if (file.size() < sizeof(SnapshotHeader)) {
+		fprintf(stderr, "%s: not a snapshot\n", path);
+		return false;
+	}
+	memcpy(&file_header, file.data(), sizeof(file_header));
+	if (memcmp(file_header.magic, kSnapshotMagic, sizeof(file_header.magic)) != 0) {
+		fprintf(stderr, "%s: not a snapshot\n", path);
+		return false;
+	}
+	if (file_header.version != kSnapshotVersion) {
+		fprintf(stderr, "%s: unsupported snapshot version %u\n", path, file_header.version);
+		return false;
+	}
+
+	uint64_t table_end = sizeof(SnapshotHeader)
+		+ (uint64_t)file_header.field_count * sizeof(SnapshotFieldHeader);
+	if (table_end > file.size()) {
+		fprintf(stderr, "%s: truncated snapshot\n", path);
+		return false;
+	}
+	fields.resize(file_header.field_count);
+	if (!fields.empty()) {
+		memcpy(&fields[0], file.data() + sizeof(SnapshotHeader), fields.size() * sizeof(SnapshotFieldHeader));
+	}
+
+	for (SnapshotFieldHeader &field : fields) {
+		field.name[sizeof(field.name) - 1] = '\0';
+		uint64_t expected = (uint64_t)field.width * field.height * field.components * sizeof(float);
+		if (field.width <= 0 || field.height <= 0 || field.components <= 0 || field.bytes != expected
+			|| field.offset % sizeof(float) != 0 || field.offset + field.bytes > file.size()) {
+			fprintf(stderr, "%s: invalid field %s\n", path, field.name);
+			fields.clear();
+			return false;
+		}
+	}
+	return true;
+}
+
+const SnapshotFieldHeader *Snapshot::field(const char *name, int components) const {
+	for (const SnapshotFieldHeader &field : fields) {
+		if (strcmp(field.name, name) == 0 && field.components == components) {
+			return &field;
+		}
+	}
+	return nullptr;
+}
@@ -0,0 +1,78 @@
+#ifndef _SNAPSHOT_HPP_
+#define _SNAPSHOT_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mapped_file.hpp"
+
+// Versioned binary snapshot of the simulation state. A fixed header and a
+// table of fields are followed by each field's float texels, row-major from
+// the bottom row like glGetTexImage, starting on a page boundary so mapped
+// fields can be handed straight to glTexSubImage2D. Little endian.
+//
+//   SnapshotHeader
+//   SnapshotFieldHeader * field_count
+//   padding, field data, padding, field data...
+const char kSnapshotMagic[4] = { 'G', 'F', 'D', 'S' };
+const uint32_t kSnapshotVersion = 1;
+
+struct SnapshotHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t field_count;
+	uint32_t simulation_divisor;
+	int32_t canvas_width;
+	int32_t canvas_height;
+	uint64_t step;
+};
+
+struct SnapshotFieldHeader
+{
+	char name[16]; // null terminated.
+	int32_t width;
+	int32_t height;
+	int32_t components;
+	uint32_t reserved;
+	uint64_t offset; // bytes from the start of the file.
+	uint64_t bytes;
+};
+
+// A field to write, |data| holds width * height * components floats.
+struct SnapshotField
+{
+	std::string name;
+	int width;
+	int height;
+	int components;
+	std::vector<float> data;
+};
+
+// Writes |fields| to |path|. Returns false and prints the error on failure.
+bool writeSnapshot(const char *path, int canvas_width, int canvas_height,
+	int simulation_divisor, uint64_t step, const std::vector<SnapshotField> &fields);
+
+// A memory-mapped snapshot, fields are only paged in when read.
+class Snapshot
+{
+public:
+	// Maps and validates |path|. Returns false and prints the error on failure.
+	bool load(const char *path);
+
+	const SnapshotHeader &header() const { return file_header; }
+
+	// The named field, or null if it's missing or doesn't have |components|.
+	const SnapshotFieldHeader *field(const char *name, int components) const;
+	const float *fieldData(const SnapshotFieldHeader &field) const {
+		return (const float*)(file.data() + field.offset);
+	}
+
+private:
+	MappedFile file;
+	SnapshotHeader file_header;
+	std::vector<SnapshotFieldHeader> fields;
+};
+
+#endif
\ No newline at end of file
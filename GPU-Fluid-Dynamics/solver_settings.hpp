@@ -0,0 +1,92 @@
+#ifndef _SOLVER_SETTINGS_HPP_
+#define _SOLVER_SETTINGS_HPP_
+
+enum class PressureSolver
+{
+	Jacobi,
+	Multigrid,
+};
+
+// Semi-Lagrangian advection traces each texel back along the velocity and
+// interpolates, which smooths the fields a little every step. MacCormack
+// follows it with a correction from advecting the result back again, which
+// keeps detail on a much coarser grid for one more pass over the fields.
+enum class AdvectionScheme
+{
+	SemiLagrangian,
+	MacCormack,
+};
+
+// Pressure solve configuration shared by the GPU and CPU solvers.
+struct PressureSettings
+{
+	PressureSolver solver = PressureSolver::Jacobi;
+
+	int jacobi_iterations = 200;
+
+	int multigrid_cycles = 4;
+	int multigrid_smoothing_iterations = 2; // per level before and after.
+	int multigrid_coarse_iterations = 40;
+	float multigrid_relaxation = 0.8f;
+
+	// When positive the solve stops as soon as the RMS residual drops to the
+	// tolerance, with the iteration counts above acting as caps. The
+	// residual is checked every |residual_check_interval| Jacobi iterations
+	// or after every V-cycle.
+	float residual_tolerance = 0;
+	int residual_check_interval = 20;
+
+	// Start from the previous frame's pressure, scaled, rather than zero.
+	bool warm_start = false;
+	float warm_start_scale = 1;
+};
+
+// Edge length of the tiles tracked by sparse simulation, the pressure.comp tile.
+const int kSparseTileSize = 32; // texels.
+
+// Restricts every stage to the tiles with non-negligible velocity or
+// divergence, those within |margin| tiles of them and those under the mouse
+// impulse, shared by the GPU and CPU solvers. Quiescent tiles keep their
+// velocity and colour and have zero pressure and divergence. The pressure
+// solve is only sparse for Jacobi, multigrid still covers the whole grid.
+struct SparseTileSettings
+{
+	bool enabled = false;
+
+	// A tile stays active while either maximum exceeds its threshold.
+	float velocity_threshold = 0.01f; // texels per advection timestep unit.
+	float divergence_threshold = 0.01f;
+
+	int margin = 1; // tiles.
+};
+
+// The parameters of one simulation of an ensemble, shared by GpuEnsemble and
+// CpuEnsemble. The impulse is applied every step, like the headless impulse.
+struct EnsembleMember
+{
+	float impulse_x = 0; // texels.
+	float impulse_y = 0;
+	float impulse_dx = 1;
+	float impulse_dy = 0;
+	float impulse_radius = 40;
+
+	float advection_timestep = 4;
+	int jacobi_iterations = 200;
+};
+
+// Convergence of the most recent pressure solve.
+struct PressureSolveStats
+{
+	int iterations = 0; // Jacobi iterations or V-cycles.
+	float residual = 0; // RMS.
+
+	// Only tracked by the CPU solver.
+	double cell_updates = 0; // summed over every level.
+	double seconds = 0;
+
+	double cellUpdatesPerSecond() const {
+		return seconds > 0 ? cell_updates / seconds : 0;
+	}
+};
+
+#endif
@@ -0,0 +1,17 @@
+#version 330
+
+in vec2 offset;
+flat in vec4 splat;
+
+uniform bool dye_pass;
+
+out vec4 result;
+
+// The velocity pass is blended additively and the dye pass mixes towards the
+// emitter colour by the alpha.
+void main()
+{
+	float r = min(length(offset), 1.0);
+	float mag = 1.0 - r;
+	result = dye_pass ? vec4(splat.rgb, splat.a * mag) : vec4(splat.xy * mag*mag, 0.0, 0.0);
+}
\ No newline at end of file
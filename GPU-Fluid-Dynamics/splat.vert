@@ -0,0 +1,48 @@
+#version 330
+
+// One quad per emitter over its radius, drawn into the velocity or colour
+// field with blending, see applyEmitters(). Each emitter is drawn four times,
+// offset by the grid size towards the far edges, so splats wrap like the
+// fields' GL_REPEAT sampling.
+
+const int kMaxEmitters = 256; // per draw, kMaxEmittersPerBatch.
+
+struct Emitter
+{
+	vec4 position_radius; // canvas pixels.
+	vec4 force_dye; // force in pixels per step, dye opacity.
+	vec4 colour;
+};
+
+layout(std140) uniform EmitterBlock
+{
+	Emitter emitters[kMaxEmitters];
+};
+
+uniform vec2 grid_size;
+uniform float grid_scale; // texels of the target field per canvas pixel.
+uniform bool dye_pass;
+
+// From the centre in radii.
+out vec2 offset;
+flat out vec4 splat;
+
+void main()
+{
+	Emitter emitter = emitters[gl_InstanceID / 4];
+	int copy = gl_InstanceID % 4;
+
+	vec2 centre = emitter.position_radius.xy * grid_scale;
+	float radius = max(emitter.position_radius.z * grid_scale, 0.5);
+	vec2 wrap = vec2(copy % 2, copy / 2) * mix(grid_size, -grid_size, greaterThan(centre, grid_size * 0.5));
+
+	// Padded by a texel so small emitters still cover a texel centre.
+	vec2 corner = vec2(gl_VertexID % 2, gl_VertexID / 2) * 2.0 - 1.0;
+	offset = corner * (radius + 1.0) / radius;
+	vec2 position = centre + wrap + corner * (radius + 1.0);
+	gl_Position = vec4(position / grid_size * 2.0 - 1.0, 0.0, 1.0);
+
+	splat = dye_pass
+		? vec4(emitter.colour.rgb, emitter.force_dye.z)
+		: vec4(emitter.force_dye.xy * grid_scale, 0.0, 0.0);
+}
\ No newline at end of file
@@ -0,0 +1,174 @@
+/*
+* Copyright (c) 2017 Owen Glofcheski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#include "stage_profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+RollingHistogram::RollingHistogram(int capacity) : capacity(std::max(1, capacity)) {
+	samples.reserve(this->capacity);
+}
+
+void RollingHistogram::add(double ms) {
+	if ((int)samples.size() < capacity) {
+		samples.push_back(ms);
+	} else {
+		samples[next] = ms;
+	}
+	next = (next + 1) % capacity;
+}
+
+void RollingHistogram::clear() {
+	samples.clear();
+	next = 0;
+}
+
+double RollingHistogram::mean() const {
+	if (samples.empty()) {
+		return 0;
+	}
+	double sum = 0;
+	for (double sample : samples) {
+		sum += sample;
+	}
+	return sum / samples.size();
+}
+
+double RollingHistogram::max() const {
+	return samples.empty() ? 0 : *std::max_element(samples.begin(), samples.end());
+}
+
+double RollingHistogram::percentile(double p) const {
+	if (samples.empty()) {
+		return 0;
+	}
+	std::vector<double> sorted = samples;
+	int rank = (int)std::ceil(p / 100 * sorted.size()) - 1;
+	rank = std::min(std::max(rank, 0), (int)sorted.size() - 1);
+	std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+	return sorted[rank];
+}
+
+std::vector<double> RollingHistogram::chronological() const {
+	if ((int)samples.size() < capacity) {
+		return samples;
+	}
+	std::vector<double> ordered(samples.begin() + next, samples.end());
+	ordered.insert(ordered.end(), samples.begin(), samples.begin() + next);
+	return ordered;
+}
+
+int StageProfiler::addStage(const std::string &name) {
+	Stage stage;
+	stage.name = name;
+	stages.push_back(stage);
+	return (int)stages.size() - 1;
+}
+
+void StageProfiler::record(int stage, double ms) {
+	stages[stage].histogram.add(ms);
+	stages[stage].interval_ms += ms;
+	stages[stage].interval_samples++;
+}
+
+void StageProfiler::recordDropped(int stage) {
+	++stages[stage].dropped;
+}
+
+void StageProfiler::clear() {
+	for (Stage &stage : stages) {
+		stage.histogram.clear();
+		stage.dropped = 0;
+		stage.interval_ms = 0;
+		stage.interval_samples = 0;
+	}
+}
+
+double StageProfiler::takeIntervalMean(int stage) {
+	Stage &s = stages[stage];
+	double mean = s.interval_samples > 0 ? s.interval_ms / s.interval_samples : 0;
+	s.interval_ms = 0;
+	s.interval_samples = 0;
+	return mean;
+}
+
+bool StageProfiler::writeCsv(const char *path) const {
+	FILE *file = fopen(path, "w");
+	if (!file) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		return false;
+	}
+	fprintf(file, "stage,samples,dropped,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n");
+	for (const Stage &stage : stages) {
+		const RollingHistogram &h = stage.histogram;
+		fprintf(file, "%s,%d,%d,%.4f,%.4f,%.4f,%.4f,%.4f\n", stage.name.c_str(), h.count(),
+			stage.dropped, h.mean(), h.percentile(50), h.percentile(95), h.percentile(99), h.max());
+	}
+	fclose(file);
+	return true;
+}
+
+bool StageProfiler::writeJson(const char *path) const {
+	FILE *file = fopen(path, "w");
+	if (!file) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		return false;
+	}
+	fprintf(file, "{\n\t\"stages\": [");
+	for (size_t i = 0; i < stages.size(); ++i) {
+		const RollingHistogram &h = stages[i].histogram;
+		fprintf(file, "%s\n\t\t{\n", i > 0 ? "," : "");
+		fprintf(file, "\t\t\t\"name\": \"%s\",\n", stages[i].name.c_str());
+		fprintf(file, "\t\t\t\"samples\": %d,\n", h.count());
+		fprintf(file, "\t\t\t\"dropped\": %d,\n", stages[i].dropped);
+		fprintf(file, "\t\t\t\"mean_ms\": %.4f,\n", h.mean());
+		fprintf(file, "\t\t\t\"p50_ms\": %.4f,\n", h.percentile(50));
+		fprintf(file, "\t\t\t\"p95_ms\": %.4f,\n", h.percentile(95));
+		fprintf(file, "\t\t\t\"p99_ms\": %.4f,\n", h.percentile(99));
+		fprintf(file, "\t\t\t\"max_ms\": %.4f,\n", h.max());
+		fprintf(file, "\t\t\t\"history_ms\": [");
+		std::vector<double> history = h.chronological();
+		for (size_t j = 0; j < history.size(); ++j) {
+			fprintf(file, "%s%.4f", j > 0 ? ", " : "", history[j]);
+		}
+		fprintf(file, "]\n\t\t}");
+	}
+	fprintf(file, "\n\t]\n}\n");
+	fclose(file);
+	return true;
+}
+
+void StageProfiler::print() const {
+	printf("%-20s %8s %8s %9s %9s %9s %9s\n", "stage", "samples", "dropped",
+		"p50 ms", "p95 ms", "p99 ms", "max ms");
+	for (const Stage &stage : stages) {
+		const RollingHistogram &h = stage.histogram;
+		if (h.count() == 0 && stage.dropped == 0) {
+			continue;
+		}
+		printf("%-20s %8d %8d %9.3f %9.3f %9.3f %9.3f\n", stage.name.c_str(), h.count(), stage.dropped,
+			h.percentile(50), h.percentile(95), h.percentile(99), h.max());
+	}
+}
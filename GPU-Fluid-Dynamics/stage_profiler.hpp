@@ -0,0 +1,93 @@
+#ifndef _STAGE_PROFILER_HPP_
+#define _STAGE_PROFILER_HPP_
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// The most recent |capacity| samples of a timing, in milliseconds.
+class RollingHistogram
+{
+public:
+	explicit RollingHistogram(int capacity = 600);
+
+	void add(double ms);
+	void clear();
+
+	int count() const { return (int)samples.size(); }
+	double mean() const;
+	double max() const;
+
+	// Nearest rank percentile, |p| in [0, 100].
+	double percentile(double p) const;
+
+	// Oldest first.
+	std::vector<double> chronological() const;
+
+private:
+	int capacity;
+	int next = 0;
+	std::vector<double> samples;
+};
+
+// Named per-stage timings of the simulation, filled by the GPU timer queries
+// or by StageProfiler::Scope on the CPU.
+class StageProfiler
+{
+public:
+	// Returns the index used to record the stage.
+	int addStage(const std::string &name);
+
+	int stageCount() const { return (int)stages.size(); }
+	const std::string &stageName(int stage) const { return stages[stage].name; }
+	const RollingHistogram &histogram(int stage) const { return stages[stage].histogram; }
+	int dropped(int stage) const { return stages[stage].dropped; }
+
+	void record(int stage, double ms);
+	// Counts a sample that ran but whose time was never measured.
+	void recordDropped(int stage);
+	void clear();
+
+	// Mean of the samples recorded since the last call, for reports over a
+	// shorter interval than the histograms keep.
+	double takeIntervalMean(int stage);
+
+	// One line per stage with its sample and dropped counts, mean, p50, p95,
+	// p99 and max.
+	bool writeCsv(const char *path) const;
+	// As the CSV with every retained sample, oldest first.
+	bool writeJson(const char *path) const;
+
+	void print() const;
+
+	// Records the wall time between construction and destruction.
+	class Scope
+	{
+	public:
+		Scope(StageProfiler &profiler, int stage)
+			: profiler(profiler), stage(stage), start(std::chrono::steady_clock::now()) {}
+		~Scope() {
+			profiler.record(stage, std::chrono::duration<double, std::milli>(
+				std::chrono::steady_clock::now() - start).count());
+		}
+
+	private:
+		StageProfiler &profiler;
+		int stage;
+		std::chrono::steady_clock::time_point start;
+	};
+
+private:
+	struct Stage
+	{
+		std::string name;
+		RollingHistogram histogram;
+		int dropped = 0;
+		double interval_ms = 0;
+		int interval_samples = 0;
+	};
+
+	std::vector<Stage> stages;
+};
+
+#endif
\ No newline at end of file
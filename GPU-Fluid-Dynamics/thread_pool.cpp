@@ -0,0 +1,99 @@
+/*
+* Copyright (c) 2017 Owen Glofcheski
+*
+* This software is provided 'as-is', without any express or implied
+* warranty. In no event will the authors be held liable for any damages
+* arising from the use of this software.
+*
+* Permission is granted to anyone to use this software for any purpose,
+* including commercial applications, and to alter it and redistribute it
+* freely, subject to the following restrictions:
+*
+*    1. The origin of this software must not be misrepresented; you must not
+*    claim that you wrote the original software. If you use this software
+*    in a product, an acknowledgment in the product documentation would be
+*    appreciated but is not required.
+*
+*    2. Altered source versions must be plainly marked as such, and must not
+*    be misrepresented as being the original software.
+*
+*    3. This notice may not be removed or altered from any source
+*    distribution.
+*/
+
+#include "thread_pool.hpp"
+
+ThreadPool::ThreadPool(int thread_count)
+	: thread_count(thread_count) {
+	for (int i = 1; i < thread_count; ++i) {
+		workers.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	work_ready.notify_all();
+
+	for (std::thread &worker : workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int begin, int end)> &task) {
+	int threads = threadCount();
+	if (threads == 1 || count < threads) {
+		task(0, count);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		current_task = &task;
+		task_count = count;
+		remaining = threads - 1;
+		++generation;
+	}
+	work_ready.notify_all();
+
+	task(0, count / threads);
+
+	std::unique_lock<std::mutex> lock(mutex);
+	work_done.wait(lock, [this] { return remaining == 0; });
+	current_task = nullptr;
+}
+
+void ThreadPool::workerLoop(int index) {
+	int threads = thread_count;
+	int seen_generation = 0;
+
+	while (true) {
+		const std::function<void(int, int)> *task;
+		int count;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			work_ready.wait(lock, [&] { return stopping || generation != seen_generation; });
+			if (stopping) {
+				return;
+			}
+			seen_generation = generation;
+			task = current_task;
+			count = task_count;
+		}
+
+		int begin = (int)((long long)count * index / threads);
+		int end = (int)((long long)count * (index + 1) / threads);
+		(*task)(begin, end);
+
+		bool last;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			last = --remaining == 0;
+		}
+		if (last) {
+			work_done.notify_one();
+		}
+	}
+}
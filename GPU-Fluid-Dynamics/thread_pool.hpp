@@ -0,0 +1,40 @@
+#ifndef _THREAD_POOL_HPP_
+#define _THREAD_POOL_HPP_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads for splitting a loop into contiguous bands.
+class ThreadPool
+{
+public:
+	explicit ThreadPool(int thread_count);
+	~ThreadPool();
+
+	int threadCount() const { return thread_count; }
+
+	// Splits [0, |count|) into one contiguous band per thread and blocks until
+	// every band has run. The calling thread runs the first band itself.
+	void parallelFor(int count, const std::function<void(int begin, int end)> &task);
+
+private:
+	void workerLoop(int index);
+
+	int thread_count;
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable work_ready;
+	std::condition_variable work_done;
+
+	const std::function<void(int, int)> *current_task = nullptr;
+	int task_count = 0;
+	int generation = 0;
+	int remaining = 0;
+	bool stopping = false;
+};
+
+#endif
@@ -2,5 +2,5 @@ uniform vec4 colour;
 
 void main()
 {
-	gl_FragColor.xyz = vec4(colour.xyz, 0.5f);
+	gl_FragColor = vec4(colour.xyz, 0.5);
 }
\ No newline at end of file
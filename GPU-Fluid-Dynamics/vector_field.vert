@@ -1,22 +1,36 @@
 #version 330
 
-layout(location = 0) in vec2 vPos; 
-
 uniform sampler2D vector_field;
 
+// Single channel fields are drawn with a y component derived from x.
+uniform bool scalar_field;
+
+// One triangle per cell, generated from gl_VertexID without any vertex data.
+uniform ivec2 triangle_grid;
+
 void main()
 {
-	vec2 sampler_pos = vPos / 2 + vec2(0.5, 0.5);
+	int cell = gl_VertexID / 3;
+	vec2 vPos = 2.0 * vec2(cell % triangle_grid.x, cell / triangle_grid.x)
+		/ vec2(triangle_grid - 1) - 1.0;
+
+	vec2 sampler_pos = vPos / 2.0 + vec2(0.5, 0.5);
 	vec2 vector = texture2D(vector_field, sampler_pos).xy;
-	float length = vector.length();
-	vector = vector / vector.length() / 40.0 * log(1.0f * vector.length());
+	if (scalar_field) {
+		vector.y = vector.x * 20.0;
+	}
+	float magnitude = length(vector);
+	if (magnitude > 0.0) {
+		vector = vector / magnitude / 40.0 * log(1.0 + magnitude);
+	}
 
 	vec2 parallel = vec2(-vector.y, vector.x);
 	if (gl_VertexID % 3 == 0) {
 	    gl_Position.xy = vPos + vector;
 	} else if (gl_VertexID % 3 == 1) {
-	    gl_Position.xy = vPos + -parallel / 4;
+	    gl_Position.xy = vPos + -parallel / 4.0;
 	} else {
-	    gl_Position.xy = vPos + parallel / 4;
+	    gl_Position.xy = vPos + parallel / 4.0;
 	}
+	gl_Position.zw = vec2(0.0, 1.0);
 }
\ No newline at end of file
@@ -19,6 +19,6 @@ void main()
 	float pT = texture2D(pressure_sampler, uv + e_y).x;
 
 	// Subtract the gradient of the pressure.
-	gl_FragData[0].x = velocity.x - timestep / (2 * e_x.x) * (pR - pL);
-	gl_FragData[0].y = velocity.y - timestep / (2 * e_y.y) * (pT - pB);
+	gl_FragData[0].x = velocity.x - timestep / (2.0 * e_x.x) * (pR - pL);
+	gl_FragData[0].y = velocity.y - timestep / (2.0 * e_y.y) * (pT - pB);
 }
\ No newline at end of file